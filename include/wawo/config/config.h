@@ -103,6 +103,65 @@
 #define WAWO_DEFAULT_KEEPALIVE_INTERVAL	4
 #define WAWO_DEFAULT_KEEPALIVE_PROBES	10
 
+#define WAWO_UDP_MMSG_MAX 64
+
 #define WAWO_ENABLE_WCP
 
+#ifndef WAWO_DEFAULT_WCP_ENGINE_COUNT
+	#define WAWO_DEFAULT_WCP_ENGINE_COUNT 4
+#endif
+
+#define WAWO_MAX_WCP_ENGINE_COUNT 64
+
+//max concurrent wcp fds, wcp::set_fd_max overrides it
+#ifndef WAWO_DEFAULT_WCP_FD_MAX
+	#define WAWO_DEFAULT_WCP_FD_MAX (128*1024)
+#endif
+#define WAWO_MAX_WCP_FD_MAX (1<<20)
+
+#ifndef WAWO_DEFAULT_WCP_RCV_BATCH
+	#define WAWO_DEFAULT_WCP_RCV_BATCH 32
+#endif
+
+#ifndef WAWO_DEFAULT_WCP_SND_BATCH
+	#define WAWO_DEFAULT_WCP_SND_BATCH 32
+#endif
+
+//0 for reno, 1 for bbr, refer to wawo::net::WCP_Congestion
+#ifndef WAWO_DEFAULT_WCP_CONGESTION
+	#define WAWO_DEFAULT_WCP_CONGESTION 0
+#endif
+
+#ifndef WAWO_DEFAULT_WCP_PACING
+	#define WAWO_DEFAULT_WCP_PACING 0
+#endif
+
+//0 to coalesce small writes into full packs
+#ifndef WAWO_DEFAULT_WCP_NODELAY
+	#define WAWO_DEFAULT_WCP_NODELAY 1
+#endif
+
+//(k<<8)|m, m parity packs for each k data packs, 0 for off
+#ifndef WAWO_DEFAULT_WCP_FEC
+	#define WAWO_DEFAULT_WCP_FEC 0
+#endif
+
+//1 for the listeners to carry the accepted connections on their own udp socket
+#ifndef WAWO_DEFAULT_WCP_SHARED_SO
+	#define WAWO_DEFAULT_WCP_SHARED_SO 0
+#endif
+
+//ceiling of the receive window auto tuning, wcp::set_rcv_wnd_max overrides it
+#ifndef WAWO_DEFAULT_WCP_RCV_WND_MAX
+	#define WAWO_DEFAULT_WCP_RCV_WND_MAX (8*1024*1024)
+#endif
+#define WAWO_MAX_WCP_RCV_WND_MAX (32*1024*1024)
+
+//slab 0 is shared by the threads that did not pick one, wcp engine#N uses slab N+1
+#define WAWO_OBJECT_POOL_SLAB_MAX (WAWO_MAX_WCP_ENGINE_COUNT+1)
+
+#ifndef WAWO_OBJECT_POOL_SLAB_CACHE_MAX
+	#define WAWO_OBJECT_POOL_SLAB_CACHE_MAX 1024
+#endif
+
 #endif // end for _CONFIG_WAWO_CONFIG_H_
\ No newline at end of file
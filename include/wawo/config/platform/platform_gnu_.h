@@ -10,6 +10,7 @@
 #include <errno.h>
 
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <sys/socket.h>
 #include <fcntl.h>
 #include <netinet/in.h>
@@ -36,6 +37,19 @@ namespace wawo {
 	#define INVALID_SOCKET -1
 #endif
 
+//udp segmentation offload, older libc headers do not carry them
+#ifndef SOL_UDP
+	#define SOL_UDP 17
+#endif
+
+#ifndef UDP_SEGMENT
+	#define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+	#define UDP_GRO 104
+#endif
+
 
 #define WAWO_CLOSE_SOCKET	::close
 #define WAWO_DUP			dup
@@ -237,6 +237,18 @@ namespace wawo { namespace net {
 		virtual void check_ioe() = 0;
 		virtual void watch(u8_t const& flag, int const& fd, WWRP<ref_base> const& cookie, fn_io_event const& fn,fn_io_event_error const& err ) = 0;
 		virtual void unwatch(u8_t const& flag, int const& fd) = 0;
+
+#ifdef WAWO_ENABLE_WCP
+		//for observers that serve wcp fds in their own loop
+		virtual void wcp_watch(u8_t const& flag, int const& fd, WWRP<ref_base> const& cookie, fn_io_event const& fn, fn_io_event_error const& err) {
+			(void)flag; (void)fd; (void)cookie; (void)fn; (void)err;
+			WAWO_THROW("wcp watch not supported by this observer");
+		}
+		virtual void wcp_unwatch(u8_t const& flag, int const& fd) {
+			(void)flag; (void)fd;
+			WAWO_THROW("wcp unwatch not supported by this observer");
+		}
+#endif
 	};
 }}
 #endif //
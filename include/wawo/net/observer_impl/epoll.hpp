@@ -6,6 +6,10 @@
 #include <wawo/core.hpp>
 #include <wawo/net/observer_abstract.hpp>
 
+#ifdef WAWO_ENABLE_WCP
+	#include <wawo/net/observer_impl/wpoll.hpp>
+#endif
+
 namespace wawo { namespace net { namespace observer_impl {
 
 	using namespace wawo::thread;
@@ -15,6 +19,12 @@ namespace wawo { namespace net { namespace observer_impl {
 	{
 		int m_epfd;
 
+#ifdef WAWO_ENABLE_WCP
+		//wcp fds are watched by m_wpoll, its eventfd sits in m_epfd
+		wpoll m_wpoll;
+		WWRP<observer_ctx> m_wpoll_ctx;
+#endif
+
 	public:
 		epoll():
 			observer_abstract(),
@@ -150,6 +160,16 @@ namespace wawo { namespace net { namespace observer_impl {
 			TRACE_IOE("[EPOLL][##%d][#%d][unwatch]epoll op success, op code: %d, op flag: %d, new flag: %d", m_epfd, fd, epoll_op, flag, ctx->flag );
 		}
 
+#ifdef WAWO_ENABLE_WCP
+		void wcp_watch(u8_t const& flag, int const& fd, WWRP<ref_base> const& cookie, fn_io_event const& fn, fn_io_event_error const& err) {
+			m_wpoll.watch(flag, fd, cookie, fn, err);
+		}
+
+		void wcp_unwatch(u8_t const& flag, int const& fd) {
+			m_wpoll.unwatch(flag, fd);
+		}
+#endif
+
 	public:
 		void init() {
 			//observer_abstract::init();
@@ -161,6 +181,28 @@ namespace wawo { namespace net { namespace observer_impl {
 				WAWO_THROW("create epoll handle failed");
 			}
 
+#ifdef WAWO_ENABLE_WCP
+			m_wpoll.init();
+
+			int wpfd = m_wpoll.fd();
+			if (wpfd < 0) {
+				WAWO_ERR("[EPOLL]wpoll fd failed!, errno: %d", wpfd);
+				WAWO_THROW("get wpoll fd failed");
+			}
+
+			m_wpoll_ctx = wawo::make_ref<observer_ctx>();
+			m_wpoll_ctx->fd = wpfd;
+			m_wpoll_ctx->poll_type = T_WPOLL;
+
+			//level triggered, one check_ioe may leave some ready ones for the next round
+			struct epoll_event epEvent;
+			epEvent.data.ptr = (void*)m_wpoll_ctx.get();
+			epEvent.events = EPOLLIN;
+			if (-1 == epoll_ctl(m_epfd, EPOLL_CTL_ADD, wpfd, &epEvent)) {
+				WAWO_ERR("[EPOLL][##%d]add wpoll fd: %d failed!, errno: %d", m_epfd, wpfd, socket_get_last_errno());
+				WAWO_THROW("add wpoll fd failed");
+			}
+#endif
 			WAWO_DEBUG("[EPOLL]init write epoll handle ok" );
 		}
 		void deinit() {
@@ -172,6 +214,14 @@ namespace wawo { namespace net { namespace observer_impl {
 
 			WAWO_CONDITION_CHECK( m_epfd != -1);
 
+#ifdef WAWO_ENABLE_WCP
+			//the eventfd is gone already if wcp stopped first
+			struct epoll_event epEvent;
+			epoll_ctl(m_epfd, EPOLL_CTL_DEL, m_wpoll_ctx->fd, &epEvent);
+			m_wpoll_ctx = NULL;
+			m_wpoll.deinit();
+#endif
+
 			int rt = ::close( m_epfd );
 			if( -1 == rt ) {
 				WAWO_ERR("[EPOLL]epoll handle: %d, epoll close failed!: %d", m_epfd, socket_get_last_errno() );
@@ -197,6 +247,13 @@ namespace wawo { namespace net { namespace observer_impl {
 			for( int i=0;i<nTotalEvents;++i) {
 
 				WAWO_ASSERT( epEvents[i].data.ptr != NULL );
+
+#ifdef WAWO_ENABLE_WCP
+				if (epEvents[i].data.ptr == m_wpoll_ctx.get()) {
+					m_wpoll.check_ioe();
+					continue;
+				}
+#endif
 				WWRP<observer_ctx> ctx (static_cast<observer_ctx*> (epEvents[i].data.ptr)) ;
 				WAWO_ASSERT(ctx->fd > 0);
 
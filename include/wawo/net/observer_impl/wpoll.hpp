@@ -24,6 +24,12 @@ namespace wawo { namespace net { namespace observer_impl {
 			WAWO_ASSERT( m_wpHandle > 0 );
 		}
 
+		//readable while check_ioe has something to do
+		int fd() const {
+			WAWO_ASSERT(m_wpHandle > 0);
+			return wcp::instance()->wpoll_fd(m_wpHandle);
+		}
+
 		void deinit() {
 			WAWO_ASSERT( m_wpHandle > 0 );
 
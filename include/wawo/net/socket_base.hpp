@@ -103,6 +103,18 @@ namespace wawo { namespace net {
 	typedef u32_t (*fn_sendto)(int const& fd, wawo::byte_t const* const buff, wawo::u32_t const& length, const wawo::net::address& addr, int& ec_o, int const& flag);
 	typedef u32_t (*fn_recvfrom)(int const& fd, byte_t* const buff_o, wawo::u32_t const& size, address& addr_o, int& ec_o, int const& flag );
 
+	//for batched datagram io, null addr means the connected peer
+	//segment non-zero means buff carries several datagrams of segment bytes each (the last one may be shorter), for udp gso/gro
+	struct udp_message {
+		byte_t* buff;
+		u32_t len;
+		address addr;
+		u16_t segment;
+	};
+
+	typedef u32_t (*fn_sendmmsg)(int const& fd, udp_message const* const msgs, u32_t const& count, int& ec_o, int const& flag);
+	typedef u32_t (*fn_recvmmsg)(int const& fd, udp_message* const msgs_o, u32_t const& count, int& ec_o, int const& flag);
+
 	class socket_base;
 	struct async_cookie :
 		public ref_base
@@ -265,6 +277,8 @@ namespace wawo { namespace net {
 		fn_recv m_fn_recv;
 		fn_sendto m_fn_sendto;
 		fn_recvfrom m_fn_recvfrom;
+		fn_sendmmsg m_fn_sendmmsg;
+		fn_recvmmsg m_fn_recvmmsg;
 
 		fn_getsockopt m_fn_getsockopt;
 		fn_setsockopt m_fn_setsockopt;
@@ -330,6 +344,19 @@ namespace wawo { namespace net {
 		u32_t sendto(byte_t const* const buff, wawo::u32_t const& size, const address& addr, int& ec_o, int const& flag = 0);
 		u32_t recvfrom(byte_t* const buff_o, wawo::u32_t const& size, address& addr, int& ec_o);
 
+		//return the number of messages sent/received, msgs_o[i].len is the capacity in and the received bytes out
+		u32_t sendmmsg(udp_message const* const msgs, u32_t const& count, int& ec_o, int const& flag = 0);
+		u32_t recvmmsg(udp_message* const msgs_o, u32_t const& count, int& ec_o);
+
+		//route the datagrams sent through a shim, the shim sends them on with the returned fn
+		inline fn_sendmmsg set_send_shim(fn_send const& send, fn_sendto const& sendto, fn_sendmmsg const& sendmmsg) {
+			fn_sendmmsg next = m_fn_sendmmsg;
+			m_fn_send = send;
+			m_fn_sendto = sendto;
+			m_fn_sendmmsg = sendmmsg;
+			return next;
+		}
+
 		inline int getsockopt(int const& level, int const& option_name, void* value, socklen_t* option_len) {
 			return m_fn_getsockopt(m_fd, level, option_name, value, option_len);
 		}
@@ -376,6 +403,10 @@ namespace wawo { namespace net {
 		int reuse_addr();
 		int reuse_port();
 
+		//udp only, E_EOPNOTSUPP if the platform or kernel refuse it
+		int set_udp_segment(u16_t const& size);
+		int set_udp_gro(bool const& on_off);
+
 		inline void handle_async_connected() {
 			lock_guard<spin_mutex> _lg(m_mutexes[L_SOCKET]);
 			WAWO_ASSERT(m_fd > 0);
@@ -41,7 +41,9 @@ namespace wawo { namespace net {
 	{
 		enum event_op_code {
 			OP_WATCH,
-			OP_UNWATCH
+			OP_UNWATCH,
+			OP_WCP_WATCH,
+			OP_WCP_UNWATCH
 		};
 
 		struct event_op {
@@ -85,6 +87,20 @@ namespace wawo { namespace net {
 			m_ops.push({ flag, OP_UNWATCH, fd, NULL, NULL, NULL });
 		}
 
+#ifdef WAWO_ENABLE_WCP
+		inline void wcp_watch(u8_t const& flag, int const& fd, WWRP<ref_base> const& cookie, fn_io_event const& fn, fn_io_event_error const& err) {
+			WAWO_ASSERT(fd > 0);
+			lock_guard<spin_mutex> _lg(m_ops_mutex);
+			m_ops.push({ flag, OP_WCP_WATCH, fd, cookie, fn, err });
+		}
+
+		inline void wcp_unwatch(u8_t const& flag, int const& fd) {
+			WAWO_ASSERT(fd > 0);
+			lock_guard<spin_mutex> _lg(m_ops_mutex);
+			m_ops.push({ flag, OP_WCP_UNWATCH, fd, NULL, NULL, NULL });
+		}
+#endif
+
 	private:
 		observer_abstract* m_impl;
 		spin_mutex m_ops_mutex;
@@ -119,9 +135,14 @@ namespace wawo { namespace net {
 
 #ifdef WAWO_ENABLE_WCP
 			WAWO_ASSERT(m_wcp == NULL);
+#if WAWO_ISGNU
+			//wcp fds are served by the epoll loop through a wpoll eventfd
+			m_wcp = m_default;
+#else
 			m_wcp = wawo::make_ref<socket_observer>(T_WPOLL);
 			WAWO_ALLOC_CHECK(m_wcp, sizeof(socket_observer) );
 			m_wcp->init();
+#endif
 #endif
 		}
 
@@ -130,7 +151,7 @@ namespace wawo { namespace net {
 			m_default->deinit();
 			//m_default = NULL;
 
-#ifdef WAWO_ENABLE_WCP
+#if defined(WAWO_ENABLE_WCP) && !WAWO_ISGNU
 			WAWO_ASSERT(m_wcp != NULL);
 			m_wcp->deinit();
 			//m_wcp = NULL;
@@ -2,19 +2,31 @@
 #define WAWO_NET_WCP_HPP
 
 #include <map>
+#include <set>
 #include <unordered_map>
 #include <queue>
+#include <deque>
 #include <list>
+#include <algorithm>
 
 #include <wawo/core.hpp>
 #include <wawo/singleton.hpp>
 
 #include <wawo/thread/mutex.hpp>
-#include <wawo/thread/ticker.hpp>
+#include <wawo/thread/thread_run_object_abstract.hpp>
 
 #include <wawo/bytes_ringbuffer.hpp>
+#include <wawo/timer_wheel.hpp>
+#include <wawo/seq_ringbuffer.hpp>
+#include <wawo/object_pool.hpp>
 #include <wawo/packet.hpp>
 #include <wawo/net/address.hpp>
+#include <wawo/net/socket_base.hpp>
+#include <wawo/net/wcp_cc.hpp>
+#include <wawo/net/wcp_fec.hpp>
+#include <wawo/net/wcp_fd_table.hpp>
+#include <wawo/net/wcp_tuple_table.hpp>
+#include <wawo/net/wcp_netem.hpp>
 
 #include <wawo/log/logger_manager.h>
 
@@ -40,11 +52,20 @@
 #define WCP_RCV_BUFFER_MAX (1024*1024)
 #define WCP_RCV_BUFFER_MIN (WCP_MDU*4)
 #define WCP_RCV_WND_DEFAULT (64*1024)
+#define WCP_RCV_SPACE_INIT (WCP_MDU*10)
+
+//ms a partial pack waits for more data when nodelay is off
+#define WCP_NAGLE_DELAY 5
 
 #define WCP_SND_BUFFER_MAX (1024*1024)
 #define WCP_SND_BUFFER_MIN (WCP_MDU*4)
 #define WCP_SND_WND_DEFAULT (64*1024)
 
+//rb, rb_standby and sb are made on first use at WCP_BUFFER_INIT, doubled on demand up to the buffer size, and released once empty for WCP_BUFFER_IDLE_RELEASE ms
+#define WCP_BUFFER_INIT (4*1024)
+#define WCP_BUFFER_IDLE_RELEASE (10*1000)
+#define WCP_PACK_RING_INIT 16
+
 #define WCP_SND_SSTHRESH_MAX (1024*1024*2)
 #define WCP_SND_SSTHRESH_MIN (4*WCP_MTU)
 #define WCP_SND_SSTHRESH_DEFAULT WCP_SND_SSTHRESH_MAX
@@ -54,11 +75,15 @@
 
 #define WCP_SND_SACK_DUP_COUNT 1
 
+//delayed ack, one ack for WCP_ACK_EVERY packs, or WCP_ACK_DELAY ms after the first one not acked
+#define WCP_ACK_EVERY 2
+#define WCP_ACK_DELAY 10
+
 // one seconds
 #define WCP_RWND_CHECK_GRANULARITY 1000
 
-#define WCP_SRTT_ALPHA (1/8)
-#define WCP_RTTVAR_BETA (1/4)
+#define WCP_SRTT_ALPHA (1.0/8)
+#define WCP_RTTVAR_BETA (1.0/4)
 
 #define WCP_RTO_CLOCK_GRANULARITY 5
 #define WCP_RTO_INIT 1000
@@ -71,16 +96,59 @@
 
 
 #define WCP_SYN_MAX_TIME 30*1000
+//a syn cookie is good for the slot it is made in and the one after
+#define WCP_SYN_COOKIE_SLOT (64*1000)
 #define WCP_FIN_MAX_TIME (2*60*1000)
 #define WCP_TIMEWAIT_MAX_TIME (2*60*1000)
 #define WCP_LAST_ACK_MAX_TIME (30*1000)
 
+#define WCP_BATCH_MAX WAWO_UDP_MMSG_MAX
+
+//udp gso/gro, a super datagram must fit in 64k
+#define WCP_GSO_SEGMENT_MAX 44
+#define WCP_GRO_BUFFER_SIZE (64*1024)
+#define WCP_GRO_BATCH 4
+
+//pacing, release times are kept in microseconds, a late sender may catch up by one engine tick at most
+#define WCP_PACING_QUANTUM_US 1000
+#define WCP_PACING_CWND_GAIN_PERCENT 125
+
+//fec parity payload: k, m, idx, reserved, then the coded [flag,dlen,data] of the group
+//data packs are cut WCP_FEC_HEADER_LEN shorter so that a parity pack still fits in one MTU
+#define WCP_FEC_HEADER_LEN 8
+#define WCP_FEC_MDU (WCP_MDU-WCP_FEC_HEADER_LEN)
+#define WCP_FEC_GROUP_MAX 256
+#define WCP_FEC_KM(k,m) ((((k)&0xFF)<<8)|((m)&0xFF))
+
+//stream payload: id, then the seq of the pack in the stream, a stream window pack carries the id and the offset the sender may send up to
+//the ids are 1 to WCP_STREAM_MAX-1, a stream holds the larger of rcv_buffer_size and WCP_STREAM_WND_INIT at the receiver, the sender starts with WCP_STREAM_WND_INIT
+#define WCP_STREAM_MAX 256
+#define WCP_STREAM_HEADER_LEN 6
+#define WCP_STREAM_MDU (WCP_MDU-WCP_STREAM_HEADER_LEN)
+#define WCP_STREAM_WND_LEN (sizeof(u16_t)+sizeof(u64_t))
+#define WCP_STREAM_WND_INIT WCP_RCV_WND_DEFAULT
+
+//wcp level for getsockopt/setsockopt
+#define WCP_SOL 0x5743
+
 #define WCPPACK_TEST_FLAG( pack, _flag ) (((pack).header.flag)&_flag)
 
 namespace wawo { namespace net {
 
 	using namespace wawo::thread;
 
+	//the clock of all wcp timers, microseconds, a simulation may swap in a virtual one before the first engine or wcb is made
+	typedef u64_t(*fn_wcp_clock)();
+	extern fn_wcp_clock wcp_clock;
+
+	inline u64_t wcp_now_us() {
+		return wcp_clock();
+	}
+
+	inline u64_t wcp_now() {
+		return wcp_clock() / 1000;
+	}
+
 	enum WCP_Flag {
 		WCP_FLAG_SYN =	1 << 0,
 		WCP_FLAG_ACK =	1 << 1,
@@ -91,6 +159,11 @@ namespace wawo { namespace net {
 		WCP_FLAG_DAT =	1 << 6,
 		WCP_FLAG_KEEP_ALIVE =	1 << 7,
 		WCP_FLAG_KEEP_ALIVE_REPLY = 1<<8,
+		WCP_FLAG_FEC = 1<<9, //parity of the data packs [seq, seq+k), out of seq space
+		WCP_FLAG_MSG = 1<<10, //one message, in seq space, delivered as it arrives
+		WCP_FLAG_DGM = 1<<11, //one message, out of seq space, neither acked nor retransmitted
+		WCP_FLAG_STM = 1<<12, //data of a stream, delivered in the order of the stream as it arrives
+		WCP_FLAG_STW = 1<<13, //window of a stream
 	};
 
 	enum WCP_CWND_Cfg {
@@ -107,24 +180,110 @@ namespace wawo { namespace net {
 		u16_t dlen;
 	};
 
-	struct WCB_pack {
+	//header and payload are taken from one pooled block, header.dlen bytes of data are valid
+	struct WCB_pack :
+		public wawo::ref_base
+	{
+		WAWO_OBJECT_POOL_NEW_DELETE(WCB_pack)
+
 		WCP_Header header;
-		WWSP<wawo::packet> data;
 		u64_t sent_ts;
 		u32_t sent_times;
+		u64_t sent_us; //first sent, in microseconds
+		u64_t delivered; //WCB::snd_delivered when sent
+		u64_t delivered_us; //WCB::snd_delivered_us when sent
+		byte_t data[WCP_MDU];
+
+		WCB_pack() :
+			sent_ts(0),
+			sent_times(0),
+			sent_us(0),
+			delivered(0),
+			delivered_us(0)
+		{
+			::memset(&header, 0, sizeof(WCP_Header));
+		}
 	};
 
-	struct WCB_received_pack {
+	struct WCB_received_pack :
+		public wawo::ref_base
+	{
+		WAWO_OBJECT_POOL_NEW_DELETE(WCB_received_pack)
+
 		WCP_Header header;
-		WWSP<wawo::packet> data;
 		address	from;
+		byte_t data[WCP_MDU];
+
+		WCB_received_pack()
+		{
+			::memset(&header, 0, sizeof(WCP_Header));
+		}
+	};
+
+	//sacked [start,end) of seq
+	struct WCB_sack_range {
+		u32_t start;
+		u32_t end;
+	};
+	typedef std::vector<WCB_sack_range> WCB_SackRangeVector;
+
+	//one (re)send of a flight, an entry whose pack is acked or sent again since is stale
+	struct WCB_flight_sent {
+		u32_t seq;
+		u64_t ts;
+	};
+	typedef std::deque<WCB_flight_sent> WCB_FlightSentQueue;
+
+	typedef wawo::seq_ringbuffer<WWRP<WCB_pack>> WCB_PackRing;
+	typedef std::queue<WWRP<WCB_pack>> WCB_PackQueue;
+
+	typedef std::vector<WWRP<WCB_received_pack>> WCB_ReceivedPackVector;
+	typedef std::queue<WWRP<WCB_received_pack>> WCB_ReceivedPackQueue;
+	typedef wawo::seq_ringbuffer<WWRP<WCB_received_pack>> WCB_ReceivedPackRing;
+
+	struct WCB_fec_group {
+		u8_t k;
+		u8_t m;
+		u16_t len;
+		WWRP<WCB_received_pack> parity[WCP_FEC_M_MAX];
+	};
+	typedef std::map<u32_t, WCB_fec_group> WCB_FecGroupMap;
+
+	//the packs of all the streams share the seq space, acks and cwnd of the connection, each stream orders its own by a seq of its own
+	struct WCB_snd_stream :
+		public wawo::ref_base
+	{
+		WWRP<wawo::bytes_ringbuffer> sb;
+		u32_t seq; //of the next pack
+		u64_t offset; //bytes cut into packs
+		u64_t limit; //the peer has room up to it
+
+		WCB_snd_stream() :
+			seq(0),
+			offset(0),
+			limit(WCP_STREAM_WND_INIT)
+		{}
 	};
 
-	typedef std::list <WWSP<WCB_pack>> WCB_PackList;
-	typedef std::queue<WWSP<WCB_pack>> WCB_PackQueue;
+	struct WCB_rcv_stream :
+		public wawo::ref_base
+	{
+		WWRP<wawo::bytes_ringbuffer> rb;
+		WCB_ReceivedPackRing received; //ahead of next
+		u32_t next;
+		u64_t read; //bytes read by user
+		u64_t limit; //the peer was told last
+
+		WCB_rcv_stream() :
+			received(WCP_PACK_RING_INIT),
+			next(0),
+			read(0),
+			limit(WCP_STREAM_WND_INIT)
+		{}
+	};
 
-	typedef std::vector<WWSP<WCB_received_pack>> WCB_ReceivedPackVector;
-	typedef std::list<WWSP<WCB_received_pack>> WCB_ReceivedPackList;
+	typedef std::map<u16_t, WWRP<WCB_snd_stream>> WCB_SndStreamMap;
+	typedef std::map<u16_t, WWRP<WCB_rcv_stream>> WCB_RcvStreamMap;
 
 	enum WCB_State {
 		WCB_CLOSED,
@@ -148,15 +307,18 @@ namespace wawo { namespace net {
 		SND_BIGGEST_SACK_UPDATE = 1<<1,
 		SND_UNA_UPDATE = 1<<2,
 		SND_FAST_RECOVERED = 1<<3,
-		SND_CWND_SLOW_START = 1<<4,
-		SND_CWND_CONGEST_AVOIDANCE = 1<<5,
-		SND_LOST_DETECTED = 1<<6,
+		RCV_ACK_NOW = 1<<4,
+		SND_DGM_HELD = 1<<5, //an unreliable message waits for the next round
+		SND_RETRANSMIT_PACED = 1<<6, //due flights wait for snd_pacing_release_us
 
 		WCB_FLAG_IS_LISTENER = 1<<7,
 		WCB_FLAG_IS_PASSIVE_OPEN = 1<<8,
 		WCB_FLAG_IS_ACTIVE_OPEN	= 1<<9,
 		WCB_FLAG_FIRST_RTT_DONE = 1<<10,
 		WCB_FLAG_CLOSED_CALLED = 1<<11,
+		WCB_FLAG_SHARED_SO = 1<<13,
+
+		RCV_FEC_ARRIVED = 1<<12,
 	};
 
 	struct WCB_SndInfo {
@@ -178,6 +340,87 @@ namespace wawo { namespace net {
 		WCP_O_NONBLOCK = 1 << 0,
 	};
 
+	//flag of send/recv, a message is sent in one pack, at most WCP_MDU bytes, and is received whole by one recv, the part past size is discarded
+	//messages of both kinds come out of one queue by a recv with either flag, the byte stream is untouched by them
+	enum WCP_MsgFlag {
+		WCP_MSG_UNORDERED = 1 << 0, //reliable, not held behind a lost pack
+		WCP_MSG_UNRELIABLE = 1 << 1, //sent once, dropped by the link or by a full receive queue
+	};
+
+	//options of level WCP_SOL, value type is int except WCP_SO_MEMINFO and WCP_SO_INFO
+	enum WCP_SockOpt {
+		WCP_SO_RCV_BATCH = 1, //max datagrams per recvmmsg
+		WCP_SO_SND_BATCH = 2, //max datagrams per sendmmsg
+		WCP_SO_OFFLOAD = 3, //WCP_Offload bits, getsockopt returns what the kernel accepted
+		WCP_SO_CONGESTION = 4, //WCP_Congestion, settable before connect/listen only
+		WCP_SO_PACING = 5, //0 or 1, spread data packs over the rtt
+		WCP_SO_PACING_RATE_MAX = 6, //bytes per second, 0 for no limit
+		WCP_SO_FEC = 7, //WCP_FEC_KM(k,m), m parity packs for each k data packs, 0 for off
+		WCP_SO_SHARED_SO = 8, //0 or 1, settable before listen only, the accepted ones receive and send through the listener's udp socket
+		WCP_SO_MEMINFO = 9, //WCP_MemInfo, getsockopt only
+		WCP_SO_RCV_WND_MAX = 10, //bytes, ceiling of the receive window auto tuning, 0 for off, SO_RCVBUF turns it off too
+		WCP_SO_NODELAY = 11, //0 or 1, as TCP_NODELAY, with 0 a partial pack waits for the acks of the sent data, WCP_NAGLE_DELAY ms at most
+		WCP_SO_INFO = 12, //WCP_Info, getsockopt only
+	};
+
+	//bytes held by a wcb, as of its last update by the engine
+	struct WCP_MemInfo {
+		u32_t rcv_buffer; //rb and rb_standby
+		u32_t snd_buffer; //sb
+		u32_t rcv_packs; //received packs not delivered yet, and the ones kept for fec
+		u32_t snd_packs; //queued and in flight
+		u32_t scratch; //pack rings, pack vectors, gro/fec/sack work buffers
+		u32_t total; //all above and the wcb itself
+	};
+
+	//counted by the engine thread, per wcb since it was created, or summed over the wcbs of all engines
+	struct WCP_Counters {
+		u64_t packs_in;
+		u64_t packs_out; //retransmits included
+		u64_t bytes_in; //headers included
+		u64_t bytes_out;
+		u64_t retransmits_ack_skip; //sacked past it
+		u64_t retransmits_fast_recovery;
+		u64_t retransmits_rto;
+		u64_t rto_fires; //flight checks that found a pack timed out
+		u64_t dup_packs;
+		u64_t sacks_in; //sack packs with ranges, plain acks not counted
+		u64_t sacks_out;
+		u64_t msgs_in; //messages queued for the user, both kinds
+		u64_t msgs_out; //messages sent first time
+		u64_t msgs_dropped; //unreliable ones that found the receive queue full
+		u64_t malformed_packs; //whole packs whose payload does not parse, dropped
+	};
+
+	//as of its last update by the engine, like TCP_INFO
+	struct WCP_Info {
+		u8_t state; //WCB_State
+		u8_t congestion; //WCP_Congestion
+		u32_t rto; //ms
+		u32_t srtt;
+		u32_t rttvar;
+		u32_t snd_una;
+		u32_t snd_nxt;
+		u32_t snd_cwnd; //bytes
+		u32_t snd_ssthresh;
+		u32_t snd_rwnd;
+		u32_t snd_nflight_bytes;
+		u32_t rcv_next;
+		u32_t rcv_wnd;
+		WCP_Counters counters;
+	};
+
+	enum WCP_Offload {
+		WCP_OFFLOAD_GSO = 1 << 0,
+		WCP_OFFLOAD_GRO = 1 << 1,
+	};
+
+	struct WCB_batch {
+		u32_t count;
+		udp_message msgs[WCP_BATCH_MAX];
+		byte_t buffer[WCP_BATCH_MAX*WCP_MTU];
+	};
+
 	enum READ_flag {
 		READ_RWND_LESS_THAN_MTU			= 1,
 		READ_RWND_MORE_THAN_MTU			= 1<<1,
@@ -194,11 +437,18 @@ namespace wawo { namespace net {
 	};
 
 
+	enum WCB_buffers {
+		WCB_BUFFERS_RCV = 1,
+		WCB_BUFFERS_SND = 1<<1
+	};
+
 	struct WCB;
 	typedef std::vector< WWRP<WCB> > WCBList;
 	typedef std::queue< WWRP<WCB> > WCBQueue;
 
 	class socket;
+	class wcp_engine;
+	struct wpoll_watch_event;
 
 	struct WCB_keepalive_vals {
 		u16_t idle;
@@ -211,6 +461,9 @@ namespace wawo { namespace net {
 		public wawo::ref_base
 	{
 		WWRP<socket> so;
+		WWRP<wcp_engine> engine;
+		std::atomic<bool> engine_update_pending;
+		u64_t engine_timer_expire;
 		int fd;
 		wawo::u32_t four_tuple_hash_id;
 		spin_mutex mutex;
@@ -221,12 +474,31 @@ namespace wawo { namespace net {
 		int wcb_errno;
 		int wcb_option;
 
+		u16_t rcv_batch;
+		u16_t snd_batch;
+		u8_t offload;
+		u8_t congestion;
+		u8_t pacing;
+		u8_t nodelay;
+		u32_t pacing_rate_max;
+		u8_t fec_k;
+		u8_t fec_m;
+		u8_t shared_so;
+
+		//listener: itself and the accepted ones on its socket, the last one closes it
+		std::atomic<u32_t> shared_so_refs;
+		//accepted one: the listener that owns the socket
+		WWRP<WCB> shared_so_owner;
+		//accepted one in WCB_SYN_RECEIVED: the listener to wake once it leaves the state
+		WWRP<WCB> accept_listener;
+
 		u16_t wcb_flag;
 		u8_t r_flag;
 		u8_t s_flag;
 
 		wawo::net::address local_addr;
 		wawo::net::address remote_addr;
+		wawo::net::address listen_addr; //local address of the accepting listener, the four tuple of a passive wcb is (listen_addr, remote_addr)
 
 		u32_t rto;
 		u32_t srtt;
@@ -235,14 +507,36 @@ namespace wawo { namespace net {
 		spin_mutex received_vec_mutex;
 		WWSP<WCB_ReceivedPackVector> received_vec;
 		WWSP<WCB_ReceivedPackVector> received_vec_standby;
+		std::vector<byte_t> rcv_gro_buffer;
 
 		WCB_RcvInfo rcv_info;
-		WCB_ReceivedPackList rcv_received;
+		u32_t rcv_acked; //rcv_info.next the peer was told last
+		u64_t rcv_ack_since; //the first pack not acked yet arrived then, 0 for none
+		WCB_ReceivedPackRing rcv_received;
+		WCB_ReceivedPackRing rcv_fec_history; //delivered packs of the last WCP_FEC_K_MAX seqs
+		WCB_FecGroupMap rcv_fec_groups;
+		std::vector<byte_t> rcv_fec_buffer;
 
 		spin_mutex r_mutex;
 		condition_any r_cond;
 		WWRP<wawo::bytes_ringbuffer> rb;
 		WWRP<wawo::bytes_ringbuffer> rb_standby;
+		WCB_ReceivedPackQueue r_msgs;
+		u32_t r_msgs_bytes; //rcv_buffer_size is the most r_msgs holds too
+		WCB_RcvStreamMap r_streams; //added by the engine only
+		std::set<u16_t> r_streams_ready; //with data in rb
+		std::vector<u16_t> r_streams_wnd; //read enough to tell the peer
+		u32_t rcv_buffer_size; //the most rb or rb_standby holds
+		u64_t rcv_buffer_last_active;
+
+		u32_t rcv_wnd_max; //rcv_wnd_tune grows rcv_buffer_size up to it
+		u32_t rcv_rtt; //ms one window takes to arrive, 0 for no sample yet
+		u32_t rcv_rtt_seq;
+		u64_t rcv_rtt_time;
+		u64_t rcv_delivered; //bytes written to rb_standby
+		u64_t rcv_space_copied; //bytes read by user at rcv_space_time
+		u64_t rcv_space_time;
+		u32_t rcv_space; //the most bytes read by user in one rtt
 		u64_t r_timer_last_rwnd_update;
 
 		WCBList backloglist_pending;
@@ -250,24 +544,38 @@ namespace wawo { namespace net {
 		u32_t backlog_size;
 
 		u32_t snd_biggest_ack;
-		u64_t snd_lost_detected_timer;
-		u32_t snd_lost_biggest_seq;
-		u32_t snd_lost_cwnd_for_fast_recovery_compensation;
-		u8_t  snd_lost_bigger_than_lost_seq_time;
-
-		u64_t snd_timer_cwnd_congest_avoidance;
 		WCB_SndInfo snd_info;
 		WCB_PackQueue snd_sending;
+		WWRP<wcp_cc_abstract> cc;
 
 		u32_t snd_nflight_bytes;
-		u32_t snd_nflight_bytes_max;
-		WCB_PackList snd_flights;
+		u64_t snd_delivered;
+		u64_t snd_delivered_us;
+		u64_t snd_pacing_release_us; //next data pack leaves no earlier than this
+		u64_t snd_nagle_hold_since; //the partial tail of sb waits from then, 0 for none
+		u64_t snd_dgm_round; //unreliable messages of one srtt from then and the flight share the cwnd
+		u32_t snd_dgm_bytes;
+		std::vector<WWRP<WCB_pack>> snd_fec_group;
+		std::vector<byte_t> snd_fec_buffer;
+		WCB_PackRing snd_flights;
 		u64_t snd_last_rto_timer;
-		WWSP<wawo::packet> snd_sacked_pack_tmp;
+		WCB_FlightSentQueue snd_flights_sent; //in the order they were sent, check_flights looks at the due head only
+		std::vector<WCB_flight_sent> snd_flights_due; //scratch of check_flights
+		u64_t snd_flights_oldest_sent; //sent_ts of the oldest flight as check_flights saw it, 0 for none
+		u64_t snd_flights_unwalked_sent; //so of the first one check_flights did not look at, 0 for none
+		std::vector<u32_t> snd_sacked_seqs;
+		WCB_PackQueue snd_stream_wnds; //seq assigned by check_send
+		WCB_SackRangeVector snd_sack_scoreboard;
 
 		spin_mutex s_mutex;
 		WWRP<wawo::bytes_ringbuffer> sb;
+		u32_t snd_buffer_size; //the most sb holds
+		u64_t snd_buffer_last_active;
 		WCB_PackQueue s_sending_standby;
+		WCB_PackQueue s_msgs; //seq assigned by check_send
+		u32_t s_msgs_bytes; //snd_buffer_size is the most s_msgs holds too
+		WCB_SndStreamMap s_streams;
+		u16_t s_stream_next; //round robin of the streams to cut a pack from
 
 		WCB_PackQueue s_sending_ignore_seq_space;
 
@@ -275,6 +583,15 @@ namespace wawo { namespace net {
 		WCB_keepalive_vals keepalive_vals;
 		u8_t keepalive_probes_sent;
 
+		spin_mutex wpoll_mutex;
+		WWSP<wpoll_watch_event> wpoll_evt; //set by wpoll_ctl, one wpoll per wcb
+
+		u8_t buffers_held; //WCB_BUFFERS_RCV/WCB_BUFFERS_SND, what check_buffers might release later
+		WCP_MemInfo mem_info; //guarded by mutex
+		WCP_Counters counters; //engine thread only
+		WCP_Counters counters_folded; //the part added to the engine counters
+		WCP_Info info; //guarded by mutex
+
 		WCB();
 		~WCB();
 
@@ -284,6 +601,21 @@ namespace wawo { namespace net {
 			timer_state = 0;
 			state = WCB_CLOSED;
 
+			engine_update_pending.store(false, std::memory_order_release);
+			engine_timer_expire = 0;
+
+			rcv_batch = WAWO_DEFAULT_WCP_RCV_BATCH;
+			snd_batch = WAWO_DEFAULT_WCP_SND_BATCH;
+			offload = 0;
+			congestion = WAWO_DEFAULT_WCP_CONGESTION;
+			pacing = WAWO_DEFAULT_WCP_PACING;
+			nodelay = WAWO_DEFAULT_WCP_NODELAY;
+			pacing_rate_max = 0;
+			fec_k = (WAWO_DEFAULT_WCP_FEC >> 8) & 0xFF;
+			fec_m = WAWO_DEFAULT_WCP_FEC & 0xFF;
+			shared_so = WAWO_DEFAULT_WCP_SHARED_SO;
+			shared_so_refs.store(0, std::memory_order_relaxed);
+
 			wcb_flag = 0;
 			wcb_option = 0;
 			wcb_errno = 0;
@@ -293,11 +625,10 @@ namespace wawo { namespace net {
 			received_vec = wawo::make_shared<WCB_ReceivedPackVector>();
 			received_vec_standby = wawo::make_shared<WCB_ReceivedPackVector>();
 
-			received_vec->reserve(256);
-			received_vec_standby->reserve(256);
-
 			rcv_info.next = 0;
 			rcv_info.wnd = WCP_RCV_WND_DEFAULT;
+			rcv_acked = 0;
+			rcv_ack_since = 0;
 
 			wcb_flag = 0;
 			r_flag = 0;
@@ -306,9 +637,6 @@ namespace wawo { namespace net {
 			r_timer_last_rwnd_update = 0;
 
 			snd_biggest_ack = 0;
-			wcb_flag = SND_CWND_SLOW_START;
-			snd_lost_detected_timer = 0;
-			snd_lost_biggest_seq = 0;
 
 			snd_info.dsn = 0;
 			snd_info.next = 0;
@@ -317,26 +645,52 @@ namespace wawo { namespace net {
 			snd_info.cwnd = WCP_CWND_Cfg::WCP_IW*WCP_MTU;
 			snd_info.rwnd = WCP_RCV_WND_DEFAULT;
 
-			snd_timer_cwnd_congest_avoidance = 0;
+			cc = wcp_cc_make(congestion);
+			WAWO_ASSERT(cc != NULL);
+			cc->init(*this);
 
 			snd_nflight_bytes = 0;
-			snd_nflight_bytes_max = 0;
+			snd_delivered = 0;
+			snd_delivered_us = 0;
+			snd_pacing_release_us = 0;
+			snd_nagle_hold_since = 0;
+			snd_dgm_round = 0;
+			snd_dgm_bytes = 0;
 			snd_last_rto_timer = 0;
-
-			snd_sacked_pack_tmp = wawo::make_shared<wawo::packet>(64*1024);
+			snd_flights_oldest_sent = 0;
+			snd_flights_unwalked_sent = 0;
 
 			WAWO_ASSERT(rb == NULL);
 			WAWO_ASSERT(rb_standby == NULL);
 			WAWO_ASSERT(sb == NULL);
 
-			rb = wawo::make_ref<wawo::bytes_ringbuffer>(WCP_RCV_WND_DEFAULT);
-			rb_standby = wawo::make_ref<wawo::bytes_ringbuffer>(WCP_RCV_WND_DEFAULT);
-
-			sb = wawo::make_ref<wawo::bytes_ringbuffer>(WCP_SND_WND_DEFAULT);
+			rcv_buffer_size = WCP_RCV_WND_DEFAULT;
+			rcv_buffer_last_active = 0;
+			r_msgs_bytes = 0;
+			s_msgs_bytes = 0;
+			s_stream_next = 1;
+
+			rcv_wnd_max = WAWO_DEFAULT_WCP_RCV_WND_MAX;
+			rcv_rtt = 0;
+			rcv_rtt_seq = 0;
+			rcv_rtt_time = 0;
+			rcv_delivered = 0;
+			rcv_space_copied = 0;
+			rcv_space_time = 0;
+			rcv_space = WCP_RCV_SPACE_INIT;
+			snd_buffer_size = WCP_SND_WND_DEFAULT;
+			snd_buffer_last_active = 0;
+
+			buffers_held = 0;
+			::memset(&mem_info, 0, sizeof(WCP_MemInfo));
+			mem_info.total = sizeof(WCB);
+			::memset(&counters, 0, sizeof(WCP_Counters));
+			::memset(&counters_folded, 0, sizeof(WCP_Counters));
+			::memset(&info, 0, sizeof(WCP_Info));
 
 			backlog_size = 128;
 
-			keepalive_timer_last_received_pack = wawo::time::curr_milliseconds();
+			keepalive_timer_last_received_pack = wcp_now();
 			keepalive_vals.idle = 60 ;
 			keepalive_vals.interval = 60;
 			keepalive_vals.probes = 5;
@@ -350,10 +704,17 @@ namespace wawo { namespace net {
 			rb = NULL;
 			rb_standby = NULL;
 			sb = NULL;
+			WCB_ReceivedPackQueue().swap(r_msgs);
+			WCB_PackQueue().swap(s_msgs);
+			r_streams.clear();
+			r_streams_ready.clear();
+			r_streams_wnd.clear();
+			s_streams.clear();
+			WCB_PackQueue().swap(snd_stream_wnds);
 		}
 
 		int get_rcv_buffer_size() const {
-			return (rb->capacity()>>1);
+			return (rcv_buffer_size>>1);
 		}
 
 		int set_rcv_buffer_size(int const& size) {
@@ -366,20 +727,16 @@ namespace wawo { namespace net {
 			u32_t _size = WAWO_MIN( size, WCP_RCV_BUFFER_MAX );
 			_size = WAWO_MAX(_size, WCP_RCV_BUFFER_MIN);
 
-			WAWO_ASSERT( rb->count() == 0 );
-			rb = wawo::make_ref<bytes_ringbuffer>(_size<<1);
-			WAWO_ALLOC_CHECK(rb, sizeof(bytes_ringbuffer));
-
-			WAWO_ASSERT(rb_standby->count() == 0);
-			rb_standby = wawo::make_ref<bytes_ringbuffer>(_size<<1);
-
-			rcv_info.wnd = rb->capacity();
+			WAWO_ASSERT(rb == NULL || rb->count() == 0);
+			WAWO_ASSERT(rb_standby == NULL || rb_standby->count() == 0);
+			rcv_buffer_size = _size<<1;
+			rcv_info.wnd = rcv_buffer_size;
 
 			return wawo::OK;
 		}
 
 		int get_snd_buffer_size() const {
-			return (sb->capacity() >> 1);
+			return (snd_buffer_size >> 1);
 		}
 
 		int set_snd_buffer_size(int const& size) {
@@ -392,32 +749,36 @@ namespace wawo { namespace net {
 			u32_t _size = WAWO_MIN(size, WCP_SND_BUFFER_MAX);
 			_size = WAWO_MAX(_size, WCP_SND_BUFFER_MIN);
 
-			WAWO_ASSERT(sb->count() == 0);
-			sb = wawo::make_ref<bytes_ringbuffer>(_size<<1);
-			WAWO_ALLOC_CHECK(sb,sizeof(bytes_ringbuffer));
+			WAWO_ASSERT(sb == NULL || sb->count() == 0);
+			snd_buffer_size = _size<<1;
 
 			return wawo::OK;
 		}
 
 		inline void SYN() {
 			WAWO_ASSERT(state == WCB_CLOSED);
-			WWSP<WCB_pack> opack = wawo::make_shared<WCB_pack>();
+			WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
 			opack->header.seq = snd_info.dsn++;
 			opack->header.flag = WCP_FLAG_SYN;
 			opack->header.dlen = 0;
 			s_sending_standby.push(opack);
 		}
 
-		inline void SYNACK() {
-			WWSP<WCB_pack> opack = wawo::make_shared<WCB_pack>();
+		//echo the cookie of the listener
+		inline void SYNACK(WWRP<WCB_received_pack> const& synack) {
+			WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
 			opack->header.seq = snd_info.dsn++;
 			opack->header.flag = WCP_FLAG_ACK;
 			opack->header.dlen = 0;
+			if (synack->header.dlen >= sizeof(u32_t)) {
+				::memcpy(opack->data, synack->data, sizeof(u32_t));
+				opack->header.dlen = sizeof(u32_t);
+			}
 			s_sending_standby.push(opack);
 		}
 
 		inline void SYNSYNACK() {
-			WWSP<WCB_pack> opack = wawo::make_shared<WCB_pack>();
+			WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
 			opack->header.seq = snd_info.dsn++;
 			opack->header.flag = WCP_FLAG_SYN | WCP_FLAG_ACK;
 			opack->header.dlen = 0;
@@ -426,7 +787,7 @@ namespace wawo { namespace net {
 		}
 
 		inline void FIN() {
-			WWSP<WCB_pack> opack = wawo::make_shared<WCB_pack>();
+			WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
 			opack->header.seq = snd_info.dsn++;
 			opack->header.flag = WCP_FLAG_FIN ;
 			opack->header.dlen = 0;
@@ -434,37 +795,84 @@ namespace wawo { namespace net {
 		}
 
 		inline void FINACK() {
-			WWSP<WCB_pack> opack = wawo::make_shared<WCB_pack>();
+			WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
 			opack->header.seq = snd_info.dsn++;
 			opack->header.flag = WCP_FLAG_ACK;
 			opack->header.dlen = 0;
 			s_sending_standby.push(opack);
 		}
 
-		inline void SACK(WWSP<wawo::packet> const& sacked_packet) {
-			static u32_t pack_acked_max_bytes = (WCP_MDU / sizeof(u32_t) )*sizeof(u32_t);
+		//data: u32_t base, then (u16_t start, u16_t len) ranges relative to base
+		//seqs older than base are covered by header.ack, a range-less SACK still carries it
+		inline void SACK(std::vector<u32_t>& seqs, u32_t const& base) {
+			static const u32_t range_max = (WCP_MDU - sizeof(u32_t)) / (sizeof(u16_t) * 2);
+
+			//by the distance from base, the seqs wrap
+			std::sort(seqs.begin(), seqs.end(), [&base](u32_t const& a, u32_t const& b) {
+				return (a - base) < (b - base);
+			});
+
+			WWRP<WCB_pack> opack = _SACK_make(base);
+			u32_t nranges = 0;
+			u32_t npacks = 0;
+
+			std::vector<u32_t>::const_iterator it = seqs.begin();
+			while (it != seqs.end()) {
+				if (seq_before(*it, base) || ((*it - base) > 0xFFFF)) {
+					++it;
+					continue;
+				}
 
-			while ( sacked_packet->len() ) {
-				WWSP<WCB_pack> opack = wawo::make_shared<WCB_pack>();
-				WWSP<packet> data = wawo::make_shared<wawo::packet>(WCP_MDU);
-				u32_t wlen = sacked_packet->len()>=pack_acked_max_bytes ? pack_acked_max_bytes : sacked_packet->len() ;
-				data->write( sacked_packet->begin(), wlen );
-				sacked_packet->skip(wlen);
+				u32_t const start = *it;
+				u32_t end = start + 1;
+				while ((++it != seqs.end()) && !seq_before(end, *it) && ((end - start) < 0xFFFF)) {
+					if (*it == end) {
+						++end;
+					}
+				}
 
-				opack->header.seq = snd_info.dsn;
-				opack->header.flag = WCP_FLAG_SACK;
-				opack->header.dlen = data->len() & 0xFFFF;
-				opack->data = data;
-				s_sending_ignore_seq_space.push(opack);
+				wawo::bytes_helper::write_u16((start - base) & 0xFFFF, opack->data + opack->header.dlen);
+				opack->header.dlen += sizeof(u16_t);
+				wawo::bytes_helper::write_u16((end - start) & 0xFFFF, opack->data + opack->header.dlen);
+				opack->header.dlen += sizeof(u16_t);
 
-				for (int i = 0; i < WCP_SND_SACK_DUP_COUNT; ++i) {
-					s_sending_ignore_seq_space.push(opack);
+				if (++nranges == range_max) {
+					_SACK_push(opack);
+					++npacks;
+					opack = _SACK_make(base);
+					nranges = 0;
 				}
 			}
+
+			if (nranges > 0 || npacks == 0) {
+				_SACK_push(opack);
+			}
+			seqs.clear();
+		}
+
+		inline WWRP<WCB_pack> _SACK_make(u32_t const& base) {
+			WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
+			opack->header.seq = snd_info.dsn;
+			opack->header.flag = WCP_FLAG_SACK;
+			wawo::bytes_helper::write_u32(base, (byte_t*)opack->data);
+			opack->header.dlen = sizeof(u32_t);
+			return opack;
+		}
+
+		//the ranges drive the fast retransmit of the peer, they are sent more than once, a plain ack is covered by the next one
+		inline void _SACK_push(WWRP<WCB_pack> const& opack) {
+			s_sending_ignore_seq_space.push(opack);
+			if (opack->header.dlen == sizeof(u32_t)) {
+				return;
+			}
+			++counters.sacks_out;
+			for (int i = 0; i < WCP_SND_SACK_DUP_COUNT; ++i) {
+				s_sending_ignore_seq_space.push(opack);
+			}
 		}
 
 		inline void keepalive() {
-			WWSP<WCB_pack> opack = wawo::make_shared<WCB_pack>();
+			WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
 			opack->header.seq = snd_info.dsn;
 			opack->header.flag = WCP_FLAG_KEEP_ALIVE;
 			opack->header.dlen = 0;
@@ -472,7 +880,7 @@ namespace wawo { namespace net {
 		}
 
 		inline void keepalive_reply() {
-			WWSP<WCB_pack> opack = wawo::make_shared<WCB_pack>();
+			WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
 			opack->header.seq = snd_info.dsn;
 			opack->header.flag = WCP_FLAG_KEEP_ALIVE_REPLY;
 			opack->header.dlen = 0;
@@ -480,47 +888,37 @@ namespace wawo { namespace net {
 		}
 
 		inline void update_rwnd() {
-			WWSP<WCB_pack> opack = wawo::make_shared<WCB_pack>();
+			WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
 			opack->header.seq = snd_info.dsn;
 			opack->header.flag = WCP_FLAG_WND ;
 			opack->header.dlen = 0;
 			s_sending_ignore_seq_space.push(opack);
 		}
 
-		inline void SYN_RCVD(WWSP<WCB_received_pack> const& synpack) {
+		//the syn is answered by a cookie, rebuild it for the final ack that brings the cookie back
+		inline void SYN_RCVD(WWRP<WCB_received_pack> const& ackpack) {
 			lock_guard<spin_mutex> _lg(mutex);
 			WAWO_ASSERT(state == WCB_CLOSED);
 
+			WWRP<WCB_received_pack> synpack = wawo::make_ref<WCB_received_pack>();
+			synpack->header.seq = ackpack->header.seq - 1;
+			synpack->header.wnd = ackpack->header.wnd;
+			synpack->header.flag = WCP_FLAG_SYN;
+			synpack->from = ackpack->from;
+
+			//the cookie syn-ack is none of ours, the one we send for the rebuilt syn is acked by the packs after
+			ackpack->header.ack = 0;
+
 			lock_guard<spin_mutex> lg_received_vec(received_vec_mutex);
 			received_vec_standby->push_back(synpack);
+			received_vec_standby->push_back(ackpack);
 			state = WCB_SYN_RECEIVED;
 		}
 
-		inline void _check_cwnd(u32_t const& check_size ) {
-			if (wcb_flag&SND_CWND_SLOW_START) {
-				snd_info.cwnd += check_size;
-
-				if (snd_info.cwnd >= snd_info.ssthresh) {
-					wcb_flag |= SND_CWND_CONGEST_AVOIDANCE;
-					wcb_flag &= ~SND_CWND_SLOW_START;
-				}
-			}
-			else if (wcb_flag&SND_CWND_CONGEST_AVOIDANCE) {
-				u64_t now = wawo::time::curr_milliseconds();
-				if ((now - snd_timer_cwnd_congest_avoidance) >= static_cast<u32_t>(srtt)) {
-					snd_info.cwnd += WCP_MTU;
-					snd_timer_cwnd_congest_avoidance = now;
-				}
-			}
-			else {}
-
-			snd_info.cwnd = WAWO_MIN(snd_info.cwnd, WCP_SND_CWND_MAX);
-		}
-
-		inline void _handle_pack_acked(WCB_PackList::iterator const& otf_it, u64_t const& now) {
+		inline void _handle_pack_acked(WWRP<WCB_pack> const& otf, u64_t const& now) {
 			//rtt sample
-			if ((*otf_it)->sent_times == 1) {
-				u32_t rtt = static_cast<i32_t>(now-(*otf_it)->sent_ts);
+			if (otf->sent_times == 1) {
+				u32_t rtt = static_cast<i32_t>(now-otf->sent_ts);
 				WAWO_ASSERT(rtt >= 0);
 
 				if ( !(wcb_flag&WCB_FLAG_FIRST_RTT_DONE) ) {
@@ -545,25 +943,106 @@ namespace wawo { namespace net {
 				else {}
 			}
 
-			//cwnd check
-			u32_t ntotal_bytes = (*otf_it)->header.dlen + WCP_HeaderLen;
+			u32_t ntotal_bytes = otf->header.dlen + WCP_HeaderLen;
 			WAWO_ASSERT( snd_nflight_bytes >= ntotal_bytes);
 			snd_nflight_bytes -= ntotal_bytes;
-			_check_cwnd(ntotal_bytes);
+
+			//delivery rate sample, bytes delivered since this pack was sent over the time it took
+			//the ms clock is too coarse for it, a ms boundary in between would halve the sample
+			u64_t const now_us = wcp_now_us();
+			snd_delivered += ntotal_bytes;
+			snd_delivered_us = now_us;
+
+			wcp_cc_ack ack;
+			ack.bytes = ntotal_bytes;
+			ack.rtt_us = -1;
+			ack.delivered = snd_delivered;
+			ack.prior_delivered = otf->delivered;
+			ack.delivery_rate = 0;
+			if (otf->sent_times == 1) {
+				ack.rtt_us = static_cast<i64_t>(now_us - otf->sent_us);
+				u64_t const interval = WAWO_MAX(now_us - otf->delivered_us, now_us - otf->sent_us);
+				if (interval > 0) {
+					ack.delivery_rate = ((snd_delivered - otf->delivered) * 1000000) / interval;
+				}
+			}
+			cc->on_acked(*this, ack, now);
+		}
+
+		//bytes per second, 0 for not paced
+		inline u64_t pacing_rate() const {
+			if (!pacing) {
+				return 0;
+			}
+			u64_t rate = cc->pacing_rate();
+			if (rate == 0 && srtt > 0) {
+				rate = (u64_t(snd_info.cwnd) * 1000 * WCP_PACING_CWND_GAIN_PERCENT) / (u64_t(srtt) * 100);
+			}
+			if (pacing_rate_max != 0 && (rate == 0 || rate > pacing_rate_max)) {
+				rate = pacing_rate_max;
+			}
+			return rate;
 		}
 
 		WCB_State update(u64_t const& now);
+		u64_t next_timer(u64_t const& now);
+		void schedule_update();
 		void pump_packs();
+		//one datagram taken off the socket by someone else, a simulated link
+		void pump_pack(byte_t const* const buffer, u32_t const& len, address const& from);
+		void close_so(int const& ec);
+
+		//the bodies of wcp::send and wcp::recv, s_mutex and r_mutex are taken inside
+		int send(byte_t const* const buffer, u32_t const& len, int const& flag = 0);
+		int recv(byte_t* const buffer_o, u32_t const& size, int const& flag = 0);
+		int send_msg(byte_t const* const buffer, u32_t const& len, int const& flag);
+		int recv_msg(byte_t* const buffer_o, u32_t const& size);
+		//false if r_msgs is full
+		bool msg_arrive(WWRP<WCB_received_pack> const& pack);
+
+		//sid 0 is the byte stream of send/recv
+		int send_stream(u16_t const& sid, byte_t const* const buffer, u32_t const& len);
+		int recv_stream(u16_t const& sid, byte_t* const buffer_o, u32_t const& size);
+		int stream_ready(u16_t* const sids, u32_t const& count);
+		void stream_arrive(WWRP<WCB_received_pack> const& pack);
+		void stream_wnd_arrive(WWRP<WCB_received_pack> const& pack);
+		void stream_deliver(u16_t const& sid, WCB_rcv_stream& st);
+		//one pack of the next stream with data and room, false for none
+		bool stream_cut(u32_t& nmax_try_bytes);
+		inline u32_t stream_wnd() const {
+			return WAWO_MAX(rcv_buffer_size, u32_t(WCP_STREAM_WND_INIT));
+		}
+
+		u32_t wpoll_check(u32_t const& evts);
+		void wpoll_notify();
 
 		void check_recv(u64_t const& now);
+		//seqs past rcv_info.next the peer may have in flight, its flight keeps under the wnd we advertise and a pack takes WCP_HeaderLen at least
+		inline u32_t rcv_seq_span() const {
+			return WAWO_MAX(rcv_buffer_size, u32_t(WCP_RCV_WND_DEFAULT)) / WCP_HeaderLen;
+		}
 		void check_flights( u64_t const& now);
 		void check_send(u64_t const& now);
+		void check_ack(u64_t const& now);
+		bool send_ignore_seq_space();
+		void check_buffers(u64_t const& now);
+		void rcv_wnd_tune(u64_t const& now);
+		void take_info();
+
+		void fec_add(WWRP<WCB_pack> const& pack);
+		void fec_flush();
+		void fec_arrive(WWRP<WCB_received_pack> const& parity);
+		void fec_check(u32_t const& seq);
+		void fec_rebuild(WCB_FecGroupMap::iterator const& it);
 
 
-		int send_pack(WWSP<WCB_pack> const& pack);
+		int send_pack(WWRP<WCB_pack> const& pack);
+		int flush_packs();
+		u8_t set_offload(u8_t const& flag);
+		int set_congestion(u8_t const& type);
 
 		void listen_handle_syn();
-		int recv_pack(WWSP<WCB_received_pack>& pack, address& from);
+		int recv_pack(WWRP<WCB_received_pack>& pack, address& from);
 
 		int connect(wawo::net::address const& addr);
 		int shutdown(int const& flag);
@@ -583,11 +1062,14 @@ namespace wawo { namespace net {
 		WPOLLHUB	=0x08 //unexpected close
 	};
 
+	struct wpoll;
 	struct wpoll_watch_event {
 		int fd;
-		u32_t evts;
+		std::atomic<u32_t> evts; //changed under wp's mutex, read without it
 		WWRP<ref_base> cookie;
 		WWRP<WCB> wcb;
+		WWWP<wpoll> wp;
+		std::atomic<bool> queued; //in wp's ready list, set under wp's mutex
 	};
 
 	struct wpoll_event {
@@ -596,33 +1078,44 @@ namespace wawo { namespace net {
 		WWRP<ref_base> cookie;
 	};
 
-	struct wpoll_event_pending {
-		wpoll_event wpoll_evt;
-		WWSP<wpoll_watch_event> watch_evt;
-	};
+	typedef std::map< int, WWSP<wpoll_watch_event> > wpoll_watch_event_map;
+	typedef std::deque< WWSP<wpoll_watch_event> > wpoll_ready_queue;
 
-	typedef std::vector< WWSP<wpoll_watch_event> > wpoll_watch_event_vector;
-	typedef std::queue< wpoll_event_pending > wpoll_event_pending_queue;
+	/*
+	 * a wcb pushes its watch event onto ready when the engine changed it, or when it is (re)watched
+	 * wpoll_wait only looks at ready entries, it pops them with mutex held and checks their level after releasing it, like EPOLLET
+	 * efd is an eventfd that stays readable while ready is not empty, so a wpoll can sit in an epoll set
+	 */
 	struct wpoll {
-		shared_mutex mutex;
-		wpoll_watch_event_vector evts;
+		spin_mutex mutex;
+		condition_any cond;
+		wpoll_watch_event_map evts;
+		wpoll_ready_queue ready;
+		int efd; //-1 if not supported
+		bool closed;
+
+		wpoll();
+		~wpoll();
+
+		void push(WWSP<wpoll_watch_event> const& evt);
+		void close();
+
+		//with mutex held
+		void efd_signal();
+		void efd_reset();
 	};
 
 	typedef std::map<int, WWSP<wpoll>> WpollMap;
 	typedef std::pair<int, WWSP<wpoll>> WpollPair;
 
-	class wcp :
-		public wawo::singleton<wcp>
+	class wcp_engine :
+		public wawo::ref_base,
+		public wawo::thread::thread_run_object_abstract
 	{
-		enum State {
-			S_IDLE,
-			S_RUN,
-			S_EXIT
-		};
-
 		enum OpCode {
 			OP_NONE,
 			OP_WATCH,
+			OP_UPDATE
 		};
 
 		struct Op {
@@ -634,62 +1127,68 @@ namespace wawo { namespace net {
 		typedef std::map<int, WWRP<WCB>> WCBMap;
 		typedef std::pair<int, WWRP<WCB>> WCBPair;
 
-		static std::atomic<int> s_wcb_auto_increament_id;
+		u32_t m_id;
 
-		shared_mutex m_mutex;
-		WpollMap m_wpoll_map;
-		wpoll_event_pending_queue m_event_pending_queue;
+		spin_mutex m_ops_mutex;
+		OpQueue m_ops;
 
-		u8_t m_state;
+		spin_mutex m_signal_mutex;
+		condition_any m_signal_cond;
+		std::atomic<bool> m_signaled;
 
-		shared_mutex m_wcb_map_mutex;
+		//owned by engine thread only
 		WCBMap m_wcb_map;
+		wawo::timer_wheel< WWRP<WCB> > m_timer_wheel;
+		WCB_batch m_snd_batch;
 
-		spin_mutex m_wcb_create_pending_map_mutex;
-		WCBMap m_wcb_create_pending_map;
+		//written by engine thread only, a wcb adds to them after each update
+		spin_mutex m_counters_mutex;
+		WCP_Counters m_counters;
 
-		typedef std::unordered_map<wawo::u32_t, WWRP<WCB>> FourTupleWCBMap;
-		typedef std::pair<wawo::u32_t, WWRP<WCB>> FourTupleWCBPair;
-
-		spin_mutex m_wcb_four_tuple_map_mutex;
-		FourTupleWCBMap m_wcb_four_tuple_map;
-
-		spin_mutex m_ops_mutex;
-		OpQueue m_ops;
+	public:
+		wcp_engine(u32_t const& id);
+		~wcp_engine();
 
-		WWSP<wawo::thread::fn_ticker> m_self_ticker;
+		inline u32_t const& id() const { return m_id; }
 
-		static std::atomic<int> s_wpoll_auto_increament_id;
-	public:
-		wcp();
-		~wcp();
+		//shared by all wcb of this engine, flushed at the end of each WCB::update
+		inline WCB_batch& snd_batch() { return m_snd_batch; }
 
-		int start() { on_start(); return wawo::OK; }
+		void watch(WWRP<WCB> const& wcb) {
+			Op op = { wcb, OP_WATCH };
+			_plan_op(op);
+			notify();
+		}
 
-		void on_start();
+		void update(WWRP<WCB> const& wcb) {
+			Op op = { wcb, OP_UPDATE };
+			_plan_op(op);
+			notify();
+		}
 
-		void stop() {
-			{
-				lock_guard<shared_mutex> lg(m_mutex);
-				if (m_state == S_EXIT) { return; }
+		//wake up engine for newly arrived packs or ops
+		inline void notify() {
+			if (m_signaled.exchange(true, std::memory_order_acq_rel) == false) {
+				lock_guard<spin_mutex> lg(m_signal_mutex);
+				m_signal_cond.notify_one();
 			}
-			on_stop();
 		}
+
+		void on_start();
 		void on_stop();
+		void run();
 
-		void run() {
-			shared_lock_guard<shared_mutex> lg(m_mutex);
-			if (m_state != S_RUN) { return; }
-			_execute_ops();
-			_update();
-		}
+		//execute the planned ops, then fire the timers expired at or before now
+		//run() steps on wcp_now(), a simulation steps an engine that is not started on its own clock
+		void step(u64_t const& now);
 
-		void watch(WWRP<WCB> const& wcb) {
-			Op op = { wcb, OP_WATCH };
-			_plan_op(op);
+		//expire of the earliest timer, ((u64_t)-1) for none
+		inline u64_t next_tick() const {
+			return m_timer_wheel.next_tick();
 		}
 
-		void _update();
+		//add the counters of this engine to total
+		void counters(WCP_Counters& total);
 
 	private:
 		inline void _plan_op(Op const& op) {
@@ -704,14 +1203,118 @@ namespace wawo { namespace net {
 			m_ops.pop();
 		}
 
-		void _execute_ops();
+		void _execute_ops(u64_t const& now);
+		void _update_wcb(WWRP<WCB> const& wcb, u64_t const& now);
+		void _fold_counters(WWRP<WCB> const& wcb);
+	};
+
+	typedef std::vector< WWRP<wcp_engine> > wcp_engine_vector;
+
+	class wcp :
+		public wawo::singleton<wcp>
+	{
+		enum State {
+			S_IDLE,
+			S_RUN,
+			S_EXIT
+		};
+
+		typedef std::map<int, WWRP<WCB>> WCBMap;
+		typedef std::pair<int, WWRP<WCB>> WCBPair;
+
+		shared_mutex m_mutex;
+		WpollMap m_wpoll_map;
+
+		u8_t m_state;
+
+		u32_t m_engine_count;
+		wcp_engine_vector m_engines;
+
+		//fd -> wcb, for api lookup, wcb are driven by their engine
+		//an fd is taken by socket()/accept, and the wcb is bound to it by watch()
+		u32_t m_fd_max;
+		u32_t m_rcv_wnd_max;
+		wcp_fd_table<WCB> m_wcb_table;
+
+		spin_mutex m_wcb_create_pending_map_mutex;
+		WCBMap m_wcb_create_pending_map;
+
+		//passive wcbs by their full four tuple
+		wcp_tuple_table m_four_tuple_table;
+
+		//siphash key of the syn cookies
+		u64_t m_syn_cookie_key[2];
+		u32_t _syn_cookie(wawo::net::address const& local, wawo::net::address const& remote, u64_t const& slot) const;
+
+		static std::atomic<int> s_wpoll_auto_increament_id;
+	public:
+		wcp();
+		~wcp();
+
+		//must be called before start
+		void set_engine_count(u32_t const& count) {
+			lock_guard<shared_mutex> lg(m_mutex);
+			WAWO_ASSERT(m_state == S_IDLE);
+			WAWO_ASSERT(count > 0 && count <= WAWO_MAX_WCP_ENGINE_COUNT);
+			m_engine_count = count;
+		}
+
+		//must be called before start, max concurrent wcp fds
+		void set_fd_max(u32_t const& max) {
+			lock_guard<shared_mutex> lg(m_mutex);
+			WAWO_ASSERT(m_state == S_IDLE);
+			WAWO_ASSERT(max > 0 && max <= WAWO_MAX_WCP_FD_MAX);
+			m_fd_max = max;
+		}
+
+		//must be called before start, ceiling of the receive window auto tuning for the new sockets
+		void set_rcv_wnd_max(u32_t const& max) {
+			lock_guard<shared_mutex> lg(m_mutex);
+			WAWO_ASSERT(m_state == S_IDLE);
+			WAWO_ASSERT(max <= WAWO_MAX_WCP_RCV_WND_MAX);
+			m_rcv_wnd_max = max;
+		}
+
+		int start() { return on_start(); }
+
+		int on_start();
+
+		void stop() {
+			{
+				lock_guard<shared_mutex> lg(m_mutex);
+				if (m_state != S_RUN) { return; }
+			}
+			on_stop();
+		}
+		void on_stop();
+
+		int watch(WWRP<WCB> const& wcb);
+		void unwatch(WWRP<WCB> const& wcb);
+
+	private:
+		WWRP<wcp_engine> _engine_of(u32_t const& four_tuple_hash_id);
 
 	public:
 
-#define WCP_FD_MAX (2048)
+		u32_t make_syn_cookie(wawo::net::address const& local, wawo::net::address const& remote) const;
+		bool check_syn_cookie(wawo::net::address const& local, wawo::net::address const& remote, u32_t const& cookie) const;
 
-		static inline int make_wcb_fd() {
-			return (wawo::atomic_increment(&s_wcb_auto_increament_id) % WCP_FD_MAX) + 0xFFFFFF;
+		inline WWRP<WCB> wcb_of(int const& fd) const {
+			return m_wcb_table.get(fd);
+		}
+
+		//E_EMFILE if all the fds are taken
+		inline int make_wcb_fd() {
+			int fd = m_wcb_table.alloc();
+			if (fd < 0) {
+				wawo::set_last_errno(fd);
+			}
+			return fd;
+		}
+
+		//no-op for an fd freed already, stop() frees all
+		inline void free_wcb_fd(int const& fd) {
+			m_wcb_table.free(fd);
 		}
 
 		int socket(int const& family, int const& socket_type, int const& protocol);
@@ -725,6 +1328,13 @@ namespace wawo { namespace net {
 		int send(int const& fd, byte_t const* const buffer, u32_t const& len, int const& flag);
 		int recv(int const& fd, byte_t* const buffer_o, u32_t const& size, int const& flag);
 
+		//streams of one connection, opened by the first send of either side, no handshake, they end with the connection
+		//a stream is ordered and reliable, a loss holds the stream it is in only, sid 0 is the byte stream of send/recv
+		int send_stream(int const& fd, u16_t const& sid, byte_t const* const buffer, u32_t const& len);
+		int recv_stream(int const& fd, u16_t const& sid, byte_t* const buffer_o, u32_t const& size);
+		//ids of the streams with data to read, count at most, returns the number of them
+		int stream_ready(int const& fd, u16_t* const sids, u32_t const& count);
+
 
 		int getsockname(int const& fd, struct sockaddr* addr, socklen_t* addrlen);
 
@@ -737,39 +1347,45 @@ namespace wawo { namespace net {
 		int wpoll_create();
 		int wpoll_close(int const& wpoll_handle);
 		int wpoll_ctl(int const& wpoll_handle, wpoll_op const& op, wpoll_event const& evt );
-		int wpoll_wait(int const& wpoll_handle, wpoll_event evts[], u32_t const& size);
+		//timeout in milliseconds, 0 returns at once, -1 blocks until something is ready
+		int wpoll_wait(int const& wpoll_handle, wpoll_event evts[], u32_t const& size, int const& timeout = 0);
+
+		//the eventfd of wpoll_handle, readable while wpoll_wait has something to return
+		int wpoll_fd(int const& wpoll_handle);
 
+		//summed over all engines, as of their last updates
+		void counters(WCP_Counters& total);
+
+
+		//engine shard id of a four tuple
+		inline u32_t four_tuple_hash(wawo::net::address const& local, wawo::net::address const& remote) const {
+			return static_cast<u32_t>(m_four_tuple_table.hash(local, remote) >> 32);
+		}
+
+		//fd of the passive wcb on this four tuple, 0 for none, takes no lock
+		inline int four_tuple_fd(wawo::net::address const& local, wawo::net::address const& remote) const {
+			return m_four_tuple_table.find(local, remote);
+		}
 
 		int add_to_four_tuple_hash_map(WWRP<WCB> const& wcb) {
-			lock_guard<spin_mutex> lg_four_tuple_map(m_wcb_four_tuple_map_mutex);
 			WAWO_ASSERT( wcb != NULL) ;
-			WAWO_ASSERT( wcb->four_tuple_hash_id != 0 );
+			WAWO_ASSERT( wcb->wcb_flag&WCB_FLAG_IS_PASSIVE_OPEN );
 
-			if (m_wcb_four_tuple_map.size() >= WCP_FD_MAX) {
+			if (m_four_tuple_table.size() >= m_wcb_table.capacity()) {
 				wawo::set_last_errno(wawo::E_EMFILE);
 				return wawo::E_EMFILE;
 			}
 
-			FourTupleWCBMap::iterator const& it = m_wcb_four_tuple_map.find(wcb->four_tuple_hash_id);
-			if (it != m_wcb_four_tuple_map.end()) {
-				wawo::set_last_errno(wawo::E_EADDRINUSE);
-				return wawo::E_EADDRINUSE;
+			int insertrt = m_four_tuple_table.insert(wcb->listen_addr, wcb->remote_addr, wcb->fd);
+			if (insertrt != wawo::OK) {
+				wawo::set_last_errno(insertrt);
 			}
-			m_wcb_four_tuple_map.insert({ wcb->four_tuple_hash_id,wcb });
-			return wawo::OK;
+			return insertrt;
 		}
 		int remove_from_four_tuple_hash_map(WWRP<WCB> const& wcb) {
-			lock_guard<spin_mutex> lg_four_tuple_map(m_wcb_four_tuple_map_mutex);
 			WAWO_ASSERT(wcb != NULL);
-			WAWO_ASSERT(wcb->four_tuple_hash_id != 0);
 			WAWO_ASSERT(wcb->wcb_flag&WCB_FLAG_IS_PASSIVE_OPEN);
-
-			FourTupleWCBMap::iterator const& it = m_wcb_four_tuple_map.find(wcb->four_tuple_hash_id);
-			if (it == m_wcb_four_tuple_map.end()) {
-				return -1;
-			}
-			m_wcb_four_tuple_map.erase(it);
-			return wawo::OK;
+			return m_four_tuple_table.erase(wcb->listen_addr, wcb->remote_addr, wcb->fd);
 		}
 	};
 }}
@@ -0,0 +1,156 @@
+#ifndef WAWO_NET_WCP_CC_HPP
+#define WAWO_NET_WCP_CC_HPP
+
+#include <wawo/core.hpp>
+#include <wawo/smart_ptr.hpp>
+
+namespace wawo { namespace net {
+
+	struct WCB;
+	struct WCB_pack;
+
+	//value of WCP_SO_CONGESTION
+	enum WCP_Congestion {
+		WCP_CC_RENO = 0, //slow start + congestion avoidance, window halved on lost
+		WCP_CC_BBR = 1, //model based, bottleneck bandwidth and min rtt
+		WCP_CC_MAX
+	};
+
+	//what one acked flight tells the controller
+	struct wcp_cc_ack {
+		u32_t bytes;
+		i64_t rtt_us; //-1 if the pack was retransmitted
+		u64_t delivered; //bytes delivered in total, this pack included
+		u64_t prior_delivered; //bytes delivered in total when this pack was sent
+		u64_t delivery_rate; //bytes per second, 0 if no valid sample
+	};
+
+	/*
+	 * congestion controller of one WCB, all the calls come from the engine thread that owns the WCB
+	 * the controller drives wcb.snd_info.cwnd (and ssthresh if it cares), and may ask for a pacing rate
+	 */
+	class wcp_cc_abstract :
+		public wawo::ref_base
+	{
+		WAWO_DECLARE_NONCOPYABLE(wcp_cc_abstract)
+	public:
+		wcp_cc_abstract() {}
+		virtual ~wcp_cc_abstract() {}
+
+		virtual u8_t type() const = 0;
+		virtual char const* name() const = 0;
+
+		virtual void init(WCB& wcb) = 0;
+		virtual void on_sent(WCB& wcb, WWRP<WCB_pack> const& pack, u64_t const& now) { (void)wcb; (void)pack; (void)now; }
+		virtual void on_acked(WCB& wcb, wcp_cc_ack const& ack, u64_t const& now) = 0;
+
+		//ack is the biggest seq of a sacked range, return true if the lost detected before is recovered
+		virtual bool on_sacked(WCB& wcb, u32_t const& ack, u64_t const& now) { (void)wcb; (void)ack; (void)now; return false; }
+
+		//pack timed out and is going to be retransmitted
+		virtual void on_timeout(WCB& wcb, WWRP<WCB_pack> const& pack, u64_t const& now) { (void)wcb; (void)pack; (void)now; }
+
+		//at least WCP_LOST_THRESHOLD packs timed out in one check
+		virtual void on_lost(WCB& wcb, u64_t const& now) { (void)wcb; (void)now; }
+
+		//bytes per second, 0 means no preference
+		virtual u64_t pacing_rate() const { return 0; }
+	};
+
+	class wcp_cc_reno :
+		public wcp_cc_abstract
+	{
+		enum Reno_Flag {
+			SLOW_START = 1 << 0,
+			CONGEST_AVOIDANCE = 1 << 1,
+			LOST_DETECTED = 1 << 2,
+		};
+
+		u8_t m_flag;
+		u64_t m_timer_congest_avoidance;
+		u64_t m_lost_detected_timer;
+		u32_t m_lost_biggest_seq;
+		u32_t m_lost_cwnd_for_fast_recovery_compensation;
+		u8_t m_lost_bigger_than_lost_seq_time;
+		u32_t m_nflight_bytes_max;
+
+	public:
+		wcp_cc_reno();
+
+		u8_t type() const { return WCP_CC_RENO; }
+		char const* name() const { return "reno"; }
+
+		void init(WCB& wcb);
+		void on_sent(WCB& wcb, WWRP<WCB_pack> const& pack, u64_t const& now);
+		void on_acked(WCB& wcb, wcp_cc_ack const& ack, u64_t const& now);
+		bool on_sacked(WCB& wcb, u32_t const& ack, u64_t const& now);
+		void on_timeout(WCB& wcb, WWRP<WCB_pack> const& pack, u64_t const& now);
+		void on_lost(WCB& wcb, u64_t const& now);
+	};
+
+	enum WCP_BBR_Cfg {
+		WCP_BBR_BW_WINDOW_ROUNDS = 10,
+		WCP_BBR_MIN_RTT_WINDOW = 10*1000,
+		WCP_BBR_PROBE_RTT_TIME = 200,
+		WCP_BBR_MIN_CWND_PACKS = 4,
+		WCP_BBR_FULL_BW_ROUNDS = 3,
+		WCP_BBR_CYCLE_LEN = 8,
+		WCP_BBR_GAIN_UNIT = 256, //gains are in 1/256
+		WCP_BBR_MIN_RTT_FLOOR_US = 1000, //one engine tick, what goes out in a tick is in flight anyway
+	};
+
+	class wcp_cc_bbr :
+		public wcp_cc_abstract
+	{
+		enum BBR_Mode {
+			STARTUP,
+			DRAIN,
+			PROBE_BW,
+			PROBE_RTT
+		};
+
+		u8_t m_mode;
+
+		u64_t m_round;
+		u64_t m_next_round_delivered;
+		u64_t m_bw_rounds[WCP_BBR_BW_WINDOW_ROUNDS]; //max delivery rate of each round
+		u64_t m_btlbw;
+
+		u64_t m_min_rtt_us;
+		u64_t m_min_rtt_ts;
+
+		u64_t m_full_bw;
+		u8_t m_full_bw_count;
+		bool m_filled_pipe;
+
+		u8_t m_cycle_idx;
+		u64_t m_cycle_ts;
+		u64_t m_probe_rtt_done_ts;
+		u32_t m_prior_cwnd; //cwnd before probe rtt
+
+		u32_t m_pacing_gain;
+		u32_t m_cwnd_gain;
+		u64_t m_pacing_rate;
+
+		void _update_bw(wcp_cc_ack const& ack, bool& round_start);
+		void _update_mode(WCB& wcb, bool const& round_start, bool const& min_rtt_expired, u64_t const& now);
+		u32_t _bdp(u32_t const& gain) const;
+
+	public:
+		wcp_cc_bbr();
+
+		u8_t type() const { return WCP_CC_BBR; }
+		char const* name() const { return "bbr"; }
+
+		void init(WCB& wcb);
+		void on_acked(WCB& wcb, wcp_cc_ack const& ack, u64_t const& now);
+		u64_t pacing_rate() const { return m_pacing_rate; }
+
+		u64_t const& btlbw() const { return m_btlbw; }
+		u64_t const& min_rtt_us() const { return m_min_rtt_us; }
+	};
+
+	//NULL if type is unknown
+	WWRP<wcp_cc_abstract> wcp_cc_make(u8_t const& type);
+}}
+#endif
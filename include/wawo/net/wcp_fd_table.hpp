@@ -0,0 +1,256 @@
+#ifndef WAWO_NET_WCP_FD_TABLE_HPP
+#define WAWO_NET_WCP_FD_TABLE_HPP
+
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include <wawo/core.hpp>
+#include <wawo/smart_ptr.hpp>
+#include <wawo/thread/mutex.hpp>
+
+//fd = WCP_FD_TAG | generation<<WCP_FD_INDEX_BITS | slot index, far above what the os hands out
+#define WCP_FD_TAG (1<<30)
+#define WCP_FD_INDEX_BITS 20
+#define WCP_FD_GEN_MASK ((1<<(30-WCP_FD_INDEX_BITS))-1)
+#define WCP_FD_INDEX_MASK ((1<<WCP_FD_INDEX_BITS)-1)
+#define WCP_FD_SLOTS_PER_CHUNK 1024
+
+namespace wawo { namespace net {
+
+	/*
+	 * fd -> T, each slot carries a generation that moves on every reuse, a stale fd never reaches the new owner
+	 * get() takes no lock, alloc/bind/free/clear serialize on a table spin_mutex
+	 *
+	 * get() counts itself in on the reader counter of the slot's current phase while it loads p and grabs a ref, a writer
+	 * publishes the new p, drains the other phase, flips the phase and drains the old one (left-right), then drops the last T
+	 * readers never wait, and a writer only waits for the ones that were in the middle of the few instructions above
+	 */
+	template <class T>
+	class wcp_fd_table {
+		WAWO_DECLARE_NONCOPYABLE(wcp_fd_table)
+
+		struct slot {
+			std::atomic<int> fd; //non zero once bound
+			int owner; //fd handed out by alloc, 0 for free
+			u32_t gen;
+			std::atomic<u32_t> phase;
+			std::atomic<u32_t> readers[2]; //get() in each phase
+			std::atomic<T*> p; //read by get(), ref held by ref
+			WWRP<T> ref; //writers only
+		};
+
+		spin_mutex m_mutex;
+		std::atomic<slot*>* m_chunks;
+		u32_t m_capacity;
+		u32_t m_next; //slots below are allocated
+		u32_t m_count;
+		std::deque<u32_t> m_free;
+
+		inline slot* _slot_of(int const& fd) const {
+			if ((fd&WCP_FD_TAG) == 0 || m_chunks == NULL) {
+				return NULL;
+			}
+			u32_t const idx = fd&WCP_FD_INDEX_MASK;
+			if (idx >= m_capacity) {
+				return NULL;
+			}
+			slot* chunk = m_chunks[idx / WCP_FD_SLOTS_PER_CHUNK].load(std::memory_order_acquire);
+			if (chunk == NULL) {
+				return NULL;
+			}
+			return chunk + (idx%WCP_FD_SLOTS_PER_CHUNK);
+		}
+
+		//m_mutex held, the ref of the last T goes to last, it is safe to drop once this returns
+		static void _publish(slot* s, WWRP<T> const& p, WWRP<T>& last) {
+			s->p.store(p.get());
+			last = s->ref;
+			s->ref = p;
+
+			u32_t const prev = s->phase.load();
+			while (s->readers[prev ^ 1].load() != 0) {
+				std::this_thread::yield();
+			}
+			s->phase.store(prev ^ 1);
+			while (s->readers[prev].load() != 0) {
+				std::this_thread::yield();
+			}
+		}
+
+	public:
+		wcp_fd_table() :
+			m_chunks(NULL),
+			m_capacity(0),
+			m_next(0),
+			m_count(0)
+		{}
+
+		~wcp_fd_table() {
+			deinit();
+		}
+
+		void init(u32_t const& capacity) {
+			lock_guard<spin_mutex> lg(m_mutex);
+			WAWO_ASSERT(m_chunks == NULL);
+			WAWO_ASSERT(capacity > 0 && capacity <= (WCP_FD_INDEX_MASK + 1));
+
+			m_capacity = capacity;
+			u32_t const nchunks = (capacity + WCP_FD_SLOTS_PER_CHUNK - 1) / WCP_FD_SLOTS_PER_CHUNK;
+			m_chunks = new std::atomic<slot*>[nchunks];
+			WAWO_ALLOC_CHECK(m_chunks, sizeof(std::atomic<slot*>)*nchunks);
+			for (u32_t i = 0; i < nchunks; ++i) {
+				m_chunks[i].store(NULL, std::memory_order_relaxed);
+			}
+			m_next = 0;
+			m_count = 0;
+		}
+
+		void deinit() {
+			lock_guard<spin_mutex> lg(m_mutex);
+			if (m_chunks == NULL) {
+				return;
+			}
+			u32_t const nchunks = (m_capacity + WCP_FD_SLOTS_PER_CHUNK - 1) / WCP_FD_SLOTS_PER_CHUNK;
+			for (u32_t i = 0; i < nchunks; ++i) {
+				slot* chunk = m_chunks[i].load(std::memory_order_relaxed);
+				if (chunk != NULL) {
+					delete[] chunk;
+				}
+			}
+			delete[] m_chunks;
+			m_chunks = NULL;
+			m_capacity = 0;
+			m_next = 0;
+			m_count = 0;
+			m_free.clear();
+		}
+
+		//return a new fd, or E_EMFILE
+		int alloc() {
+			lock_guard<spin_mutex> lg(m_mutex);
+			if (m_chunks == NULL) {
+				return wawo::E_INVALID_STATE;
+			}
+
+			u32_t idx;
+			if (m_next < m_capacity) {
+				idx = m_next;
+				if ((idx%WCP_FD_SLOTS_PER_CHUNK) == 0) {
+					slot* chunk = new slot[WCP_FD_SLOTS_PER_CHUNK];
+					WAWO_ALLOC_CHECK(chunk, sizeof(slot)*WCP_FD_SLOTS_PER_CHUNK);
+					for (u32_t i = 0; i < WCP_FD_SLOTS_PER_CHUNK; ++i) {
+						chunk[i].fd.store(0, std::memory_order_relaxed);
+						chunk[i].owner = 0;
+						chunk[i].gen = 0;
+						chunk[i].phase.store(0, std::memory_order_relaxed);
+						chunk[i].readers[0].store(0, std::memory_order_relaxed);
+						chunk[i].readers[1].store(0, std::memory_order_relaxed);
+						chunk[i].p.store(NULL, std::memory_order_relaxed);
+					}
+					m_chunks[idx / WCP_FD_SLOTS_PER_CHUNK].store(chunk, std::memory_order_release);
+				}
+				++m_next;
+			} else if (m_free.size()) {
+				idx = m_free.front();
+				m_free.pop_front();
+			} else {
+				return wawo::E_EMFILE;
+			}
+
+			slot* s = m_chunks[idx / WCP_FD_SLOTS_PER_CHUNK].load(std::memory_order_relaxed) + (idx%WCP_FD_SLOTS_PER_CHUNK);
+			WAWO_ASSERT(s->owner == 0);
+			s->gen = (s->gen + 1)&WCP_FD_GEN_MASK;
+			s->owner = WCP_FD_TAG | (s->gen << WCP_FD_INDEX_BITS) | idx;
+			++m_count;
+			return s->owner;
+		}
+
+		//make fd visible to get()
+		int bind(int const& fd, WWRP<T> const& p) {
+			WWRP<T> last; //released after both locks
+			lock_guard<spin_mutex> lg(m_mutex);
+			slot* s = _slot_of(fd);
+			if (s == NULL || s->owner != fd) {
+				return wawo::E_EBADF;
+			}
+			_publish(s, p, last);
+			s->fd.store(fd, std::memory_order_release);
+			return wawo::OK;
+		}
+
+		int free(int const& fd) {
+			WWRP<T> last; //released after the lock
+			lock_guard<spin_mutex> lg(m_mutex);
+			slot* s = _slot_of(fd);
+			if (s == NULL || s->owner != fd) {
+				return wawo::E_EBADF;
+			}
+			s->fd.store(0, std::memory_order_release);
+			s->owner = 0;
+			_publish(s, NULL, last);
+			m_free.push_back(fd&WCP_FD_INDEX_MASK);
+			WAWO_ASSERT(m_count > 0);
+			--m_count;
+			return wawo::OK;
+		}
+
+		inline WWRP<T> get(int const& fd) const {
+			slot* s = _slot_of(fd);
+			if (s == NULL || s->fd.load(std::memory_order_acquire) != fd) {
+				return NULL;
+			}
+			WWRP<T> p;
+			u32_t const phase = s->phase.load();
+			s->readers[phase].fetch_add(1);
+			T* const raw = s->p.load();
+			if (raw != NULL) {
+				p = WWRP<T>(raw);
+			}
+			s->readers[phase].fetch_sub(1);
+			if (s->fd.load(std::memory_order_acquire) != fd) {
+				return NULL;
+			}
+			return p;
+		}
+
+		//all the bound ones
+		void bound(std::vector< WWRP<T> >& all) {
+			lock_guard<spin_mutex> lg(m_mutex);
+			for (u32_t idx = 0; idx < m_next; ++idx) {
+				slot* s = m_chunks[idx / WCP_FD_SLOTS_PER_CHUNK].load(std::memory_order_relaxed) + (idx%WCP_FD_SLOTS_PER_CHUNK);
+				if (s->fd.load(std::memory_order_relaxed) != 0) {
+					all.push_back(s->ref);
+				}
+			}
+		}
+
+		//free all
+		void clear() {
+			std::vector< WWRP<T> > lasts; //released after the lock
+			lock_guard<spin_mutex> lg(m_mutex);
+			m_free.clear();
+			for (u32_t idx = 0; idx < m_next; ++idx) {
+				slot* s = m_chunks[idx / WCP_FD_SLOTS_PER_CHUNK].load(std::memory_order_relaxed) + (idx%WCP_FD_SLOTS_PER_CHUNK);
+				s->fd.store(0, std::memory_order_release);
+				s->owner = 0;
+				if (s->ref != NULL) {
+					WWRP<T> last;
+					_publish(s, NULL, last);
+					lasts.push_back(last);
+				}
+				m_free.push_back(idx);
+			}
+			m_count = 0;
+		}
+
+		inline u32_t size() {
+			lock_guard<spin_mutex> lg(m_mutex);
+			return m_count;
+		}
+
+		inline u32_t const& capacity() const { return m_capacity; }
+	};
+}}
+#endif
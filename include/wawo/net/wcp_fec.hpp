@@ -0,0 +1,25 @@
+#ifndef WAWO_NET_WCP_FEC_HPP
+#define WAWO_NET_WCP_FEC_HPP
+
+#include <wawo/core.hpp>
+
+#define WCP_FEC_K_MAX 32
+#define WCP_FEC_M_MAX 8
+
+namespace wawo { namespace net {
+
+	/*
+	 * systematic erasure code over GF(2^8), k data blocks protected by up to m parity blocks, any k of the k+m rebuild the data
+	 * parity rows are cauchy rows scaled so that the first one is all 1, m == 1 is plain xor parity
+	 */
+	class wcp_fec {
+	public:
+		//parity block #idx of k data blocks, each of len bytes
+		static void encode(byte_t const* const data[], u8_t const& k, u32_t const& len, u8_t const& idx, byte_t* parity);
+
+		//data[i] == NULL means a missing data block, it gets rebuilt into rebuilt[i]
+		//parity[j] == NULL means a missing parity block, return false if there are not enough parity blocks
+		static bool decode(byte_t const* const data[], u8_t const& k, byte_t const* const parity[], u8_t const& m, u32_t const& len, byte_t* const rebuilt[]);
+	};
+}}
+#endif
@@ -0,0 +1,108 @@
+#ifndef WAWO_NET_WCP_NETEM_HPP
+#define WAWO_NET_WCP_NETEM_HPP
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include <wawo/core.hpp>
+#include <wawo/singleton.hpp>
+#include <wawo/smart_ptr.hpp>
+#include <wawo/thread/mutex.hpp>
+#include <wawo/thread/condition.hpp>
+#include <wawo/thread/thread_run_object_abstract.hpp>
+#include <wawo/net/address.hpp>
+#include <wawo/net/socket_base.hpp>
+
+namespace wawo { namespace net {
+
+	//one way link, applied to each datagram an attached udp socket sends, probabilities in [0,1]
+	struct WCP_NetemConf {
+		u32_t delay; //ms
+		u32_t jitter; //ms, uniform in [-jitter, jitter], the order is kept unless reordered
+		double loss; //bernoulli, used while ge_p is 0
+		double ge_p; //gilbert-elliott, good -> bad
+		double ge_r; //bad -> good
+		double ge_loss_good;
+		double ge_loss_bad;
+		double reorder; //sent without the delay, ahead of the ones queued
+		double duplicate;
+		u64_t rate; //bytes per second, 0 for no cap
+		u32_t limit; //datagrams queued per socket, drop tail, 0 for no limit
+		u32_t seed; //0 for a random one
+	};
+
+	struct WCP_NetemStats {
+		u64_t datagrams; //passed to the emulator
+		u64_t bytes;
+		u64_t lost;
+		u64_t overflowed; //dropped by limit
+		u64_t duplicated;
+		u64_t reordered;
+	};
+
+	/*
+	 * in process link emulator for benchmarking wcp off loopback
+	 *
+	 * attach() puts a shim in front of the send fns of a udp socket, the datagrams are held and sent by the emulator thread
+	 * once they are due, each socket has a link of its own, so both peers in one process shape both directions
+	 * a socket attached stays attached, the shim passes straight through while the emulator is stopped
+	 */
+	class wcp_netem :
+		public wawo::singleton<wcp_netem>,
+		public wawo::thread::thread_run_object_abstract
+	{
+		struct link {
+			fn_sendmmsg next;
+			u64_t tx_free; //us, the cap is busy until then
+			u64_t last; //us, release time of the last one in order
+			u32_t queued;
+			bool bad;
+		};
+
+		struct datagram {
+			int fd;
+			fn_sendmmsg next;
+			address addr;
+			std::vector<byte_t> data;
+		};
+
+		typedef std::map<int, link> LinkMap;
+		typedef std::multimap<u64_t, datagram> DatagramQueue;
+
+		spin_mutex m_mutex;
+		condition_any m_cond;
+		WCP_NetemConf m_conf;
+		WCP_NetemStats m_stats;
+		LinkMap m_links;
+		DatagramQueue m_queue;
+		std::mt19937_64 m_rng;
+
+		inline double _rand() {
+			return std::uniform_real_distribution<double>(0.0, 1.0)(m_rng);
+		}
+
+		bool _lost(link& l);
+		void _emulate(int const& fd, byte_t const* const buffer, u32_t const& len, address const& addr);
+		fn_sendmmsg _next_of(int const& fd);
+
+	public:
+		wcp_netem();
+		~wcp_netem();
+
+		void set_conf(WCP_NetemConf const& conf);
+		WCP_NetemConf conf();
+		WCP_NetemStats stats();
+
+		void attach(WWRP<socket_base> const& so);
+
+		void on_start();
+		void on_stop();
+		void run();
+
+		static u32_t send(int const& fd, byte_t const* const buffer, u32_t const& length, int& ec_o, int const& flag);
+		static u32_t sendto(int const& fd, byte_t const* const buffer, u32_t const& length, address const& addr, int& ec_o, int const& flag);
+		static u32_t sendmmsg(int const& fd, udp_message const* const msgs, u32_t const& count, int& ec_o, int const& flag);
+	};
+}}
+#endif
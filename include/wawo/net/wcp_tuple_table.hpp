@@ -0,0 +1,88 @@
+#ifndef WAWO_NET_WCP_TUPLE_TABLE_HPP
+#define WAWO_NET_WCP_TUPLE_TABLE_HPP
+
+#include <atomic>
+
+#include <wawo/core.hpp>
+#include <wawo/thread/mutex.hpp>
+#include <wawo/net/address.hpp>
+
+#define WCP_TUPLE_TABLE_MIN_CAPACITY 1024
+#define WCP_TUPLE_TABLE_READER_STRIPES 16
+
+namespace wawo { namespace net {
+	using namespace wawo::thread;
+
+	/*
+	 * (local address, remote address) -> wcp fd, open addressing with linear probing over a power of 2 array
+	 * keys are the full address identities, the hash is seeded per process so that peers can not line up collisions
+	 *
+	 * find() takes no lock, insert/erase serialize on a spin_mutex
+	 * the array is rebuilt when live + erased slots pass 3/4 of it, and the old one is freed by the writer right after
+ * find() counts itself in on its thread's stripe of the current phase before it loads the array, a writer that swapped the array
+ * drains the other phase, flips the phase and drains the old one (left-right), readers never wait and never share one counter
+	 */
+	class wcp_tuple_table {
+		WAWO_DECLARE_NONCOPYABLE(wcp_tuple_table)
+
+		enum slot_fd {
+			SLOT_EMPTY = 0,
+			SLOT_ERASED = -1
+		};
+
+		struct slot {
+			std::atomic<u64_t> local;
+			std::atomic<u64_t> remote;
+			std::atomic<int> fd; //written last on insert
+		};
+
+		struct slot_array {
+			slot* slots;
+			u32_t mask;
+		};
+
+		//one cache line each
+		struct reader_stripe {
+			std::atomic<u32_t> n[2];
+			byte_t pad[64 - sizeof(std::atomic<u32_t>) * 2];
+		};
+
+		spin_mutex m_mutex;
+		std::atomic<slot_array*> m_array;
+		std::atomic<u32_t> m_phase;
+		mutable reader_stripe m_readers[WCP_TUPLE_TABLE_READER_STRIPES];
+		u32_t m_count;
+		u32_t m_erased;
+		u64_t m_seed;
+
+		static slot_array* _make_array(u32_t const& capacity);
+		static void _free_array(slot_array* a);
+
+		void _rebuild(u32_t const& capacity);
+		void _drain();
+
+	public:
+		wcp_tuple_table();
+		~wcp_tuple_table();
+
+		void init();
+		void deinit();
+
+		u64_t hash(address const& local, address const& remote) const;
+
+		//E_EADDRINUSE if the tuple is taken
+		int insert(address const& local, address const& remote, int const& fd);
+
+		//erase the tuple if it still maps to fd
+		int erase(address const& local, address const& remote, int const& fd);
+
+		//fd of the tuple, 0 for none
+		int find(address const& local, address const& remote) const;
+
+		inline u32_t size() {
+			lock_guard<spin_mutex> lg(m_mutex);
+			return m_count;
+		}
+	};
+}}
+#endif
@@ -0,0 +1,106 @@
+#ifndef _WAWO_OBJECT_POOL_HPP_
+#define _WAWO_OBJECT_POOL_HPP_
+
+#include <new>
+#include <wawo/core.hpp>
+#include <wawo/thread/mutex.hpp>
+
+namespace wawo {
+
+	//the slab of current thread, see object_pool
+	inline u32_t& object_pool_slab() {
+		static WAWO_TLS u32_t _slab = 0;
+		return _slab;
+	}
+
+	struct object_pool_slab_scope {
+		u32_t prev;
+		explicit object_pool_slab_scope(u32_t const& slab) :
+			prev(object_pool_slab())
+		{
+			object_pool_slab() = slab;
+		}
+		~object_pool_slab_scope() {
+			object_pool_slab() = prev;
+		}
+	};
+
+	//free lists of sizeof(T) blocks, for class level operator new/delete
+	//a block is taken from the slab of current thread, and goes back to the very slab when it is released by any thread
+	//each slab caches WAWO_OBJECT_POOL_SLAB_CACHE_MAX blocks at most, the others go back to the heap
+	template <class T>
+	class object_pool {
+		struct block {
+			block* next;
+			u32_t slab;
+		};
+
+		enum Cfg {
+			BLOCK_HEAD_SIZE = ((sizeof(block) + 15) & ~15)
+		};
+
+		struct slab {
+			wawo::thread::spin_mutex mutex;
+			block* free;
+			u32_t count;
+
+			slab() : free(NULL), count(0) {}
+		};
+
+		static slab* _slabs() {
+			static slab _s[WAWO_OBJECT_POOL_SLAB_MAX];
+			return _s;
+		}
+
+	public:
+		static void* alloc(std::size_t const& size) {
+			WAWO_ASSERT(size == sizeof(T));
+			(void)size;
+
+			u32_t const id = object_pool_slab() % WAWO_OBJECT_POOL_SLAB_MAX;
+			slab& s = _slabs()[id];
+			block* b = NULL;
+			{
+				wawo::thread::lock_guard<wawo::thread::spin_mutex> lg(s.mutex);
+				if (s.free != NULL) {
+					b = s.free;
+					s.free = b->next;
+					--s.count;
+				}
+			}
+
+			if (b == NULL) {
+				b = (block*) ::operator new(BLOCK_HEAD_SIZE + sizeof(T));
+			}
+			b->slab = id;
+			return ((byte_t*)b) + BLOCK_HEAD_SIZE;
+		}
+
+		static void free(void* const p) {
+			if (p == NULL) {
+				return;
+			}
+
+			block* b = (block*)(((byte_t*)p) - BLOCK_HEAD_SIZE);
+			WAWO_ASSERT(b->slab < WAWO_OBJECT_POOL_SLAB_MAX);
+			slab& s = _slabs()[b->slab];
+			{
+				wawo::thread::lock_guard<wawo::thread::spin_mutex> lg(s.mutex);
+				if (s.count < WAWO_OBJECT_POOL_SLAB_CACHE_MAX) {
+					b->next = s.free;
+					s.free = b;
+					++s.count;
+					return;
+				}
+			}
+			::operator delete(b);
+		}
+	};
+}
+
+#define WAWO_OBJECT_POOL_NEW_DELETE(T) \
+	public: \
+		static void* operator new(std::size_t size) { return wawo::object_pool<T>::alloc(size); } \
+		static void operator delete(void* p) { wawo::object_pool<T>::free(p); }
+
+#endif
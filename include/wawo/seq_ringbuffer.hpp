@@ -0,0 +1,150 @@
+#ifndef _WAWO_SEQ_RINGBUFFER_HPP_
+#define _WAWO_SEQ_RINGBUFFER_HPP_
+
+#include <vector>
+#include <wawo/core.hpp>
+
+//the span of the occupied seqs is kept under it, so that it is always less than half of the seq space
+#define WAWO_SEQ_RINGBUFFER_CAPACITY_MAX (1<<20)
+
+namespace wawo {
+
+	//a is before b, the seqs wrap
+	inline bool seq_before(u32_t const& a, u32_t const& b) {
+		return static_cast<i32_t>(a - b) < 0;
+	}
+
+	//slots indexed by (seq & mask), T() means an empty slot
+	//it keeps [begin, end) covering all the occupied seqs, and doubles itself when the span does not fit, up to WAWO_SEQ_RINGBUFFER_CAPACITY_MAX
+	template <class T>
+	class seq_ringbuffer {
+		WAWO_DECLARE_NONCOPYABLE(seq_ringbuffer)
+
+		std::vector<T> m_slots;
+		u32_t m_mask;
+		u32_t m_begin;
+		u32_t m_end;
+		u32_t m_count;
+
+	public:
+		//capacity must be power of 2
+		explicit seq_ringbuffer(u32_t const& capacity = 256) :
+			m_slots(capacity),
+			m_mask(capacity - 1),
+			m_begin(0),
+			m_end(0),
+			m_count(0)
+		{
+			WAWO_ASSERT(capacity > 0 && ((capacity&m_mask) == 0));
+		}
+		~seq_ringbuffer() {}
+
+		inline u32_t const& count() const { return m_count; }
+		inline bool empty() const { return m_count == 0; }
+		inline u32_t capacity() const { return m_mask + 1; }
+
+		//the smallest seq that might be occupied, and one past the biggest one
+		inline u32_t const& begin_seq() const { return m_begin; }
+		inline u32_t const& end_seq() const { return m_end; }
+
+		void clear() {
+			for (u32_t seq = m_begin; seq != m_end; ++seq) {
+				m_slots[seq&m_mask] = T();
+			}
+			m_begin = m_end = m_count = 0;
+		}
+
+		//return false if seq is occupied already, or it is too far from the ones held
+		bool insert(u32_t const& seq, T const& data) {
+			WAWO_ASSERT(data != T());
+
+			if (m_count == 0) {
+				m_begin = seq;
+				m_end = seq + 1;
+			} else {
+				u32_t const begin = seq_before(seq, m_begin) ? seq : m_begin;
+				u32_t const end = seq_before(seq, m_end) ? m_end : (seq + 1);
+				if ((end - begin) > WAWO_SEQ_RINGBUFFER_CAPACITY_MAX) {
+					return false;
+				}
+				if ((end - begin) > capacity()) {
+					_grow(end - begin);
+				}
+
+				T& slot = m_slots[seq&m_mask];
+				if (!seq_before(seq, m_begin) && seq_before(seq, m_end) && slot != T()) {
+					return false;
+				}
+				m_begin = begin;
+				m_end = end;
+			}
+
+			m_slots[seq&m_mask] = data;
+			++m_count;
+			return true;
+		}
+
+		//NULL if seq is not occupied
+		inline T* find(u32_t const& seq) {
+			if (seq_before(seq, m_begin) || !seq_before(seq, m_end)) {
+				return NULL;
+			}
+			T& slot = m_slots[seq&m_mask];
+			return slot == T() ? NULL : &slot;
+		}
+
+		void erase(u32_t const& seq) {
+			if (seq_before(seq, m_begin) || !seq_before(seq, m_end)) {
+				return;
+			}
+			T& slot = m_slots[seq&m_mask];
+			if (slot == T()) {
+				return;
+			}
+			slot = T();
+			--m_count;
+
+			if (m_count == 0) {
+				m_begin = m_end;
+				return;
+			}
+
+			while (m_slots[m_begin&m_mask] == T()) {
+				++m_begin;
+			}
+			while (m_slots[(m_end - 1)&m_mask] == T()) {
+				--m_end;
+			}
+		}
+
+		//give back the slots of an empty one
+		void shrink(u32_t const& capacity) {
+			WAWO_ASSERT(m_count == 0);
+			WAWO_ASSERT(capacity > 0 && ((capacity&(capacity - 1)) == 0));
+			if (capacity >= this->capacity()) {
+				return;
+			}
+			std::vector<T>(capacity).swap(m_slots);
+			m_mask = capacity - 1;
+			m_begin = m_end = 0;
+		}
+
+	private:
+		void _grow(u32_t const& span) {
+			WAWO_ASSERT(span <= WAWO_SEQ_RINGBUFFER_CAPACITY_MAX);
+			u32_t ncapacity = capacity() << 1;
+			while (ncapacity < span) {
+				ncapacity <<= 1;
+			}
+
+			std::vector<T> slots(ncapacity);
+			u32_t const nmask = ncapacity - 1;
+			for (u32_t seq = m_begin; seq != m_end; ++seq) {
+				slots[seq&nmask] = m_slots[seq&m_mask];
+			}
+			m_slots.swap(slots);
+			m_mask = nmask;
+		}
+	};
+}
+#endif
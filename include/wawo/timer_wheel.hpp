@@ -0,0 +1,146 @@
+#ifndef _WAWO_TIMER_WHEEL_HPP_
+#define _WAWO_TIMER_WHEEL_HPP_
+
+#include <vector>
+#include <wawo/core.hpp>
+
+namespace wawo {
+
+	//hierarchical timing wheel, one tick per time unit (caller decides the unit)
+	//entries can not be removed, caller should check whether the fired entry is still valid (lazy cancel)
+	template <class T, u8_t level_max=4, u8_t slot_bits=6>
+	class timer_wheel {
+		WAWO_DECLARE_NONCOPYABLE(timer_wheel)
+
+		enum Cfg {
+			SLOT_MAX = (1<<slot_bits),
+			SLOT_MASK = (SLOT_MAX-1)
+		};
+
+		struct entry {
+			u64_t expire;
+			T data;
+		};
+
+		typedef std::vector<entry> slot_t;
+
+		slot_t m_slots[level_max][SLOT_MAX];
+		u64_t m_tick;
+		u32_t m_count;
+
+	public:
+		timer_wheel(u64_t const& tick) :
+			m_tick(tick),
+			m_count(0)
+		{
+		}
+		~timer_wheel() {}
+
+		inline u64_t const& tick() const { return m_tick; }
+		inline u32_t const& count() const { return m_count; }
+		inline bool empty() const { return m_count == 0; }
+
+		void clear() {
+			for (u8_t level = 0; level < level_max; ++level) {
+				for (u32_t i = 0; i < SLOT_MAX; ++i) {
+					slot_t().swap(m_slots[level][i]);
+				}
+			}
+			m_count = 0;
+		}
+
+		void schedule(u64_t const& expire, T const& data) {
+			entry e = { expire, data };
+			_place(e);
+			++m_count;
+		}
+
+		//fire all entries that expired at or before tick, fn(expire, data)
+		template <class _Fn>
+		void advance(u64_t const& tick, _Fn const& fn) {
+			while (m_tick <= tick) {
+				if ((m_tick&SLOT_MASK) == 0) {
+					_cascade();
+				}
+
+				slot_t& slot = m_slots[0][m_tick&SLOT_MASK];
+				++m_tick;
+
+				if (slot.size()) {
+					slot_t fired;
+					fired.swap(slot);
+					m_count -= static_cast<u32_t>(fired.size());
+
+					for (u32_t i = 0; i < fired.size(); ++i) {
+						fn(fired[i].expire, fired[i].data);
+					}
+				}
+
+				if (m_count == 0 && m_tick <= tick) {
+					m_tick = tick + 1;
+				}
+			}
+		}
+
+		//the nearest tick that advance() must reach, ((u64_t)-1) if nothing scheduled
+		//it is exact for level 0, and the next cascade point for upper levels
+		u64_t next_tick() const {
+			if (m_count == 0) {
+				return ((u64_t)-1);
+			}
+
+			//cascade pending
+			if ((m_tick&SLOT_MASK) == 0) {
+				return m_tick;
+			}
+
+			u64_t t = m_tick;
+			do {
+				if (m_slots[0][t&SLOT_MASK].size()) {
+					return t;
+				}
+				++t;
+			} while ((t&SLOT_MASK) != 0);
+			return t;
+		}
+
+	private:
+		void _place(entry const& e) {
+			u64_t const expire = e.expire < m_tick ? m_tick : e.expire;
+
+			//pick the lowest level whose slot is still ahead of current tick
+			u8_t level = 0;
+			while ((level < (level_max - 1)) && (((expire >> (slot_bits*level)) - (m_tick >> (slot_bits*level))) > SLOT_MASK)) {
+				++level;
+			}
+
+			u64_t at = (expire >> (slot_bits*level));
+			if ((at - (m_tick >> (slot_bits*level))) > SLOT_MASK) {
+				//out of range, park at the farthest slot, it would be re-placed by cascade
+				at = (m_tick >> (slot_bits*level)) + SLOT_MASK;
+			}
+			m_slots[level][at&SLOT_MASK].push_back(e);
+		}
+
+		void _cascade() {
+			//find the highest level that reaches its slot boundary, then cascade from top to bottom
+			u8_t top = 1;
+			while ((top < (level_max - 1)) && (((m_tick >> (slot_bits*top))&SLOT_MASK) == 0)) {
+				++top;
+			}
+
+			for (u8_t level = top; level >= 1; --level) {
+				u32_t const idx = static_cast<u32_t>((m_tick >> (slot_bits*level))&SLOT_MASK);
+				slot_t& slot = m_slots[level][idx];
+				if (slot.size()) {
+					slot_t moving;
+					moving.swap(slot);
+					for (u32_t i = 0; i < moving.size(); ++i) {
+						_place(moving[i]);
+					}
+				}
+			}
+		}
+	};
+}
+#endif
@@ -224,6 +224,181 @@ namespace wawo { namespace net { namespace standard_socket {
 		WAWO_TRACE_SOCKET_INOUT("[wawo::net::recvfrom][#%d]recvfrom() == %d", fd, r_total);
 		return r_total;
 	}
+
+#if WAWO_ISGNU
+	inline u32_t sendmmsg(int const& fd, udp_message const* const msgs, u32_t const& count, int& ec_o, int const& flag) {
+		WAWO_ASSERT(msgs != NULL);
+		WAWO_ASSERT(count > 0 && count <= WAWO_UDP_MMSG_MAX);
+
+		struct mmsghdr hdrs[WAWO_UDP_MMSG_MAX];
+		struct iovec iovs[WAWO_UDP_MMSG_MAX];
+		sockaddr_in addrs[WAWO_UDP_MMSG_MAX];
+		byte_t ctrls[WAWO_UDP_MMSG_MAX][CMSG_SPACE(sizeof(u16_t))];
+
+		for (u32_t i = 0; i < count; ++i) {
+			WAWO_ASSERT(msgs[i].buff != NULL);
+			WAWO_ASSERT(msgs[i].len > 0);
+
+			iovs[i].iov_base = (void*) msgs[i].buff;
+			iovs[i].iov_len = msgs[i].len;
+
+			::memset(&hdrs[i], 0, sizeof(struct mmsghdr));
+			hdrs[i].msg_hdr.msg_iov = &iovs[i];
+			hdrs[i].msg_hdr.msg_iovlen = 1;
+
+			if (msgs[i].segment != 0 && msgs[i].len > msgs[i].segment) {
+				hdrs[i].msg_hdr.msg_control = ctrls[i];
+				hdrs[i].msg_hdr.msg_controllen = sizeof(ctrls[i]);
+				struct cmsghdr* cm = CMSG_FIRSTHDR(&hdrs[i].msg_hdr);
+				cm->cmsg_level = SOL_UDP;
+				cm->cmsg_type = UDP_SEGMENT;
+				cm->cmsg_len = CMSG_LEN(sizeof(u16_t));
+				*((u16_t*)CMSG_DATA(cm)) = msgs[i].segment;
+			}
+
+			if (!msgs[i].addr.is_null()) {
+				addrs[i].sin_family = AF_INET;
+				addrs[i].sin_addr.s_addr = msgs[i].addr.get_netsequence_ulongip();
+				addrs[i].sin_port = msgs[i].addr.get_netsequence_port();
+				hdrs[i].msg_hdr.msg_name = &addrs[i];
+				hdrs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+			}
+		}
+
+		u32_t sent_total = 0;
+		ec_o = wawo::OK;
+		do {
+			int sent = ::sendmmsg(fd, hdrs + sent_total, count - sent_total, flag);
+			if (WAWO_LIKELY(sent > 0)) {
+				sent_total += sent;
+				if (sent_total == count) {
+					break;
+				}
+				continue;
+			}
+
+			WAWO_ASSERT(sent == -1);
+			int send_ec = socket_get_last_errno();
+			if (IS_ERRNO_EQUAL_WOULDBLOCK(send_ec)) {
+				ec_o = wawo::E_SOCKET_SEND_BLOCK;
+			}
+			else if (send_ec == EINTR) {
+				continue;
+			}
+			else {
+				WAWO_ERR("[wawo::net::sendmmsg][#%d]send failed, error code: <%d>", fd, send_ec);
+				ec_o = WAWO_NEGATIVE(send_ec);
+			}
+			break;
+		} while (true);
+
+		WAWO_TRACE_SOCKET_INOUT("[wawo::net::sendmmsg][#%d]sendmmsg() == %d", fd, sent_total);
+		return sent_total;
+	}
+
+	inline u32_t recvmmsg(int const& fd, udp_message* const msgs_o, u32_t const& count, int& ec_o, int const& flag) {
+		WAWO_ASSERT(msgs_o != NULL);
+		WAWO_ASSERT(count > 0 && count <= WAWO_UDP_MMSG_MAX);
+
+		struct mmsghdr hdrs[WAWO_UDP_MMSG_MAX];
+		struct iovec iovs[WAWO_UDP_MMSG_MAX];
+		sockaddr_in addrs[WAWO_UDP_MMSG_MAX];
+		byte_t ctrls[WAWO_UDP_MMSG_MAX][CMSG_SPACE(sizeof(int))];
+
+		for (u32_t i = 0; i < count; ++i) {
+			WAWO_ASSERT(msgs_o[i].buff != NULL);
+			iovs[i].iov_base = (void*) msgs_o[i].buff;
+			iovs[i].iov_len = msgs_o[i].len;
+
+			::memset(&hdrs[i], 0, sizeof(struct mmsghdr));
+			hdrs[i].msg_hdr.msg_iov = &iovs[i];
+			hdrs[i].msg_hdr.msg_iovlen = 1;
+			hdrs[i].msg_hdr.msg_name = &addrs[i];
+			hdrs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+			hdrs[i].msg_hdr.msg_control = ctrls[i];
+			hdrs[i].msg_hdr.msg_controllen = sizeof(ctrls[i]);
+		}
+
+		u32_t r_total = 0;
+		do {
+			int nmsgs = ::recvmmsg(fd, hdrs, count, flag, NULL);
+			if (WAWO_LIKELY(nmsgs > 0)) {
+				for (int i = 0; i < nmsgs; ++i) {
+					msgs_o[i].len = hdrs[i].msg_len;
+					msgs_o[i].addr.set_netsequence_port(addrs[i].sin_port);
+					msgs_o[i].addr.set_netsequence_ulongip(addrs[i].sin_addr.s_addr);
+
+					//coalesced by gro
+					msgs_o[i].segment = 0;
+					for (struct cmsghdr* cm = CMSG_FIRSTHDR(&hdrs[i].msg_hdr); cm != NULL; cm = CMSG_NXTHDR(&hdrs[i].msg_hdr, cm)) {
+						if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+							msgs_o[i].segment = static_cast<u16_t>(*((int*)CMSG_DATA(cm)));
+							break;
+						}
+					}
+				}
+				r_total = nmsgs;
+				ec_o = wawo::OK;
+				break;
+			}
+
+			WAWO_ASSERT(nmsgs == -1);
+			int _ern = socket_get_last_errno();
+			if (IS_ERRNO_EQUAL_WOULDBLOCK(_ern)) {
+				ec_o = E_SOCKET_RECV_BLOCK;
+			}
+			else if (_ern == EINTR) {
+				continue;
+			}
+			else {
+				ec_o = WAWO_NEGATIVE(_ern);
+				WAWO_ERR("[wawo::net::recvmmsg][#%d]recvmmsg, ERROR: %d", fd, _ern);
+			}
+			break;
+		} while (true);
+
+		WAWO_TRACE_SOCKET_INOUT("[wawo::net::recvmmsg][#%d]recvmmsg() == %d", fd, r_total);
+		return r_total;
+	}
+#else
+	//no batched syscall, one by one
+	inline u32_t sendmmsg(int const& fd, udp_message const* const msgs, u32_t const& count, int& ec_o, int const& flag) {
+		u32_t sent_total = 0;
+		ec_o = wawo::OK;
+		for (; sent_total < count; ++sent_total) {
+			udp_message const& m = msgs[sent_total];
+			u32_t const segment = m.segment == 0 ? m.len : m.segment;
+			for (u32_t offset = 0; offset < m.len && ec_o == wawo::OK; offset += segment) {
+				u32_t const len = WAWO_MIN(segment, m.len - offset);
+				if (m.addr.is_null()) {
+					wawo::net::standard_socket::send(fd, m.buff + offset, len, ec_o, flag);
+				} else {
+					wawo::net::standard_socket::sendto(fd, m.buff + offset, len, m.addr, ec_o, flag);
+				}
+			}
+			if (ec_o != wawo::OK) {
+				break;
+			}
+		}
+		return sent_total;
+	}
+
+	inline u32_t recvmmsg(int const& fd, udp_message* const msgs_o, u32_t const& count, int& ec_o, int const& flag) {
+		u32_t r_total = 0;
+		for (; r_total < count; ++r_total) {
+			udp_message& m = msgs_o[r_total];
+			m.len = wawo::net::standard_socket::recvfrom(fd, m.buff, m.len, m.addr, ec_o, flag);
+			m.segment = 0;
+			if (ec_o != wawo::OK) {
+				break;
+			}
+		}
+		if (r_total > 0) {
+			ec_o = wawo::OK;
+		}
+		return r_total;
+	}
+#endif
 }}}
 
 
@@ -391,6 +566,8 @@ namespace wawo { namespace net {
 			m_fn_recv = wawo::net::wcp_socket::recv;
 			m_fn_sendto = wawo::net::standard_socket::sendto;
 			m_fn_recvfrom = wawo::net::standard_socket::recvfrom;
+			m_fn_sendmmsg = wawo::net::standard_socket::sendmmsg;
+			m_fn_recvmmsg = wawo::net::standard_socket::recvmmsg;
 		} else {
 #endif
 			m_fn_socket = wawo::net::standard_socket::socket;
@@ -407,6 +584,8 @@ namespace wawo { namespace net {
 			m_fn_recv = wawo::net::standard_socket::recv;
 			m_fn_sendto = wawo::net::standard_socket::sendto;
 			m_fn_recvfrom = wawo::net::standard_socket::recvfrom;
+			m_fn_sendmmsg = wawo::net::standard_socket::sendmmsg;
+			m_fn_recvmmsg = wawo::net::standard_socket::recvmmsg;
 #ifdef WAWO_ENABLE_WCP
 		}
 #endif
@@ -1381,6 +1560,34 @@ namespace wawo { namespace net {
 			return _set_options(m_option | OPTION_REUSEPORT);
 		}
 
+		int socket_base::set_udp_segment(u16_t const& size) {
+			WAWO_ASSERT(m_fd>0);
+#if WAWO_ISGNU
+			int _size = size;
+			int rt = m_fn_setsockopt(m_fd, SOL_UDP, UDP_SEGMENT, (char*)&_size, sizeof(_size));
+			WAWO_RETURN_V_IF_MATCH(wawo::OK, rt == wawo::OK);
+			WAWO_WARN("[socket][#%d:%s]set UDP_SEGMENT failed: %d", m_fd, m_addr.address_info().cstr, rt);
+			return wawo::E_EOPNOTSUPP;
+#else
+			(void)size;
+			return wawo::E_EOPNOTSUPP;
+#endif
+		}
+
+		int socket_base::set_udp_gro(bool const& on_off) {
+			WAWO_ASSERT(m_fd>0);
+#if WAWO_ISGNU
+			int _on = on_off ? 1 : 0;
+			int rt = m_fn_setsockopt(m_fd, SOL_UDP, UDP_GRO, (char*)&_on, sizeof(_on));
+			WAWO_RETURN_V_IF_MATCH(wawo::OK, rt == wawo::OK);
+			WAWO_WARN("[socket][#%d:%s]set UDP_GRO failed: %d", m_fd, m_addr.address_info().cstr, rt);
+			return wawo::E_EOPNOTSUPP;
+#else
+			(void)on_off;
+			return wawo::E_EOPNOTSUPP;
+#endif
+		}
+
 		u32_t socket_base::sendto(wawo::byte_t const* const buffer, wawo::u32_t const& len, const wawo::net::address& addr, int& ec_o, int const& flag) {
 
 			WAWO_ASSERT(buffer != NULL);
@@ -1422,6 +1629,38 @@ namespace wawo { namespace net {
 			return m_fn_recvfrom(m_fd, buffer_o, size, addr_o, ec_o,0);
 		}
 
+		u32_t socket_base::sendmmsg(udp_message const* const msgs, u32_t const& count, int& ec_o, int const& flag) {
+			WAWO_ASSERT(msgs != NULL);
+			WAWO_ASSERT(count > 0);
+			ec_o = wawo::OK;
+
+			if (m_wflag&SHUTDOWN_WR) {
+				ec_o = wawo::E_SOCKET_WR_SHUTDOWN_ALREADY;
+				return 0;
+			}
+
+			return m_fn_sendmmsg(m_fd, msgs, count, ec_o, flag);
+		}
+
+		u32_t socket_base::recvmmsg(udp_message* const msgs_o, u32_t const& count, int& ec_o) {
+			WAWO_ASSERT(msgs_o != NULL);
+			WAWO_ASSERT(count > 0);
+			ec_o = wawo::OK;
+
+			if (m_rflag&SHUTDOWN_RD) {
+				ec_o = wawo::E_SOCKET_RD_SHUTDOWN_ALREADY;
+				return 0;
+			}
+
+			u32_t nmsgs = m_fn_recvmmsg(m_fd, msgs_o, count, ec_o, 0);
+			if (m_state == S_CONNECTED) {
+				for (u32_t i = 0; i < nmsgs; ++i) {
+					msgs_o[i].addr = m_addr;
+				}
+			}
+			return nmsgs;
+		}
+
 		u32_t socket_base::send(byte_t const* const buffer, u32_t const& length, int& ec_o, int const& flag) {
 			WAWO_ASSERT(buffer != NULL);
 			WAWO_ASSERT(length > 0);
@@ -123,6 +123,18 @@ namespace wawo { namespace net {
 					m_impl->unwatch(op.flag, op.fd);
 				}
 				break;
+#ifdef WAWO_ENABLE_WCP
+			case OP_WCP_WATCH:
+				{
+					m_impl->wcp_watch(op.flag, op.fd, op.cookie, op.fn, op.err);
+				}
+				break;
+			case OP_WCP_UNWATCH:
+				{
+					m_impl->wcp_unwatch(op.flag, op.fd);
+				}
+				break;
+#endif
 			}
 		}
 	}
@@ -140,11 +152,19 @@ namespace wawo { namespace net {
 #ifdef WAWO_ENABLE_WCP
 	void observer::wcp_watch(u8_t const& flag, int const& fd, WWRP<ref_base> const& cookie, fn_io_event const& fn, fn_io_event_error const& err)
 	{
+#if WAWO_ISGNU
+		m_wcp->wcp_watch(flag, fd, cookie, fn, err);
+#else
 		m_wcp->watch(flag, fd, cookie, fn, err);
+#endif
 	}
 	void observer::wcp_unwatch(u8_t const& flag, int const& fd)
 	{
+#if WAWO_ISGNU
+		m_wcp->wcp_unwatch(flag, fd);
+#else
 		m_wcp->unwatch(flag, fd);
+#endif
 	}
 #endif
 
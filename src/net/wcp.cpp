@@ -1,13 +1,19 @@
 
+#include <random>
+
 #include <wawo/net/socket_observer.hpp>
 #include <wawo/net/socket.hpp>
 #include <wawo/net/wcp.hpp>
 
+#if WAWO_ISGNU
+	#include <sys/eventfd.h>
+#endif
+
 #define WCPPACK_TO_UDPMESSAGE( wcp_pack, mbuffer, size, wlen ) \
 do { \
 	WAWO_ASSERT(mbuffer != 0); \
 	WAWO_ASSERT(WCP_HeaderLen<=size); \
-	WAWO_ASSERT( (wcp_pack).data == NULL? true: (wcp_pack).data->len() <= WCP_MDU ); \
+	WAWO_ASSERT( (wcp_pack).header.dlen <= WCP_MDU ); \
 	wlen = 0; \
 	wawo::bytes_helper::write_impl<wawo::u32_t>( (wcp_pack).header.seq, mbuffer + wlen); \
 	wlen += sizeof(wawo::u32_t); \
@@ -17,45 +23,50 @@ do { \
 	wlen += sizeof(wawo::u32_t); \
 	wawo::bytes_helper::write_impl<wawo::u16_t>((wcp_pack).header.flag, mbuffer + wlen ); \
 	wlen += sizeof(wawo::u16_t); \
-	if ((wcp_pack).data != NULL && (wcp_pack).data->len()) { \
-		wawo::bytes_helper::write_impl<wawo::u16_t>((wawo::u16_t)(wcp_pack).data->len(), mbuffer + wlen); \
+	if ((wcp_pack).header.dlen) { \
+		wawo::bytes_helper::write_impl<wawo::u16_t>((wcp_pack).header.dlen, mbuffer + wlen); \
 		wlen += sizeof(wawo::u16_t); \
-		WAWO_ASSERT(size>=(wlen + (wcp_pack).data->len())); \
-		::memcpy( (void*) (mbuffer+wlen), (void*)(wcp_pack).data->begin(), (wcp_pack).data->len() ); \
-		wlen += ((wcp_pack).data->len())&0xFFFF; \
+		WAWO_ASSERT(size>=(wlen + (wcp_pack).header.dlen)); \
+		::memcpy( (void*) (mbuffer+wlen), (void*)(wcp_pack).data, (wcp_pack).header.dlen ); \
+		wlen += (wcp_pack).header.dlen; \
 	} else { \
 		wawo::bytes_helper::write_impl<wawo::u16_t>(0, mbuffer + wlen); \
 		wlen += sizeof(wawo::u16_t); \
 	}\
 } while (0)
 
-#define WCP_RECEIVED_PACK_FROM_UDPMESSAGE( pack, mbuffer,len) \
-do { \
-	WAWO_ASSERT(mbuffer != 0); \
-	WAWO_ASSERT(WCP_HeaderLen<=len); \
-	wawo::u32_t rlen = 0; \
-	(pack).header.seq = wawo::bytes_helper::read_u32(mbuffer + rlen); \
-	rlen += sizeof(wawo::u32_t); \
-	(pack).header.ack = wawo::bytes_helper::read_u32(mbuffer + rlen); \
-	rlen += sizeof(wawo::u32_t); \
-	(pack).header.wnd = wawo::bytes_helper::read_u32(mbuffer + rlen); \
-	rlen += sizeof(wawo::u32_t); \
-	(pack).header.flag = wawo::bytes_helper::read_u16(mbuffer + rlen ); \
-	rlen += sizeof(wawo::u16_t); \
-	(pack).header.dlen = wawo::bytes_helper::read_u16(mbuffer + rlen); \
-	rlen += sizeof(wawo::u16_t); \
-	if ((pack).header.dlen != 0) { \
-		WAWO_ASSERT((pack).header.dlen<=WCP_MDU); \
-		WAWO_ASSERT((pack).header.dlen==(len-rlen)); \
-		WWSP<wawo::packet> data = wawo::make_shared<wawo::packet>((pack).header.dlen); \
-		data->write(mbuffer+rlen, (pack).header.dlen ); \
-		(pack).data = data; \
-		rlen += (pack).header.dlen; \
-	} \
-} while (0)
-
 namespace wawo { namespace net {
 
+	fn_wcp_clock wcp_clock = wawo::time::curr_microseconds;
+
+	//false for a datagram that is not one whole wcp pack, it is dropped
+	static bool _received_pack_from_udpmessage(WCB_received_pack& pack, byte_t const* const mbuffer, u32_t const& len) {
+		WAWO_ASSERT(mbuffer != 0);
+		if (len < WCP_HeaderLen) {
+			return false;
+		}
+
+		u32_t rlen = 0;
+		pack.header.seq = wawo::bytes_helper::read_u32(mbuffer + rlen);
+		rlen += sizeof(u32_t);
+		pack.header.ack = wawo::bytes_helper::read_u32(mbuffer + rlen);
+		rlen += sizeof(u32_t);
+		pack.header.wnd = wawo::bytes_helper::read_u32(mbuffer + rlen);
+		rlen += sizeof(u32_t);
+		pack.header.flag = wawo::bytes_helper::read_u16(mbuffer + rlen);
+		rlen += sizeof(u16_t);
+		pack.header.dlen = wawo::bytes_helper::read_u16(mbuffer + rlen);
+		rlen += sizeof(u16_t);
+
+		if (pack.header.dlen > WCP_MDU || pack.header.dlen != (len - rlen)) {
+			return false;
+		}
+		if (pack.header.dlen != 0) {
+			::memcpy((void*)pack.data, (void*)(mbuffer + rlen), pack.header.dlen);
+		}
+		return true;
+	}
+
 	void wcb_pump_packs(WWRP<ref_base> const& cookie_) {
 		WAWO_ASSERT(cookie_ != NULL );
 		WWRP<async_cookie> cookie = wawo::static_pointer_cast<async_cookie>(cookie_);
@@ -73,15 +84,7 @@ namespace wawo { namespace net {
 		WAWO_ERR("[wcp][wcb][#%d:%s]wcb_socket_error: %d", wcb->so->get_fd(), wcb->so->get_addr_info().cstr, code );
 	}
 
-	inline wawo::u32_t four_tuple_hash(wawo::net::address const& addr1, wawo::net::address const& addr2) {
-		return ((wawo::u32_t)(addr1.get_hostsequence_ulongip()) * 59) ^
-			((wawo::u32_t)(addr2.get_hostsequence_ulongip())) ^
-			((wawo::u32_t)(addr1.get_port()) << 16) ^
-			((wawo::u32_t)(addr2.get_port()))
-			;
-	}
-
-	inline static int inject_to_address(WWRP<socket> const& so, WWSP<WCB_pack> const& opack, address const& to) {
+	inline static int inject_to_address(WWRP<socket> const& so, WWRP<WCB_pack> const& opack, address const& to) {
 		WAWO_ASSERT(!to.is_null());
 		byte_t buffer[WCP_MTU];
 		u16_t len;
@@ -100,7 +103,7 @@ namespace wawo { namespace net {
 	}
 
 	inline static int reply_rst_to_address(WWRP<socket> const& so, u32_t const& seq, address const& to) {
-		WWSP<WCB_pack> rst = wawo::make_shared<WCB_pack>();
+		WWRP<WCB_pack> rst = wawo::make_ref<WCB_pack>();
 		rst->header.seq = seq;
 		rst->header.flag = WCP_FLAG_RST;
 		rst->header.dlen = 0;
@@ -109,7 +112,103 @@ namespace wawo { namespace net {
 		return inject_to_address(so, rst, to);
 	}
 
-	WCB::WCB() {}
+	//stateless answer to a syn, seq 0 and the cookie as data, see WCB::SYN_RCVD
+	inline static int reply_syn_cookie_to_address(WWRP<socket> const& so, u32_t const& cookie, u32_t const& wnd, address const& to) {
+		WWRP<WCB_pack> synack = wawo::make_ref<WCB_pack>();
+		synack->header.seq = 0;
+		synack->header.ack = 1;
+		synack->header.wnd = wnd;
+		synack->header.flag = WCP_FLAG_SYN | WCP_FLAG_ACK;
+		synack->header.dlen = sizeof(u32_t);
+		wawo::bytes_helper::write_u32(cookie, (byte_t*)synack->data);
+		return inject_to_address(so, synack, to);
+	}
+
+#define WCP_SIPROUND(v0,v1,v2,v3) \
+do { \
+	v0 += v1; v1 = (v1 << 13) | (v1 >> 51); v1 ^= v0; v0 = (v0 << 32) | (v0 >> 32); \
+	v2 += v3; v3 = (v3 << 16) | (v3 >> 48); v3 ^= v2; \
+	v0 += v3; v3 = (v3 << 21) | (v3 >> 43); v3 ^= v0; \
+	v2 += v1; v1 = (v1 << 17) | (v1 >> 47); v1 ^= v2; v2 = (v2 << 32) | (v2 >> 32); \
+} while (0)
+
+	//siphash-2-4 of n 64 bit words
+	static u64_t _siphash24(u64_t const key[2], u64_t const* m, u32_t const& n) {
+		u64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+		u64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+		u64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+		u64_t v3 = 0x7465646279746573ULL ^ key[1];
+
+		for (u32_t i = 0; i < n; ++i) {
+			v3 ^= m[i];
+			WCP_SIPROUND(v0, v1, v2, v3);
+			WCP_SIPROUND(v0, v1, v2, v3);
+			v0 ^= m[i];
+		}
+
+		u64_t const b = u64_t(n * sizeof(u64_t)) << 56;
+		v3 ^= b;
+		WCP_SIPROUND(v0, v1, v2, v3);
+		WCP_SIPROUND(v0, v1, v2, v3);
+		v0 ^= b;
+
+		v2 ^= 0xff;
+		WCP_SIPROUND(v0, v1, v2, v3);
+		WCP_SIPROUND(v0, v1, v2, v3);
+		WCP_SIPROUND(v0, v1, v2, v3);
+		WCP_SIPROUND(v0, v1, v2, v3);
+		return v0 ^ v1 ^ v2 ^ v3;
+	}
+
+	//a datagram on a listener's shared socket goes to the wcb of its four tuple, false if there is none yet
+	inline static bool shared_so_route(address const& local, WWRP<WCB_received_pack> const& inpack) {
+		int const fd = wcp::instance()->four_tuple_fd(local, inpack->from);
+		if (fd == 0) {
+			return false;
+		}
+		WWRP<WCB> to = wcp::instance()->wcb_of(fd);
+		if (to == NULL) {
+			return false;
+		}
+		{
+			lock_guard<spin_mutex> lg(to->received_vec_mutex);
+			to->received_vec_standby->push_back(inpack);
+		}
+		to->schedule_update();
+		return true;
+	}
+
+	//make room for need more bytes in b, doubling from WCP_BUFFER_INIT, never beyond max
+	static void _ringbuffer_reserve(WWRP<wawo::bytes_ringbuffer>& b, u32_t const& need, u32_t const& max) {
+		u32_t const count = (b == NULL) ? 0 : b->count();
+		u32_t const capacity = (b == NULL) ? 0 : b->capacity();
+		if (b != NULL && ((count + need) <= capacity || capacity >= max)) {
+			return;
+		}
+
+		u32_t ncapacity = WAWO_MAX(capacity, WCP_BUFFER_INIT);
+		while (ncapacity < (count + need) && ncapacity < max) {
+			ncapacity <<= 1;
+		}
+		ncapacity = WAWO_MIN(ncapacity, max);
+
+		WWRP<wawo::bytes_ringbuffer> nb = wawo::make_ref<wawo::bytes_ringbuffer>(ncapacity);
+		WAWO_ALLOC_CHECK(nb, sizeof(wawo::bytes_ringbuffer));
+		if (count) {
+			byte_t tmp[WCP_MDU];
+			u32_t nbytes;
+			while ((nbytes = b->read(tmp, sizeof(tmp))) > 0) {
+				nb->write(tmp, nbytes);
+			}
+		}
+		b = nb;
+	}
+
+	WCB::WCB() :
+		rcv_received(WCP_PACK_RING_INIT),
+		rcv_fec_history(WCP_PACK_RING_INIT),
+		snd_flights(WCP_PACK_RING_INIT)
+	{}
 	WCB::~WCB() {}
 
 	WCB_State WCB::update(u64_t const& now) {
@@ -137,7 +236,12 @@ namespace wawo { namespace net {
 			lock_guard<spin_mutex> lg_r_mutex(r_mutex);
 			WCBList::iterator it = backloglist_pending.begin();
 			while (it != backloglist_pending.end()) {
-				WCB_State s = (*it)->update(now);
+				//pending wcb is driven by its own engine, check state only
+				WCB_State s;
+				{
+					lock_guard<spin_mutex> lg_pending((*it)->mutex);
+					s = (*it)->state;
+				}
 				if (s == WCB_ESTABLISHED) {
 					WAWO_ASSERT(backlogq.size() <= backlog_size);
 					backlogq.push(*it);
@@ -234,652 +338,2118 @@ namespace wawo { namespace net {
 		break;
 		}
 
+		if (state != WCB_RECYCLE) {
+			check_ack(now);
+			check_buffers(now);
+		}
+
+		int flushrt = flush_packs();
+		if (flushrt != wawo::OK && flushrt != wawo::E_SOCKET_SEND_BLOCK) {
+			lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+			wcb_errno = flushrt;
+			s_flag |= WRITE_SEND_ERROR;
+		}
+
+		if (accept_listener != NULL && state != WCB_SYN_RECEIVED) {
+			accept_listener->schedule_update();
+			accept_listener = NULL;
+		}
+
+		take_info();
 		return state;
 	}
 
-	void WCB::check_recv(u64_t const& now) {
+	//return the nearest time that update() has something to do without any incoming event, 0 for none
+	u64_t WCB::next_timer(u64_t const& now) {
 
-		{
-			if (received_vec->size()) { received_vec->clear(); }
-			lock_guard<spin_mutex> lg_received_vec(received_vec_mutex);
-			{
-				if (received_vec_standby->size() != 0) {
-					received_vec.swap(received_vec_standby);
-				}
+		u64_t expire = 0;
+		auto _expire_at = [&expire](u64_t const& at) {
+			if (expire == 0 || at < expire) {
+				expire = at;
 			}
-		}
+		};
 
-		u32_t received_size = received_vec->size();
-		if (received_size == 0) {
-			u64_t timediff = ((now - keepalive_timer_last_received_pack)/1000);
-			if ( keepalive_probes_sent >= keepalive_vals.probes ) {
-				lock_guard<spin_mutex> lg_r_mutex( r_mutex);
-				r_flag |= READ_RECV_ERROR;
-				wcb_errno = wawo::E_ETIMEOUT;
-				WCP_TRACE("[wcp][%u:%s]connection timeout", fd, remote_addr.address_info().cstr );
-			}
-			else if (timediff >= static_cast<u64_t>(keepalive_vals.idle + (keepalive_vals.interval*keepalive_probes_sent))) {
-				//lock_guard<spin_mutex> lg_s_mutex( s_mutex );
-				keepalive();
-				++keepalive_probes_sent;
-				WCP_TRACE("[wcp][%u:%s]keepalive, probes: %u", fd, remote_addr.address_info().cstr, keepalive_probes_sent );
-			}
-			else {}
+		bool check_recv_timer = true;
+
+		switch (state) {
+		case WCB_CLOSED:
+		case WCB_RECYCLE:
+		{
+			return 0;
+		}
+		break;
+		case WCB_LISTEN:
+		{
+			//pending wcb is driven by other engine, it wakes us once it leaves WCB_SYN_RECEIVED
+			return 0;
+		}
+		break;
+		case WCB_TIME_WAIT:
+		{
+			return timer_state + WCP_TIMEWAIT_MAX_TIME;
+		}
+		break;
+		case WCB_SYNING:
+		{
+			check_recv_timer = false;
+		}
+		break;
+		case WCB_SYN_SENT:
+		{
+			_expire_at(timer_state + WCP_SYN_MAX_TIME);
+		}
+		break;
+		case WCB_FIN_WAIT_1:
+		case WCB_CLOSING:
+		case WCB_FIN_WAIT_2:
+		{
+			_expire_at(timer_state + WCP_FIN_MAX_TIME);
+		}
+		break;
+		case WCB_LAST_ACK:
+		{
+			_expire_at(timer_state + WCP_LAST_ACK_MAX_TIME);
+		}
+		break;
+		case WCB_SYN_RECEIVED:
+		case WCB_ESTABLISHED:
+		case WCB_CLOSE_WAIT:
+		{}
+		break;
 		}
-		else {
 
-			keepalive_timer_last_received_pack = now;
-			keepalive_probes_sent = 0;
+		if (wcb_errno != 0) {
+			return now + 1;
+		}
 
-			std::queue<u32_t> acked_queue; //0 normal, 1 dup
-			for (u32_t i = 0; i < received_size; ++i) {
-				WWSP<WCB_received_pack> const& pack = (*received_vec)[i];
+		if (check_recv_timer) {
+			if (keepalive_probes_sent >= keepalive_vals.probes) {
+				return now + 1;
+			}
+			_expire_at(keepalive_timer_last_received_pack + (keepalive_vals.idle + (keepalive_vals.interval*keepalive_probes_sent))*1000ULL);
+		}
 
-				//ack new means the packet has been read by remote user, so rwnd should be updated
-				//@todo, we should check ack range
-				if (snd_info.una < pack->header.ack) {
-					snd_info.una = pack->header.ack;
-					wcb_flag |= SND_UNA_UPDATE;
-					snd_info.rwnd = pack->header.wnd;
-				}
+		if (r_flag&READ_RWND_MORE_THAN_MTU) {
+			_expire_at(r_timer_last_rwnd_update + WCP_RWND_CHECK_GRANULARITY + 1);
+		}
 
-				if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_WND)) {
-					snd_info.rwnd = pack->header.wnd;
-				}
+		if (snd_nagle_hold_since != 0) {
+			_expire_at(snd_nagle_hold_since + WCP_NAGLE_DELAY);
+		}
 
-				if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_SACK)) {
-					WAWO_ASSERT(pack->data != NULL && pack->data->len());
-					while (pack->data->len()) {
-						acked_queue.push(pack->data->read<u32_t>());
-					}
-					continue;
-				}
+		if (wcb_flag&SND_DGM_HELD) {
+			_expire_at(snd_dgm_round + WAWO_MAX(srtt, u32_t(WCP_RTO_CLOCK_GRANULARITY)));
+		}
 
-				if (WCPPACK_TEST_FLAG(*pack, (WCP_FLAG_KEEP_ALIVE))) {
-					keepalive_reply();
-					WCP_TRACE("[wcp][%u:%s]keepalive reply, probes: %u", fd, remote_addr.address_info().cstr, keepalive_probes_sent);
-					continue;
-				}
+		if (rcv_ack_since != 0) {
+			_expire_at(rcv_ack_since + WCP_ACK_DELAY);
+		}
 
-				if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_KEEP_ALIVE_REPLY)) {
-					continue;
-				}
+		if (buffers_held&WCB_BUFFERS_RCV) {
+			_expire_at(rcv_buffer_last_active + WCP_BUFFER_IDLE_RELEASE);
+		}
+		if (buffers_held&WCB_BUFFERS_SND) {
+			_expire_at(snd_buffer_last_active + WCP_BUFFER_IDLE_RELEASE);
+		}
 
-				snd_sacked_pack_tmp->write<u32_t>(pack->header.seq);
+		//blocked by socket send buffer
+		if (s_sending_ignore_seq_space.size()) {
+			return now + 1;
+		}
 
-				if (pack->header.seq < rcv_info.next) {
-					WCP_TRACE("[wcp]check_recv, duplicate (old), seq: %u, flag: %u, wnd: %u, ack: %u, expect: %u",
-						pack->header.seq, pack->header.flag, pack->header.wnd, pack->header.ack, rcv_info.next);
+		if (snd_sending.size() &&
+			((snd_sending.front()->header.dlen + WCP_HeaderLen + snd_nflight_bytes) < WAWO_MIN(snd_info.cwnd, snd_info.rwnd))
+		) {
+			//held by pacing, or blocked by socket send buffer
+			if (snd_pacing_release_us > now*1000 && pacing_rate() != 0) {
+				_expire_at((snd_pacing_release_us + 999) / 1000);
+			} else {
+				return now + 1;
+			}
+		}
 
-					continue;
-				}
+		//due flights held by pacing
+		if ((wcb_flag&SND_RETRANSMIT_PACED) && snd_flights.count()) {
+			if (snd_pacing_release_us > now*1000) {
+				_expire_at((snd_pacing_release_us + 999) / 1000);
+			} else {
+				return now + 1;
+			}
+		}
 
-				WCB_ReceivedPackList::reverse_iterator it = rcv_received.rbegin();
-				while (it != rcv_received.rend()) {
-					u32_t& seq = (*it)->header.seq;
-					if (seq == pack->header.seq) {
+		//the oldest ones expire first, flights acked since check_flights ran only make it earlier
+		if (snd_flights.count()) {
+			u32_t const srtt_timeout = WAWO_MAX(srtt + (rttvar >> 2), u32_t(WCP_FAST_RETRANSMIT_GRAULARITY));
+			u32_t const fast_timeout = WAWO_MIN(srtt_timeout, rto);
+			u64_t flight_expire = snd_flights_oldest_sent + ((wcb_flag&SND_FAST_RECOVERED) ? fast_timeout : rto);
+			//the ones check_flights did not look at might be acked past by then
+			if (snd_flights_unwalked_sent != 0 && (snd_flights_unwalked_sent + fast_timeout) < flight_expire) {
+				flight_expire = snd_flights_unwalked_sent + fast_timeout;
+			}
+			_expire_at(WAWO_MAX(flight_expire, snd_last_rto_timer + WCP_RTO_CLOCK_GRANULARITY));
+		}
 
-						WCP_TRACE("[wcp]check_recv, duplicate (new), update rwnd, seq: %u, flag: %u, wnd: %u, ack: %u, expect: %u",
-							pack->header.seq, pack->header.flag, pack->header.wnd, pack->header.ack, rcv_info.next);
+		if (expire != 0 && expire <= now) {
+			expire = now + 1;
+		}
+		return expire;
+	}
 
-						goto _end_current_loop;
-					}
-					else if (pack->header.seq < seq) {
-						++it;
-					}
-					else {
-						break;
-					}
-				}
-				rcv_received.insert(it.base(), pack);
-				//wcb_flag |= RCV_ARRIVE_NEW;
-			_end_current_loop:
-				(void)it;//for compile grammar
-			}
+	void WCB::schedule_update() {
+		WWRP<wcp_engine> _engine = engine;
+		if (_engine == NULL) {
+			return;
+		}
+		if (engine_update_pending.exchange(true, std::memory_order_acq_rel) == false) {
+			_engine->update(WWRP<WCB>(this));
+		}
+	}
 
+	int WCB::send(byte_t const* const buffer, u32_t const& len, int const& flag) {
+		if (flag&(WCP_MSG_UNORDERED | WCP_MSG_UNRELIABLE)) {
+			return send_msg(buffer, len, flag);
+		}
 
-			if (snd_sacked_pack_tmp->len()) {
-				//lock_guard<spin_mutex> lg_s_mutex(s_mutex);
-				SACK(snd_sacked_pack_tmp);
-				snd_sacked_pack_tmp->reset();
+		lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+		if (s_flag& (WRITE_SEND_ERROR | WRITE_LOCAL_WRITE_SHUTDOWNED)) {
+			if (wcb_errno != 0) {
+				wawo::set_last_errno( wcb_errno );
+				return wcb_errno;
 			}
+			wawo::set_last_errno(wawo::E_ECONNABORTED);
+			return wawo::E_ECONNABORTED;
+		}
 
-			while (acked_queue.size()) {
-				u32_t const& ack = acked_queue.front();
+		u32_t left_capacity = snd_buffer_size - (sb == NULL ? 0 : sb->count());
+		if ( (left_capacity<len) && left_capacity<(2*WCP_MDU) ) {
+			wawo::set_last_errno(EWOULDBLOCK);
+			return WAWO_NEGATIVE(EWOULDBLOCK);
+		}
 
-				if (ack < snd_info.una) {
-					acked_queue.pop();
-					continue;
-				}
+		_ringbuffer_reserve(sb, WAWO_MIN(len, left_capacity), snd_buffer_size);
+		u32_t nbytes = sb->write(buffer, len);
+		schedule_update();
+		return nbytes;
+	}
 
-				if (ack > snd_biggest_ack) {
-					//WCP_TRACE("[wcp]biggest_ack update, last: %u, now: %u, una: %u", snd_biggest_ack, ack, snd_info.una );
-					snd_biggest_ack = ack;
-					wcb_flag |= SND_BIGGEST_SACK_UPDATE;
-				}
+	int WCB::send_msg(byte_t const* const buffer, u32_t const& len, int const& flag) {
+		if (len == 0 || len > WCP_MDU) {
+			wawo::set_last_errno(wawo::E_EMSGSIZE);
+			return wawo::E_EMSGSIZE;
+		}
 
-				WCB_PackList::iterator const& otf = std::find_if(snd_flights.begin(), snd_flights.end(), [&ack](WWSP<WCB_pack> const& pack /*on the flight*/) {
-					return (pack->header.seq == ack);
-				});
+		lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+		if (s_flag& (WRITE_SEND_ERROR | WRITE_LOCAL_WRITE_SHUTDOWNED)) {
+			if (wcb_errno != 0) {
+				wawo::set_last_errno(wcb_errno);
+				return wcb_errno;
+			}
+			wawo::set_last_errno(wawo::E_ECONNABORTED);
+			return wawo::E_ECONNABORTED;
+		}
 
-				if (otf != snd_flights.end()) {
-					_handle_pack_acked(otf,now);
-					snd_flights.erase(otf);
-				}
+		if ((s_msgs_bytes + len) > snd_buffer_size) {
+			wawo::set_last_errno(EWOULDBLOCK);
+			return WAWO_NEGATIVE(EWOULDBLOCK);
+		}
 
-				if ((wcb_flag&SND_LOST_DETECTED) && (ack > snd_lost_biggest_seq)) {
-					++snd_lost_bigger_than_lost_seq_time;
+		WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
+		opack->header.flag = (flag&WCP_MSG_UNRELIABLE) ? WCP_FLAG_DGM : (WCP_FLAG_MSG | WCP_FLAG_ACK);
+		opack->header.dlen = len & 0xFFFF;
+		::memcpy(opack->data, buffer, len);
+		s_msgs.push(opack);
+		s_msgs_bytes += len;
+		schedule_update();
+		return static_cast<int>(len);
+	}
 
-					if ( (snd_lost_bigger_than_lost_seq_time >= 1) && (snd_info.una>snd_lost_biggest_seq) ) {
+	int WCB::recv(byte_t* const buffer_o, u32_t const& size, int const& flag) {
+		if (flag&(WCP_MSG_UNORDERED | WCP_MSG_UNRELIABLE)) {
+			return recv_msg(buffer_o, size);
+		}
 
-						snd_info.cwnd += snd_lost_cwnd_for_fast_recovery_compensation;
-						snd_info.cwnd = WAWO_MIN(snd_info.cwnd, WCP_SND_CWND_MAX);
+		lock_guard<spin_mutex> lg_rb_recv(r_mutex);
+	read_begin:
+		if (r_flag&READ_LOCAL_READ_SHUTDOWNED) {
+			wawo::set_last_errno(wawo::E_ECONNABORTED);
+			return wawo::E_ECONNABORTED;
+		}
 
-						WCP_TRACE("[wcp][FR]try to set ssthresh from: %u to: %u (choose larger one), compensation: %u", snd_info.ssthresh, snd_info.cwnd, snd_lost_cwnd_for_fast_recovery_compensation );
+		if (rb != NULL && rb->count()>0) {
+			u32_t nbytes = rb->read( buffer_o, size );
 
-						u32_t _new_ssthresh = WAWO_MIN(snd_info.cwnd, WCP_SND_SSTHRESH_MAX);
-						snd_info.ssthresh = WAWO_MAX( _new_ssthresh, snd_info.ssthresh );
+			WAWO_ASSERT( nbytes>0 );
+			if (rb->count() == 0) {
+				//rb_standby would be swapped in
+				schedule_update();
+			}
+			//WAWO_INFO("[wcp][%d:%s] read bytes: %u", fd, remote_addr.address_info().cstr, nbytes);
+			return nbytes;
+		}
 
-						snd_lost_cwnd_for_fast_recovery_compensation = 0;
-						wcb_flag |= SND_FAST_RECOVERED;
-						wcb_flag &= ~SND_LOST_DETECTED;
-					}
-				}
+		WAWO_ASSERT( rb == NULL || rb->count() == 0 );
 
-				acked_queue.pop();
+		if ( r_flag&READ_REMOTE_FIN_RECEIVED ) {
+			if (r_flag&READ_REMOTE_FIN_READ_BY_USER) {
+				wawo::set_last_errno(wawo::E_ECONNRESET);
+				return wawo::E_ECONNRESET;
 			}
+			r_flag |= READ_REMOTE_FIN_READ_BY_USER;
+			wawo::set_last_errno(wawo::OK);
+			return wawo::OK;
+		}
 
-			WCB_ReceivedPackList::iterator it = rcv_received.begin();
-			while (it != rcv_received.end()) {
-				WAWO_ASSERT((*it)->header.seq >= rcv_info.next);
-
-				if ((*it)->header.seq != rcv_info.next) {
-					break;
-				}
+		if (r_flag&READ_RECV_ERROR) {
+			WAWO_ASSERT(wcb_errno != 0);
+			wawo::set_last_errno(wcb_errno);
+			return WAWO_NEGATIVE(wcb_errno);
+		}
 
-				WWSP<WCB_received_pack> const& inpack = *it;
+		//@NOTICE, 2018.01.10
+		WAWO_ASSERT(wcb_errno == 0);
 
-				if (inpack->header.dlen>0 ) {
+		//if (wcb_errno != 0) {
+		//	wawo::set_last_errno(wcb_errno);
+		//	return WAWO_NEGATIVE(wcb_errno);
+		//}
 
-					WAWO_ASSERT(WCPPACK_TEST_FLAG(*(inpack), WCP_FLAG_DAT));
-					WAWO_ASSERT(!WCPPACK_TEST_FLAG(*(inpack), (WCP_FLAG_SYN | WCP_FLAG_FIN)));
+		if (wcb_option&WCP_O_NONBLOCK) {
+			wawo::set_last_errno(EWOULDBLOCK);
+			return WAWO_NEGATIVE(EWOULDBLOCK);
+		}
 
-					if (inpack->from != remote_addr) {
-						reply_rst_to_address(so, inpack->header.ack, inpack->from);
+		WAWO_ASSERT( !(wcb_option&WCP_O_NONBLOCK));
 
-						lock_guard<spin_mutex> lg_wcb(mutex);
-						state = WCB_CLOSED;
-						wcb_errno = wawo::E_ECONNABORTED;
+		r_cond.wait<spin_mutex>(r_mutex);
+		goto read_begin;
+	}
 
-						rcv_received.erase(it);
-						break;
-					}
+	//0 once the peer has closed and the queue is drained, a message is never empty
+	int WCB::recv_msg(byte_t* const buffer_o, u32_t const& size) {
+		lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+	read_begin:
+		if (r_flag&READ_LOCAL_READ_SHUTDOWNED) {
+			wawo::set_last_errno(wawo::E_ECONNABORTED);
+			return wawo::E_ECONNABORTED;
+		}
 
-					if (rb_standby->left_capacity() < inpack->header.dlen) {
-						WAWO_WARN("[wcp]check recv, wcb rb buffer not enough, break, incoming dlen: %u, rb->left_capacity(): %u", inpack->header.dlen, rb_standby->left_capacity());
-						r_flag |= READ_RWND_LESS_THAN_MTU;
-						break;
-					}
+		if (!r_msgs.empty()) {
+			WWRP<WCB_received_pack> const msg = r_msgs.front();
+			r_msgs.pop();
+			r_msgs_bytes -= msg->header.dlen;
 
-					rb_standby->write(inpack->data->begin(), inpack->header.dlen);
-					rcv_info.wnd = rb_standby->left_capacity();
-					if (rcv_info.wnd <= WCP_MTU) {
-						r_flag |= READ_RWND_LESS_THAN_MTU;
-					}
-					else {
-						r_flag &= ~(READ_RWND_LESS_THAN_MTU | READ_RWND_MORE_THAN_MTU);
-					}
-				}
+			u32_t const nbytes = WAWO_MIN(size, u32_t(msg->header.dlen));
+			::memcpy(buffer_o, msg->data, nbytes);
+			return static_cast<int>(nbytes);
+		}
 
-				rcv_info.next++;
+		if (r_flag&READ_REMOTE_FIN_RECEIVED) {
+			wawo::set_last_errno(wawo::OK);
+			return wawo::OK;
+		}
 
-				if (WCPPACK_TEST_FLAG(*(inpack), WCP_FLAG_RST)) {
-					lock_guard<spin_mutex> lg_wcp_state(mutex);
+		if (r_flag&READ_RECV_ERROR) {
+			WAWO_ASSERT(wcb_errno != 0);
+			wawo::set_last_errno(wcb_errno);
+			return WAWO_NEGATIVE(wcb_errno);
+		}
+
+		if (wcb_option&WCP_O_NONBLOCK) {
+			wawo::set_last_errno(EWOULDBLOCK);
+			return WAWO_NEGATIVE(EWOULDBLOCK);
+		}
+
+		r_cond.wait<spin_mutex>(r_mutex);
+		goto read_begin;
+	}
+
+	int WCB::send_stream(u16_t const& sid, byte_t const* const buffer, u32_t const& len) {
+		if (sid == 0) {
+			return send(buffer, len);
+		}
+		if (sid >= WCP_STREAM_MAX) {
+			wawo::set_last_errno(wawo::E_EINVAL);
+			return wawo::E_EINVAL;
+		}
+
+		lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+		if (s_flag& (WRITE_SEND_ERROR | WRITE_LOCAL_WRITE_SHUTDOWNED)) {
+			if (wcb_errno != 0) {
+				wawo::set_last_errno(wcb_errno);
+				return wcb_errno;
+			}
+			wawo::set_last_errno(wawo::E_ECONNABORTED);
+			return wawo::E_ECONNABORTED;
+		}
+
+		WWRP<WCB_snd_stream>& st = s_streams[sid];
+		if (st == NULL) {
+			st = wawo::make_ref<WCB_snd_stream>();
+		}
+
+		u32_t left_capacity = snd_buffer_size - (st->sb == NULL ? 0 : st->sb->count());
+		if ((left_capacity<len) && left_capacity<(2 * WCP_MDU)) {
+			wawo::set_last_errno(EWOULDBLOCK);
+			return WAWO_NEGATIVE(EWOULDBLOCK);
+		}
+
+		_ringbuffer_reserve(st->sb, WAWO_MIN(len, left_capacity), snd_buffer_size);
+		u32_t nbytes = st->sb->write(buffer, len);
+		schedule_update();
+		return nbytes;
+	}
+
+	int WCB::recv_stream(u16_t const& sid, byte_t* const buffer_o, u32_t const& size) {
+		if (sid == 0) {
+			return recv(buffer_o, size);
+		}
+		if (sid >= WCP_STREAM_MAX) {
+			wawo::set_last_errno(wawo::E_EINVAL);
+			return wawo::E_EINVAL;
+		}
+
+		lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+	read_begin:
+		if (r_flag&READ_LOCAL_READ_SHUTDOWNED) {
+			wawo::set_last_errno(wawo::E_ECONNABORTED);
+			return wawo::E_ECONNABORTED;
+		}
+
+		WCB_RcvStreamMap::iterator it = r_streams.find(sid);
+		if (it != r_streams.end() && it->second->rb != NULL && it->second->rb->count()>0) {
+			WCB_rcv_stream& st = *(it->second);
+			u32_t nbytes = st.rb->read(buffer_o, size);
+			st.read += nbytes;
+			if (st.rb->count() == 0) {
+				r_streams_ready.erase(sid);
+			}
+
+			//the peer is told once a quarter of the window is read
+			if ((st.read + stream_wnd() - st.limit) >= (stream_wnd() >> 2) &&
+				std::find(r_streams_wnd.begin(), r_streams_wnd.end(), sid) == r_streams_wnd.end())
+			{
+				r_streams_wnd.push_back(sid);
+				schedule_update();
+			}
+			return nbytes;
+		}
+
+		if (r_flag&READ_REMOTE_FIN_RECEIVED) {
+			wawo::set_last_errno(wawo::OK);
+			return wawo::OK;
+		}
+
+		if (r_flag&READ_RECV_ERROR) {
+			WAWO_ASSERT(wcb_errno != 0);
+			wawo::set_last_errno(wcb_errno);
+			return WAWO_NEGATIVE(wcb_errno);
+		}
+
+		if (wcb_option&WCP_O_NONBLOCK) {
+			wawo::set_last_errno(EWOULDBLOCK);
+			return WAWO_NEGATIVE(EWOULDBLOCK);
+		}
+
+		r_cond.wait<spin_mutex>(r_mutex);
+		goto read_begin;
+	}
+
+	int WCB::stream_ready(u16_t* const sids, u32_t const& count) {
+		lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+		u32_t n = 0;
+		for (std::set<u16_t>::const_iterator it = r_streams_ready.begin(); it != r_streams_ready.end() && n < count; ++it) {
+			sids[n++] = *it;
+		}
+		return static_cast<int>(n);
+	}
+
+	void WCB::stream_arrive(WWRP<WCB_received_pack> const& pack) {
+		if (pack->header.dlen < WCP_STREAM_HEADER_LEN || pack->from != remote_addr) {
+			return;
+		}
+
+		u16_t const sid = wawo::bytes_helper::read_u16((byte_t const*)pack->data);
+		u32_t const seq = wawo::bytes_helper::read_u32((byte_t const*)pack->data + sizeof(u16_t));
+		if (sid == 0 || sid >= WCP_STREAM_MAX) {
+			return;
+		}
+
+		lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+		WCB_RcvStreamMap::iterator it = r_streams.find(sid);
+		u32_t const next = (it == r_streams.end()) ? 0 : it->second->next;
+
+		//a pack of a stream carries one byte at least, and the peer keeps its bytes past next in the stream wnd
+		if ((seq - next) >= stream_wnd()) {
+			return;
+		}
+		if (it == r_streams.end()) {
+			it = r_streams.insert(WCB_RcvStreamMap::value_type(sid, wawo::make_ref<WCB_rcv_stream>())).first;
+		}
+		it->second->received.insert(seq, pack);
+		stream_deliver(sid, *(it->second));
+	}
+
+	//r_mutex held, the peer keeps in the window, the ones past it wait for the user to read
+	void WCB::stream_deliver(u16_t const& sid, WCB_rcv_stream& st) {
+		WWRP<WCB_received_pack>* next;
+		while ((next = st.received.find(st.next)) != NULL) {
+			WWRP<WCB_received_pack> const inpack = *next;
+			u32_t const len = inpack->header.dlen - WCP_STREAM_HEADER_LEN;
+			if ((stream_wnd() - (st.rb == NULL ? 0 : st.rb->count())) < len) {
+				break;
+			}
+			if (len > 0) {
+				_ringbuffer_reserve(st.rb, len, stream_wnd());
+				st.rb->write(inpack->data + WCP_STREAM_HEADER_LEN, len);
+			}
+			st.received.erase(st.next);
+			++st.next;
+		}
+
+		if (st.rb != NULL && st.rb->count() > 0 && r_streams_ready.insert(sid).second) {
+			if (!(wcb_option&WCP_O_NONBLOCK)) {
+				r_cond.notify_all();
+			}
+		}
+	}
+
+	void WCB::stream_wnd_arrive(WWRP<WCB_received_pack> const& pack) {
+		if (pack->header.dlen < WCP_STREAM_WND_LEN) {
+			return;
+		}
+
+		u16_t const sid = wawo::bytes_helper::read_u16((byte_t const*)pack->data);
+		byte_t const* const limit_at = (byte_t const*)pack->data + sizeof(u16_t);
+		u64_t const limit = (u64_t(wawo::bytes_helper::read_u32(limit_at)) << 32) | wawo::bytes_helper::read_u32(limit_at + sizeof(u32_t));
+
+		lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+		WCB_SndStreamMap::iterator it = s_streams.find(sid);
+		if (it != s_streams.end() && limit > it->second->limit) {
+			it->second->limit = limit;
+		}
+	}
+
+	//s_mutex held
+	bool WCB::stream_cut(u32_t& nmax_try_bytes) {
+		WCB_SndStreamMap::iterator it = s_streams.lower_bound(s_stream_next);
+		for (u32_t i = 0; i < s_streams.size(); ++i, ++it) {
+			if (it == s_streams.end()) {
+				it = s_streams.begin();
+			}
+
+			WCB_snd_stream& st = *(it->second);
+			if (st.sb == NULL || st.sb->count() == 0 || st.offset >= st.limit) {
+				continue;
+			}
+
+			WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
+			opack->header.seq = snd_info.dsn++;
+			opack->header.flag = WCP_FLAG_STM | WCP_FLAG_ACK;
+			wawo::bytes_helper::write_u16(it->first, (byte_t*)opack->data);
+			wawo::bytes_helper::write_u32(st.seq++, opack->data + sizeof(u16_t));
+
+			u32_t const room = static_cast<u32_t>(WAWO_MIN(u64_t(WCP_STREAM_MDU), st.limit - st.offset));
+			u32_t const nread = st.sb->read(opack->data + WCP_STREAM_HEADER_LEN, room);
+			opack->header.dlen = (nread + WCP_STREAM_HEADER_LEN) & 0xFFFF;
+			st.offset += nread;
+			snd_sending.push(opack);
+
+			nmax_try_bytes -= WAWO_MIN(u32_t(opack->header.dlen + WCP_HeaderLen), nmax_try_bytes);
+			s_stream_next = it->first + 1;
+			return true;
+		}
+		return false;
+	}
+
+	bool WCB::msg_arrive(WWRP<WCB_received_pack> const& pack) {
+		if (pack->from != remote_addr) {
+			return false;
+		}
+
+		lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+		if ((r_msgs_bytes + pack->header.dlen) > rcv_buffer_size) {
+			return false;
+		}
+		r_msgs.push(pack);
+		r_msgs_bytes += pack->header.dlen;
+		++counters.msgs_in;
+
+		if (!(wcb_option&WCP_O_NONBLOCK)) {
+			r_cond.notify_all();
+		}
+		return true;
+	}
+
+	//level of the watched evts, WPOLLERR is always reported
+	u32_t WCB::wpoll_check(u32_t const& evts) {
+		u32_t ready = 0;
+		if (evts&WPOLLIN) {
+			lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+			if (wcb_flag&WCB_FLAG_IS_LISTENER) {
+				if (backlogq.size()) {
+					ready |= WPOLLIN;
+				}
+			} else {
+				if ((rb != NULL && rb->count()) || !r_msgs.empty() || !r_streams_ready.empty() || ((r_flag&READ_REMOTE_FIN_RECEIVED) && !(r_flag&READ_REMOTE_FIN_READ_BY_USER))) {
+					ready |= WPOLLIN;
+				}
+			}
+
+			if (r_flag&(READ_RECV_ERROR | READ_LOCAL_READ_SHUTDOWNED)) {
+				WAWO_ASSERT(wcb_errno != wawo::OK);
+				ready |= WPOLLERR;
+			}
+		}
+
+		if (evts&WPOLLOUT) {
+			WAWO_ASSERT(!(wcb_flag&WCB_FLAG_IS_LISTENER));
+			lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+			if (s_flag&(WRITE_LOCAL_WRITE_SHUTDOWNED | WRITE_SEND_ERROR)) {
+				WAWO_ASSERT(wcb_errno != wawo::OK);
+				ready |= WPOLLERR;
+			}
+			else if ((state == WCB_ESTABLISHED) && (snd_buffer_size - (sb == NULL ? 0 : sb->count()))>(WCP_MDU * 2)) {
+				ready |= WPOLLOUT;
+			}
+		}
+
+		if (wcb_errno != 0) {
+			ready |= WPOLLERR;
+		}
+		return ready;
+	}
+
+	//called by engine after each update, only a watched wcb that is ready and not queued takes the wpoll mutex
+	void WCB::wpoll_notify() {
+		WWSP<wpoll_watch_event> evt;
+		{
+			lock_guard<spin_mutex> lg(wpoll_mutex);
+			evt = wpoll_evt;
+		}
+		if (evt == NULL) {
+			return;
+		}
+
+		WWSP<wpoll> wp = evt->wp.lock();
+		if (wp == NULL) {
+			return;
+		}
+
+		if (evt->queued.load(std::memory_order_acquire)) {
+			return;
+		}
+		u32_t const watching = evt->evts.load(std::memory_order_acquire);
+
+		if (state != WCB_RECYCLE && (watching == 0 || wpoll_check(watching) == 0)) {
+			return;
+		}
+		wp->push(evt);
+	}
+
+	void WCB::check_recv(u64_t const& now) {
+
+		{
+			if (received_vec->size()) { received_vec->clear(); }
+			lock_guard<spin_mutex> lg_received_vec(received_vec_mutex);
+			{
+				if (received_vec_standby->size() != 0) {
+					received_vec.swap(received_vec_standby);
+				}
+			}
+		}
+
+		u32_t received_size = received_vec->size();
+		if (received_size) {
+			rcv_buffer_last_active = now;
+		}
+		if (received_size == 0) {
+			u64_t timediff = ((now - keepalive_timer_last_received_pack)/1000);
+			if ( keepalive_probes_sent >= keepalive_vals.probes ) {
+				lock_guard<spin_mutex> lg_r_mutex( r_mutex);
+				r_flag |= READ_RECV_ERROR;
+				wcb_errno = wawo::E_ETIMEOUT;
+				WCP_TRACE("[wcp][%u:%s]connection timeout", fd, remote_addr.address_info().cstr );
+			}
+			else if (timediff >= static_cast<u64_t>(keepalive_vals.idle + (keepalive_vals.interval*keepalive_probes_sent))) {
+				//lock_guard<spin_mutex> lg_s_mutex( s_mutex );
+				keepalive();
+				++keepalive_probes_sent;
+				WCP_TRACE("[wcp][%u:%s]keepalive, probes: %u", fd, remote_addr.address_info().cstr, keepalive_probes_sent );
+			}
+			else {}
+		}
+		else {
+
+			keepalive_timer_last_received_pack = now;
+			keepalive_probes_sent = 0;
+
+			WAWO_ASSERT(snd_sack_scoreboard.size() == 0);
+			for (u32_t i = 0; i < received_size; ++i) {
+				WWRP<WCB_received_pack> const& pack = (*received_vec)[i];
+				++counters.packs_in;
+				counters.bytes_in += WCP_HeaderLen + pack->header.dlen;
+
+				//ack new means the packet has been read by remote user, so rwnd should be updated
+				//@todo, we should check ack range
+				if (seq_before(snd_info.una, pack->header.ack)) {
+					snd_info.una = pack->header.ack;
+					wcb_flag |= SND_UNA_UPDATE;
+					snd_info.rwnd = pack->header.wnd;
+				}
+
+				if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_WND)) {
+					snd_info.rwnd = pack->header.wnd;
+				}
+
+				if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_SACK)) {
+					if (pack->header.dlen < sizeof(u32_t)) {
+						++counters.malformed_packs;
+						WCP_TRACE("[wcp]check_recv, malformed sack, seq: %u, dlen: %u", pack->header.seq, pack->header.dlen);
+						continue;
+					}
+					u32_t const base = wawo::bytes_helper::read_u32((byte_t const*)pack->data);
+					if (pack->header.dlen > sizeof(u32_t)) {
+						++counters.sacks_in;
+					}
+					for (u32_t rlen = sizeof(u32_t); (rlen + sizeof(u16_t) * 2) <= pack->header.dlen; rlen += sizeof(u16_t) * 2) {
+						WCB_sack_range range;
+						range.start = base + wawo::bytes_helper::read_u16((byte_t const*)pack->data + rlen);
+						range.end = range.start + wawo::bytes_helper::read_u16((byte_t const*)pack->data + rlen + sizeof(u16_t));
+						snd_sack_scoreboard.push_back(range);
+					}
+					continue;
+				}
+
+				if (WCPPACK_TEST_FLAG(*pack, (WCP_FLAG_KEEP_ALIVE))) {
+					keepalive_reply();
+					WCP_TRACE("[wcp][%u:%s]keepalive reply, probes: %u", fd, remote_addr.address_info().cstr, keepalive_probes_sent);
+					continue;
+				}
+
+				if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_KEEP_ALIVE_REPLY)) {
+					continue;
+				}
+
+				if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_FEC)) {
+					fec_arrive(pack);
+					continue;
+				}
+
+				if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_DGM)) {
+					if (!msg_arrive(pack)) {
+						++counters.msgs_dropped;
+					}
+					continue;
+				}
+
+				//the peer keeps its flight under the wnd we advertised, a seq past it is not one it sent, drop it and tell the peer where we are
+				if (!seq_before(pack->header.seq, rcv_info.next) && (pack->header.seq - rcv_info.next) >= rcv_seq_span()) {
+					++counters.dup_packs;
+					wcb_flag |= RCV_ACK_NOW;
+					WCP_TRACE("[wcp]check_recv, out of wnd, seq: %u, flag: %u, wnd: %u, ack: %u, expect: %u",
+						pack->header.seq, pack->header.flag, pack->header.wnd, pack->header.ack, rcv_info.next);
+					continue;
+				}
+
+				//a message is delivered on its first arrival, the in order walk below only moves rcv_info.next past it
+				//one that finds r_msgs full is not acked, the peer retransmits it
+				if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_MSG) && !seq_before(pack->header.seq, rcv_info.next) &&
+					rcv_received.find(pack->header.seq) == NULL && !msg_arrive(pack))
+				{
+					continue;
+				}
+
+				//so does the pack of a stream, in the order of its stream
+				if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_STM) && !seq_before(pack->header.seq, rcv_info.next) &&
+					rcv_received.find(pack->header.seq) == NULL)
+				{
+					stream_arrive(pack);
+				}
+
+				if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_STW)) {
+					stream_wnd_arrive(pack);
+				}
+
+				snd_sacked_seqs.push_back(pack->header.seq);
+				if (rcv_ack_since == 0) {
+					rcv_ack_since = now;
+				}
+				//the peer waits on handshake packs, a duplicate means our ack was lost
+				if (!WCPPACK_TEST_FLAG(*pack, (WCP_FLAG_DAT | WCP_FLAG_MSG | WCP_FLAG_STM | WCP_FLAG_STW)) || seq_before(pack->header.seq, rcv_info.next)) {
+					wcb_flag |= RCV_ACK_NOW;
+				}
+
+				if (seq_before(pack->header.seq, rcv_info.next)) {
+					++counters.dup_packs;
+					WCP_TRACE("[wcp]check_recv, duplicate (old), seq: %u, flag: %u, wnd: %u, ack: %u, expect: %u",
+						pack->header.seq, pack->header.flag, pack->header.wnd, pack->header.ack, rcv_info.next);
+
+					continue;
+				}
+
+				if (!rcv_received.insert(pack->header.seq, pack)) {
+					++counters.dup_packs;
+					WCP_TRACE("[wcp]check_recv, duplicate (new), update rwnd, seq: %u, flag: %u, wnd: %u, ack: %u, expect: %u",
+						pack->header.seq, pack->header.flag, pack->header.wnd, pack->header.ack, rcv_info.next);
+				}
+				else if (rcv_fec_groups.size()) {
+					fec_check(pack->header.seq);
+				}
+				//wcb_flag |= RCV_ARRIVE_NEW;
+			}
+
+
+			if (snd_sack_scoreboard.size()) {
+				std::sort(snd_sack_scoreboard.begin(), snd_sack_scoreboard.end(), [](WCB_sack_range const& a, WCB_sack_range const& b) {
+					return seq_before(a.start, b.start);
+				});
+
+				for (u32_t i = 0; i < snd_sack_scoreboard.size(); ++i) {
+					u32_t const start = seq_before(snd_sack_scoreboard[i].start, snd_info.una) ? snd_info.una : snd_sack_scoreboard[i].start;
+					u32_t const end = snd_sack_scoreboard[i].end;
+					if (!seq_before(start, end)) {
+						continue;
+					}
+
+					u32_t const ack = end - 1;
+					if (seq_before(snd_biggest_ack, ack)) {
+						//WCP_TRACE("[wcp]biggest_ack update, last: %u, now: %u, una: %u", snd_biggest_ack, ack, snd_info.una );
+						snd_biggest_ack = ack;
+						wcb_flag |= SND_BIGGEST_SACK_UPDATE;
+					}
+
+					//walked by distance, the seqs wrap
+					u32_t const flight_begin = seq_before(start, snd_flights.begin_seq()) ? snd_flights.begin_seq() : start;
+					u32_t const flight_end = seq_before(snd_flights.end_seq(), end) ? snd_flights.end_seq() : end;
+					u32_t seq = flight_begin;
+					for (u32_t n = seq_before(flight_begin, flight_end) ? (flight_end - flight_begin) : 0; n > 0; --n, ++seq) {
+						WWRP<WCB_pack> const* otf = snd_flights.find(seq);
+						if (otf != NULL) {
+							_handle_pack_acked(*otf, now);
+							snd_flights.erase(seq);
+						}
+					}
+
+					if (cc->on_sacked(*this, ack, now)) {
+						wcb_flag |= SND_FAST_RECOVERED;
+					}
+				}
+				snd_sack_scoreboard.clear();
+			}
+
+			WWRP<WCB_received_pack>* next;
+			while ((next = rcv_received.find(rcv_info.next)) != NULL) {
+				WWRP<WCB_received_pack> const inpack = *next;
+				u32_t const seq = rcv_info.next;
+
+				//the data of a handshake pack is the syn cookie
+				if (inpack->header.dlen>0 && WCPPACK_TEST_FLAG(*(inpack), WCP_FLAG_DAT)) {
+
+					WAWO_ASSERT(!WCPPACK_TEST_FLAG(*(inpack), (WCP_FLAG_SYN | WCP_FLAG_FIN)));
+
+					if (inpack->from != remote_addr) {
+						reply_rst_to_address(so, inpack->header.ack, inpack->from);
+
+						lock_guard<spin_mutex> lg_wcb(mutex);
+						state = WCB_CLOSED;
+						wcb_errno = wawo::E_ECONNABORTED;
+
+						rcv_received.erase(seq);
+						break;
+					}
+
+					u32_t const rb_left = rcv_buffer_size - (rb_standby == NULL ? 0 : rb_standby->count());
+					if (rb_left < inpack->header.dlen) {
+						WAWO_WARN("[wcp]check recv, wcb rb buffer not enough, break, incoming dlen: %u, rb->left_capacity(): %u", inpack->header.dlen, rb_left);
+						r_flag |= READ_RWND_LESS_THAN_MTU;
+						break;
+					}
+
+					_ringbuffer_reserve(rb_standby, inpack->header.dlen, rcv_buffer_size);
+					rb_standby->write(inpack->data, inpack->header.dlen);
+					rcv_delivered += inpack->header.dlen;
+					rcv_info.wnd = rcv_buffer_size - rb_standby->count();
+					if (rcv_info.wnd <= WCP_MTU) {
+						r_flag |= READ_RWND_LESS_THAN_MTU;
+					}
+					else {
+						r_flag &= ~(READ_RWND_LESS_THAN_MTU | READ_RWND_MORE_THAN_MTU);
+					}
+				}
+
+				rcv_info.next++;
+
+				if (WCPPACK_TEST_FLAG(*(inpack), WCP_FLAG_RST)) {
+					lock_guard<spin_mutex> lg_wcp_state(mutex);
 
 					wcb_errno = wawo::E_ECONNRESET;
 					state = WCB_CLOSED;
 					cond.notify_all();
 
-					lock_guard<spin_mutex> lg_r_mutex(r_mutex);
-					r_cond.notify_all();
-					break;
-				}
+					lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+					r_cond.notify_all();
+					break;
+				}
+
+				if (WCPPACK_TEST_FLAG(*(inpack), WCP_FLAG_SYN)) {
+					lock_guard<spin_mutex> lg_wcp_state(mutex);
+					if (state == WCB_SYN_RECEIVED) {
+						SYNSYNACK();
+					}
+					else if (state == WCB_SYN_SENT) {
+						//update remote
+						remote_addr = inpack->from;
+						SYNACK(inpack);
+					}
+					else {
+						reply_rst_to_address(so, inpack->header.ack, inpack->from);
+						rcv_received.erase(seq);
+
+						wcb_errno = wawo::E_ECONNABORTED;
+						state = WCB_CLOSED;
+						cond.notify_all();
+						break;
+					}
+				}
+
+				if (WCPPACK_TEST_FLAG(*(inpack), WCP_FLAG_ACK)) {
+					lock_guard<spin_mutex> lg_wcp_state(mutex);
+					switch (state) {
+					case WCB_SYN_SENT:
+					{
+						WAWO_ASSERT( !remote_addr.is_null() );
+						WAWO_ASSERT( remote_addr == inpack->from );
+
+						int connrt = so->connect(remote_addr);
+						if (connrt == wawo::OK) {
+							state = WCB_ESTABLISHED;
+						}
+						else {
+							wcb_errno = connrt;
+							state = WCB_CLOSED;
+						}
+
+						if (!(wcb_option&WCP_O_NONBLOCK)) {
+							cond.notify_all();
+						}
+					}
+					break;
+					case WCB_SYN_RECEIVED:
+					{
+						state = WCB_ESTABLISHED;
+					}
+					break;
+					case WCB_FIN_WAIT_1:
+					{
+						state = WCB_FIN_WAIT_2;
+					}
+					break;
+					case WCB_LAST_ACK:
+					{
+						state = WCB_CLOSED;
+					}
+					break;
+					case WCB_CLOSING:
+					{
+						timer_state = now;
+						state = WCB_TIME_WAIT;
+					}
+					break;
+					case WCB_ESTABLISHED:
+					{
+						//update una
+					}
+					break;
+					case WCB_FIN_WAIT_2:
+					{
+						//do nothing
+					}
+					break;
+					case WCB_CLOSE_WAIT:
+					case WCB_TIME_WAIT:
+					{}
+					break;
+					default:
+					{
+						WAWO_ASSERT(!"wcp state logic issue");
+					}
+					break;
+					}
+				}
+
+				if (WCPPACK_TEST_FLAG(*(inpack), WCP_FLAG_FIN)) {
+					lock_guard<spin_mutex> lg_wcp_state(mutex);
+
+					switch (state) {
+					case WCB_ESTABLISHED:
+					{
+						state = WCB_CLOSE_WAIT;
+						lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+						r_flag |= READ_REMOTE_FIN_RECEIVED;
+						r_flag &= ~READ_REMOTE_FIN_READ_BY_USER;
+
+						cond.notify_all();
+						r_cond.notify_all();
+					}
+					break;
+					case WCB_FIN_WAIT_1:
+					{
+						state = WCB_CLOSING;
+					}
+					break;
+					case WCB_FIN_WAIT_2:
+					{
+						timer_state = now;
+						state = WCB_TIME_WAIT;
+					}
+					break;
+					default:
+					{
+						state = WCB_CLOSED;
+						wcb_errno = wawo::E_ECONNABORTED;
+						reply_rst_to_address(so, inpack->header.ack, inpack->from);
+					}
+					break;
+					}
+					FINACK();
+				}
+
+				if (wcb_flag&RCV_FEC_ARRIVED) {
+					rcv_fec_history.insert(seq, inpack);
+					rcv_fec_history.erase(seq - WCP_FEC_K_MAX);
+				}
+				rcv_received.erase(seq);
+			}
+
+			//groups whose packs are all delivered
+			while (rcv_fec_groups.size() && (rcv_fec_groups.begin()->first + rcv_fec_groups.begin()->second.k) <= rcv_info.next) {
+				rcv_fec_groups.erase(rcv_fec_groups.begin());
+			}
+		}
+
+		if ( (rb == NULL || rb->count() == 0) && rb_standby != NULL && rb_standby->count() != 0 ) {
+			lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+			WAWO_ASSERT( rb_standby->count() != 0 );
+			if (rb == NULL || rb->count() == 0) {
+				rb.swap(rb_standby);
+
+				WAWO_ASSERT(rb->count() != 0);
+				if (r_flag&READ_RWND_LESS_THAN_MTU) {
+					r_flag |= READ_RWND_MORE_THAN_MTU;
+					rcv_info.wnd = rcv_buffer_size - (rb_standby == NULL ? 0 : rb_standby->count());
+				}
+
+				if (!(wcb_option&WCP_O_NONBLOCK)) {
+					r_cond.notify_all();
+				}
+			}
+		}
+
+		//windows of the streams read by user, they go out in seq space with the next check_send
+		{
+			lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+			for (u32_t i = 0; i < r_streams_wnd.size(); ++i) {
+				u16_t const sid = r_streams_wnd[i];
+				WCB_RcvStreamMap::iterator it = r_streams.find(sid);
+				WAWO_ASSERT(it != r_streams.end());
+				WCB_rcv_stream& st = *(it->second);
+				stream_deliver(sid, st);
+
+				u64_t const limit = st.read + stream_wnd();
+				if (limit <= st.limit) {
+					continue;
+				}
+				st.limit = limit;
+
+				WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
+				opack->header.flag = WCP_FLAG_STW | WCP_FLAG_ACK;
+				wawo::bytes_helper::write_u16(sid, (byte_t*)opack->data);
+				wawo::bytes_helper::write_u64(limit, opack->data + sizeof(u16_t));
+				opack->header.dlen = WCP_STREAM_WND_LEN;
+				snd_stream_wnds.push(opack);
+			}
+			r_streams_wnd.clear();
+		}
+
+		rcv_wnd_tune(now);
+
+		if (!(wcb_option&WCP_O_NONBLOCK)) {
+			if (r_flag&(READ_RECV_ERROR|READ_LOCAL_READ_SHUTDOWNED))
+			{
+				lock_guard<spin_mutex> lg_state(mutex);
+				cond.notify_all();
+
+				lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+				r_cond.notify_all();
+			}
+		}
+	}
+
+	void WCB::check_flights(u64_t const& now) {
+
+//#define DISABLE_RTO
+#ifdef DISABLE_RTO
+		return;
+#endif
+
+		if ( !(wcb_flag&(SND_UNA_UPDATE|SND_FAST_RECOVERED|SND_BIGGEST_SACK_UPDATE|SND_RETRANSMIT_PACED)) && (now)<snd_last_rto_timer+WCP_RTO_CLOCK_GRANULARITY) {
+			return;
+		}
+		snd_last_rto_timer = now;
+
+		u32_t lost_count = 0;
+		u32_t max_sent_time = 0;
+
+		//floor of the fast retransmit wait, srtt is 0 on loopback, a pack out of order within one tick would go again
+		u32_t const srtt_timeout = WAWO_MAX(srtt + (rttvar >> 2), u32_t(WCP_FAST_RETRANSMIT_GRAULARITY));
+
+		if ((wcb_flag&SND_UNA_UPDATE)) {
+			u32_t const acked_end = seq_before(snd_flights.end_seq(), snd_info.una) ? snd_flights.end_seq() : snd_info.una;
+			u32_t seq = snd_flights.begin_seq();
+			for (u32_t n = seq_before(seq, acked_end) ? (acked_end - seq) : 0; n > 0; --n, ++seq) {
+				WWRP<WCB_pack> const* otf = snd_flights.find(seq);
+				if (otf != NULL) {
+					_handle_pack_acked(*otf, now);
+					snd_flights.erase(seq);
+				}
+			}
+		}
+
+		//a flight goes again no earlier than fast_timeout after it was sent, so only the head of snd_flights_sent sent before that is taken
+		//the stale ones, acked or sent again since, are dropped on the way
+		u32_t const fast_timeout = WAWO_MIN(srtt_timeout, rto);
+		snd_flights_due.clear();
+		while (!snd_flights_sent.empty()) {
+			WCB_flight_sent const& sent = snd_flights_sent.front();
+			WWRP<WCB_pack> const* otf = snd_flights.find(sent.seq);
+			if (otf != NULL && (*otf)->sent_ts == sent.ts) {
+				if ((now - sent.ts) < fast_timeout) {
+					break;
+				}
+				snd_flights_due.push_back(sent);
+			}
+			snd_flights_sent.pop_front();
+		}
+
+		//kept for next_timer
+		u64_t oldest_sent = snd_flights_sent.empty() ? 0 : snd_flights_sent.front().ts;
+		u64_t const unwalked_sent = oldest_sent;
+
+		//they go in the order of seq, the hole at una first
+		u32_t const una = snd_info.una;
+		std::sort(snd_flights_due.begin(), snd_flights_due.end(), [una](WCB_flight_sent const& a, WCB_flight_sent const& b) {
+			return (a.seq - una) < (b.seq - una);
+		});
+
+		u64_t const rate = pacing_rate();
+		u64_t const now_us = (rate != 0) ? wcp_now_us() : 0;
+		wcb_flag &= ~SND_RETRANSMIT_PACED;
+
+		size_t nkept = 0;
+		bool blocked = false;
+		for (size_t i = 0; i < snd_flights_due.size(); ++i) {
+			WCB_flight_sent const sent = snd_flights_due[i];
+			WWRP<WCB_pack> const& flight_pack = *snd_flights.find(sent.seq);
+			if (blocked) {
+				snd_flights_due[nkept++] = sent;
+				continue;
+			}
+
+			static const char* retransmit_reason[] = {
+				"",
+				"AS", //ack skip
+				"FR", //fast recovery
+				"RO", //rto
+			};
+
+			(void)retransmit_reason;
+
+			u8_t retransmit = 0;
+			u32_t timediff = static_cast<u32_t>(now - flight_pack->sent_ts);
+			i32_t skip = snd_biggest_ack - flight_pack->header.seq;
+
+			if( (skip>=1) && timediff >= srtt_timeout) {
+				retransmit = 1;
+			}
+			else if ((wcb_flag&SND_FAST_RECOVERED) && timediff >= srtt_timeout) {
+				retransmit = 2;
+			}
+			else if (timediff >= static_cast<u32_t>(rto)) {
+				retransmit = 3;
+			}
+			else {}
+
+			//retransmits take from the pacing budget as new data does, the ones over it wait in the head
+			if (retransmit > 0 && rate != 0 && now_us < snd_pacing_release_us) {
+				wcb_flag |= SND_RETRANSMIT_PACED;
+				blocked = true;
+				snd_flights_due[nkept++] = sent;
+				continue;
+			}
+
+			if (retransmit == 3) {
+				++lost_count;
+				cc->on_timeout(*this, flight_pack, now);
+
+				if (flight_pack->sent_times > max_sent_time) {
+					max_sent_time = flight_pack->sent_times;
+				}
+			}
+
+			if (retransmit > 0) {
+				int sndrt = send_pack(flight_pack);
+
+				if (sndrt != wawo::OK) {
+					if (sndrt != wawo::E_SOCKET_SEND_BLOCK) {
+						lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+						wcb_errno = sndrt;
+						s_flag |= WRITE_SEND_ERROR;
+
+						WAWO_ERR("[wcp][rt][%s]skip: %d,seq: %u ,failed: %d,stimes: %u,una: %u,cwnd: %u,rwnd: %u,nflight: %u,ssthresh: %u,rto: %u,srtt: %u,rttvar: %u",
+							retransmit_reason[retransmit], skip, flight_pack->header.seq, sndrt, flight_pack->sent_times, snd_info.una, snd_info.cwnd, snd_info.rwnd, snd_nflight_bytes, snd_info.ssthresh, rto, srtt, rttvar
+						);
+					}
+
+					WCP_TRACE("[wcp][rt][%s]skip: %d,seq: %u,failed: %d,stimes: %u,una: %u,cwnd: %u,rwnd: %u,nflight: %u,ssthresh: %u,rto: %u,srtt: %u,rttvar: %u",
+						retransmit_reason[retransmit], skip, flight_pack->header.seq, sndrt, flight_pack->sent_times, snd_info.una, snd_info.cwnd, snd_info.rwnd, snd_nflight_bytes, snd_info.ssthresh, rto, srtt, rttvar
+					);
+					//it is due already, the next check comes by WCP_RTO_CLOCK_GRANULARITY
+					blocked = true;
+					snd_flights_due[nkept++] = sent;
+					continue;
+				}
+
+				flight_pack->sent_ts = now;
+				flight_pack->sent_times++;
+				snd_flights_sent.push_back({ flight_pack->header.seq, now });
+
+				if (rate != 0) {
+					snd_pacing_release_us = WAWO_MAX(snd_pacing_release_us, now_us - WCP_PACING_QUANTUM_US) + ((flight_pack->header.dlen + WCP_HeaderLen) * 1000000ULL) / rate;
+				}
+
+				switch (retransmit) {
+				case 1: ++counters.retransmits_ack_skip; break;
+				case 2: ++counters.retransmits_fast_recovery; break;
+				default: ++counters.retransmits_rto; break;
+				}
+
+				WCP_TRACE("[wcp][rt][%s]td: %u,skip: %d,seq: %u,stimes: %u,una: %u,cwnd: %u,rwnd: %u,nflight: %u,ssthresh: %u,rto: %u,srtt: %u,rttvar: %u",
+					retransmit_reason[retransmit], timediff, skip, flight_pack->header.seq, flight_pack->sent_times, snd_info.una, snd_info.cwnd, snd_info.rwnd, snd_nflight_bytes, snd_info.ssthresh, rto, srtt, rttvar
+				);
+				continue;
+			}
+
+			snd_flights_due[nkept++] = sent;
+		}
+
+		//the ones kept are due already, they go back to the head in any order
+		for (size_t i = 0; i < nkept; ++i) {
+			snd_flights_sent.push_front(snd_flights_due[i]);
+			if (oldest_sent == 0 || snd_flights_due[i].ts < oldest_sent) {
+				oldest_sent = snd_flights_due[i].ts;
+			}
+		}
+		snd_flights_oldest_sent = oldest_sent;
+		snd_flights_unwalked_sent = unwalked_sent;
+
+		//a fast recovery held by pacing goes on in the next check
+		wcb_flag &= ~(SND_BIGGEST_SACK_UPDATE |SND_UNA_UPDATE | ((wcb_flag&SND_RETRANSMIT_PACED) ? 0 : SND_FAST_RECOVERED));
+		if (lost_count > 0) {
+			++counters.rto_fires;
+		}
+
+		if ( lost_count>=WCP_LOST_THRESHOLD || max_sent_time >= 5 ) {
+
+			WAWO_ASSERT( rto >= WCP_RTO_MIN ) ;
+			rto = WAWO_MIN((rto >> 1) + rto, WCP_RTO_MAX);
+			WCP_TRACE("[wcp]lost detected, wcp new rto: %u, srrt: %u, rttvar: %u", rto, srtt, rttvar);
+
+			if (state == WCB_ESTABLISHED) {
+				cc->on_lost(*this, now);
+			}
+		}
+	}
+
+
+	//@issue 1: we did not considerate faireness for each session for current implementation
+	void WCB::check_send(u64_t const& now) {
+
+		if (s_flag&WRITE_SEND_ERROR) {
+			WAWO_WARN("[wcp][%u]WCB::check_send, send error already: %s", fd, remote_addr.address_info().cstr);
+			return;
+		}
+
+		
+		{
+			//update rwnd manually
+			if ( (r_flag&READ_RWND_MORE_THAN_MTU) && (now - r_timer_last_rwnd_update)>WCP_RWND_CHECK_GRANULARITY) {
+
+				if (s_sending_ignore_seq_space.size() == 0) {
+					update_rwnd();
+				}
+				else {
+					WWRP<WCB_pack>& pack = s_sending_ignore_seq_space.front();
+					pack->header.flag |= WCP_FLAG_WND;
+				}
+				r_timer_last_rwnd_update = now;
+			}
+
+			if (!send_ignore_seq_space()) {
+				return;
+			}
+		}
+		
+_begin_send:
+		while ( snd_sending.size() ) {
+			WWRP<WCB_pack>& pack = snd_sending.front();
+
+			u32_t ntotal_bytes = pack->header.dlen + WCP_HeaderLen;
+			if ( ((ntotal_bytes + snd_nflight_bytes) >= WAWO_MIN(snd_info.cwnd, snd_info.rwnd)) )
+			{
+				WCP_TRACE("[wcp]congest seq: %u,flag: %u,size: %u,una: %u,cwnd: %u,rwnd: %u,flight: %u,ssthresh: %u,rto: %u,srtt: %u,rttvar: %u",
+					pack->header.seq, pack->header.flag, ntotal_bytes,snd_info.una, snd_info.cwnd, snd_info.rwnd, snd_nflight_bytes, snd_info.ssthresh, rto,srtt,rttvar
+				);
+				
+				return ;
+			}
+
+			WAWO_ASSERT(pack->header.seq == snd_info.next, "[wcp][%d]seq: %u, una: %u, flag: %u, next: %u", fd, pack->header.seq, snd_info.una, pack->header.flag, snd_info.next );
+			WAWO_ASSERT(!seq_before(pack->header.seq, snd_info.una), "[wcp][%d]seq: %u, una: %u, flag: %u",fd, pack->header.seq, snd_info.una, pack->header.flag );
+
+			u64_t const rate = pacing_rate();
+			u64_t now_us = 0;
+			if (rate != 0) {
+				now_us = wcp_now_us();
+				if (now_us < snd_pacing_release_us) {
+					return;
+				}
+			}
+
+			int sndrt = send_pack(pack);
+			if (sndrt != wawo::OK) {
+				if (sndrt != wawo::E_SOCKET_SEND_BLOCK) {
+					lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+					wcb_errno = sndrt;
+					s_flag |= WRITE_SEND_ERROR;
+				}
+				return;
+			}
+
+			WAWO_ASSERT(!WCPPACK_TEST_FLAG(*pack, (WCP_FLAG_SACK | WCP_FLAG_KEEP_ALIVE | WCP_FLAG_KEEP_ALIVE_REPLY)));
+
+			pack->sent_ts = now;
+			pack->sent_times = 1;
+			pack->sent_us = (now_us != 0) ? now_us : wcp_now_us();
+			pack->delivered = snd_delivered;
+			pack->delivered_us = (snd_nflight_bytes == 0 || snd_delivered_us == 0) ? pack->sent_us : snd_delivered_us;
+
+			if (snd_flights.count() == 0) {
+				snd_flights_sent.clear();
+				snd_flights_oldest_sent = now;
+				snd_flights_unwalked_sent = 0;
+			}
+			snd_flights.insert(pack->header.seq, pack);
+			snd_flights_sent.push_back({ pack->header.seq, now });
+			snd_nflight_bytes += ntotal_bytes;
+			cc->on_sent(*this, pack, now);
+
+			if (rate != 0) {
+				snd_pacing_release_us = WAWO_MAX(snd_pacing_release_us, now_us - WCP_PACING_QUANTUM_US) + (ntotal_bytes * 1000000ULL) / rate;
+			}
+
+			if (fec_k != 0) {
+				fec_add(pack);
+			}
 
-				if (WCPPACK_TEST_FLAG(*(inpack), WCP_FLAG_SYN)) {
-					lock_guard<spin_mutex> lg_wcp_state(mutex);
-					if (state == WCB_SYN_RECEIVED) {
-						SYNSYNACK();
-					}
-					else if (state == WCB_SYN_SENT) {
-						//update remote
-						remote_addr = inpack->from;
-						SYNACK();
-					}
-					else {
-						reply_rst_to_address(so, inpack->header.ack, inpack->from);
-						rcv_received.erase(it);
+			snd_info.next++;
 
-						wcb_errno = wawo::E_ECONNABORTED;
-						state = WCB_CLOSED;
-						cond.notify_all();
-						break;
-					}
+			if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_FIN)) {
+				lock_guard<spin_mutex> lg_wcp_state(mutex);
+
+				switch (state) {
+				case WCB_ESTABLISHED:
+				{
+					timer_state = now;
+					state = WCB_FIN_WAIT_1;
+
+					lock_guard<spin_mutex> lg_s_mutex( s_mutex );
+					s_flag |= WRITE_LOCAL_FIN_SENT;
+				}
+				break;
+				case WCB_CLOSE_WAIT:
+				{
+					state = WCB_LAST_ACK;
+					timer_state = now;
 				}
+				break;
+				default:
+				{
+					WAWO_ASSERT(!"wcp state logic issue");
+				}
+				break;
+				}
+				break;
+			}
 
-				if (WCPPACK_TEST_FLAG(*(inpack), WCP_FLAG_ACK)) {
-					lock_guard<spin_mutex> lg_wcp_state(mutex);
-					switch (state) {
-					case WCB_SYN_SENT:
-					{
-						WAWO_ASSERT( !remote_addr.is_null() );
-						WAWO_ASSERT( remote_addr == inpack->from );
+			if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_SYN)) {
+				lock_guard<spin_mutex> lg_wcp_state(mutex);
+				//a passive one got the final ack together with the rebuilt syn, it may be past WCB_SYN_RECEIVED already
+				WAWO_ASSERT(state == WCB_SYNING || state == WCB_SYN_RECEIVED || (wcb_flag&WCB_FLAG_IS_PASSIVE_OPEN));
+				if (state == WCB_SYNING) {
+					state = WCB_SYN_SENT;
+					//connect() stamped it on the caller's clock, which might be ahead of now
+					timer_state = now;
+				}
+			}
 
-						int connrt = so->connect(remote_addr);
-						if (connrt == wawo::OK) {
-							state = WCB_ESTABLISHED;
-						}
-						else {
-							wcb_errno = connrt;
-							state = WCB_CLOSED;
-						}
+			snd_sending.pop();
+		}
 
-						if (!(wcb_option&WCP_O_NONBLOCK)) {
-							cond.notify_all();
-						}
-					}
-					break;
-					case WCB_SYN_RECEIVED:
-					{
-						state = WCB_ESTABLISHED;
-					}
-					break;
-					case WCB_FIN_WAIT_1:
-					{
-						state = WCB_FIN_WAIT_2;
-					}
-					break;
-					case WCB_LAST_ACK:
-					{
-						state = WCB_CLOSED;
-					}
-					break;
-					case WCB_CLOSING:
-					{
-						timer_state = now;
-						state = WCB_TIME_WAIT;
-					}
-					break;
-					case WCB_ESTABLISHED:
-					{
-						//update una
-					}
-					break;
-					case WCB_FIN_WAIT_2:
-					{
-						//do nothing
+		
+		while (s_sending_standby.size()) {
+			snd_sending.push(s_sending_standby.front());
+			s_sending_standby.pop();
+		}
+
+		if (snd_stream_wnds.size()) {
+			lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+			while (snd_stream_wnds.size()) {
+				WWRP<WCB_pack> const& opack = snd_stream_wnds.front();
+				opack->header.seq = snd_info.dsn++;
+				snd_sending.push(opack);
+				snd_stream_wnds.pop();
+			}
+		}
+
+		u32_t nmax_try_bytes = snd_info.cwnd - snd_nflight_bytes;
+		if ( !(s_flag&WRITE_LOCAL_FIN_SENT) && (nmax_try_bytes) > WCP_MTU) {
+
+			lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+			if ((sb != NULL && sb->count()>0) || !s_msgs.empty()) {
+				snd_buffer_last_active = now;
+			}
+
+			//messages go ahead of the stream, the unreliable ones are never in flight, the ones sent in one srtt count against the window instead
+			wcb_flag &= ~SND_DGM_HELD;
+			if ((now - snd_dgm_round) >= WAWO_MAX(srtt, u32_t(WCP_RTO_CLOCK_GRANULARITY))) {
+				snd_dgm_round = now;
+				snd_dgm_bytes = 0;
+			}
+			while (!s_msgs.empty() && nmax_try_bytes > 0) {
+				WWRP<WCB_pack> const opack = s_msgs.front();
+				u32_t const ntotal_bytes = opack->header.dlen + WCP_HeaderLen;
+				if (WCPPACK_TEST_FLAG(*opack, WCP_FLAG_DGM)) {
+					if (state != WCB_ESTABLISHED) {
+						break;
 					}
-					break;
-					case WCB_CLOSE_WAIT:
-					case WCB_TIME_WAIT:
-					{}
-					break;
-					default:
-					{
-						WAWO_ASSERT(!"wcp state logic issue");
+					if ((snd_dgm_bytes + ntotal_bytes) > nmax_try_bytes) {
+						wcb_flag |= SND_DGM_HELD;
+						break;
 					}
-					break;
+					snd_dgm_bytes += ntotal_bytes;
+					opack->header.seq = snd_info.dsn;
+					s_sending_ignore_seq_space.push(opack);
+					u64_t const rate = pacing_rate();
+					if (rate != 0) {
+						snd_pacing_release_us = WAWO_MAX(snd_pacing_release_us, wcp_now_us() - WCP_PACING_QUANTUM_US) + (ntotal_bytes * 1000000ULL) / rate;
 					}
+				} else {
+					opack->header.seq = snd_info.dsn++;
+					snd_sending.push(opack);
+					nmax_try_bytes -= WAWO_MIN(ntotal_bytes, nmax_try_bytes);
 				}
 
-				if (WCPPACK_TEST_FLAG(*(inpack), WCP_FLAG_FIN)) {
-					lock_guard<spin_mutex> lg_wcp_state(mutex);
-
-					switch (state) {
-					case WCB_ESTABLISHED:
-					{
-						state = WCB_CLOSE_WAIT;
-						lock_guard<spin_mutex> lg_r_mutex(r_mutex);
-						r_flag |= READ_REMOTE_FIN_RECEIVED;
-						r_flag &= ~READ_REMOTE_FIN_READ_BY_USER;
+				++counters.msgs_out;
+				s_msgs_bytes -= opack->header.dlen;
+				s_msgs.pop();
+			}
 
-						cond.notify_all();
-						r_cond.notify_all();
-					}
-					break;
-					case WCB_FIN_WAIT_1:
-					{
-						state = WCB_CLOSING;
-					}
-					break;
-					case WCB_FIN_WAIT_2:
-					{
-						timer_state = now;
-						state = WCB_TIME_WAIT;
+			u32_t const mdu = fec_k ? WCP_FEC_MDU : WCP_MDU;
+			//a pack of sb and one of the next stream by turns
+			bool sb_held = false;
+			while (nmax_try_bytes>0) {
+				bool const stream_cutted = stream_cut(nmax_try_bytes);
+				if (stream_cutted) {
+					snd_buffer_last_active = now;
+				}
+				if (sb_held || (sb == NULL) || (sb->count() == 0) || (nmax_try_bytes == 0)) {
+					if (!stream_cutted) {
+						break;
 					}
-					break;
-					default:
-					{
-						state = WCB_CLOSED;
-						wcb_errno = wawo::E_ECONNABORTED;
-						reply_rst_to_address(so, inpack->header.ack, inpack->from);
+					continue;
+				}
+
+				//nagle, a partial pack waits while the sent data is not acked
+				if (!nodelay && sb->count() < mdu && snd_flights.count() && !(s_flag&WRITE_LOCAL_WRITE_SHUTDOWNED)) {
+					if (snd_nagle_hold_since == 0) {
+						snd_nagle_hold_since = now;
 					}
-					break;
+					if ((now - snd_nagle_hold_since) < WCP_NAGLE_DELAY) {
+						sb_held = true;
+						continue;
 					}
-					FINACK();
 				}
+				snd_nagle_hold_since = 0;
 
-				it = rcv_received.erase(it);
-			}
+				WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
+				opack->header.seq = snd_info.dsn++;
+				opack->header.flag = WCP_FLAG_DAT | WCP_FLAG_ACK;
+
+				u32_t nread = sb->read(opack->data, mdu);
+				opack->header.dlen = nread & 0xFFFF;
+				snd_sending.push(opack);
+
+				nmax_try_bytes -= nread;
+			}			
 		}
 
-		if ( rb->count() == 0 && rb_standby->count() != 0 ) {
-			lock_guard<spin_mutex> lg_r_mutex(r_mutex);
-			WAWO_ASSERT( rb_standby->count() != 0 );
-			if (rb->count() == 0) {
-				rb.swap(rb_standby);
+		if (s_sending_ignore_seq_space.size() && !send_ignore_seq_space()) {
+			return;
+		}
 
-				WAWO_ASSERT(rb->count() != 0);
-				if (r_flag&READ_RWND_LESS_THAN_MTU) {
-					r_flag |= READ_RWND_MORE_THAN_MTU;
-					rcv_info.wnd = rb_standby->left_capacity();
-				}
+		if (snd_sending.size()) {
+			goto _begin_send;
+		}
 
-				if (!(wcb_option&WCP_O_NONBLOCK)) {
-					r_cond.notify_all();
-				}
+		//nothing more to send for now, let the tail get its parity
+		if (snd_fec_group.size()) {
+			bool sb_empty;
+			{
+				lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+				sb_empty = (sb == NULL || sb->count() == 0);
+			}
+			if (sb_empty || fec_k == 0) {
+				fec_flush();
 			}
 		}
+	}
 
-		if (!(wcb_option&WCP_O_NONBLOCK)) {
-			if (r_flag&(READ_RECV_ERROR|READ_LOCAL_READ_SHUTDOWNED))
-			{
-				lock_guard<spin_mutex> lg_state(mutex);
-				cond.notify_all();
+	//dynamic right sizing, rcv_buffer_size follows twice of what the user reads in one rtt, so the window does not hold a sender that the user keeps up with
+	void WCB::rcv_wnd_tune(u64_t const& now) {
+		if (rcv_wnd_max <= rcv_buffer_size) {
+			return;
+		}
 
-				lock_guard<spin_mutex> lg_r_mutex(r_mutex);
-				r_cond.notify_all();
+		//a window takes at least one rtt to arrive, the sample is an upper bound, so a smaller one is taken at once
+		if (rcv_rtt_time == 0) {
+			rcv_rtt_seq = rcv_info.next + WAWO_MAX(rcv_info.wnd / WCP_MDU, 1);
+			rcv_rtt_time = now;
+		} else if (!seq_before(rcv_info.next, rcv_rtt_seq)) {
+			u32_t sample = WAWO_MAX(static_cast<u32_t>(now - rcv_rtt_time), 1);
+			if (rcv_rtt == 0 || sample < rcv_rtt) {
+				rcv_rtt = sample;
+			} else {
+				sample = WAWO_MIN(sample, rcv_rtt << 1);
+				rcv_rtt = rcv_rtt - (rcv_rtt >> 3) + (sample >> 3);
 			}
+			rcv_rtt_time = 0;
 		}
-	}
 
-	void WCB::check_flights(u64_t const& now) {
+		u32_t rtt = (rcv_rtt != 0) ? rcv_rtt : srtt;
+		if (rtt == 0) {
+			return;
+		}
+		rtt = WAWO_MAX(rtt, WCP_RTO_CLOCK_GRANULARITY);
+		if ((now - rcv_space_time) < rtt) {
+			return;
+		}
 
-//#define DISABLE_RTO
-#ifdef DISABLE_RTO
-		return;
-#endif
+		lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+		u64_t const copied = rcv_delivered - (rb == NULL ? 0 : rb->count()) - (rb_standby == NULL ? 0 : rb_standby->count());
+		u32_t const space = static_cast<u32_t>(copied - rcv_space_copied);
+		rcv_space_copied = copied;
+		rcv_space_time = now;
 
-		if ( !(wcb_flag&(SND_UNA_UPDATE|SND_FAST_RECOVERED|SND_BIGGEST_SACK_UPDATE)) && (now)<snd_last_rto_timer+WCP_RTO_CLOCK_GRANULARITY) {
+		if (space <= rcv_space) {
 			return;
 		}
-		snd_last_rto_timer = now;
 
-		u32_t lost_count = 0;
-		u32_t max_sent_time = 0;
+		//a sender in slow start doubles in one rtt, give more if the reads grow faster than that
+		u64_t wnd = (u64_t(space) << 1) + 16 * WCP_MDU;
+		if (space >= (rcv_space + (rcv_space >> 2))) {
+			wnd += ((wnd*(space - rcv_space)) / rcv_space) << 1;
+		}
+		rcv_space = space;
 
-		WCB_PackList::iterator&& it = snd_flights.begin();
-		while (it != snd_flights.end()) {
+		wnd = WAWO_MIN(wnd, rcv_wnd_max);
+		if (wnd <= rcv_buffer_size) {
+			return;
+		}
 
-			WWSP<WCB_pack> const& flight_pack = *it;
-			if ((wcb_flag&SND_UNA_UPDATE) && flight_pack->header.seq < snd_info.una) {
-				_handle_pack_acked(it,now);
-				it = snd_flights.erase(it);
-				continue;
-			}
+		WCP_TRACE("[wcp][%u]rcv wnd tune, rtt: %u, space: %u, rcv_buffer_size: %u -> %u", fd, rtt, space, rcv_buffer_size, static_cast<u32_t>(wnd));
+		rcv_buffer_size = static_cast<u32_t>(wnd);
+		rcv_info.wnd = rcv_buffer_size - (rb_standby == NULL ? 0 : rb_standby->count());
+		if (r_flag&READ_RWND_LESS_THAN_MTU) {
+			r_flag |= READ_RWND_MORE_THAN_MTU;
+		}
+	}
 
-			static const char* retransmit_reason[] = {
-				"",
-				"AS", //ack skip
-				"FR", //fast recovery
-				"RO", //rto
-			};
+	//give back what a side has not used for WCP_BUFFER_IDLE_RELEASE, then take a new mem_info
+	void WCB::check_buffers(u64_t const& now) {
+		WCP_MemInfo info;
+		::memset(&info, 0, sizeof(WCP_MemInfo));
+		u32_t rcv_queued;
 
-			(void)retransmit_reason;
+		bool const rcv_idle = ((now - rcv_buffer_last_active) >= WCP_BUFFER_IDLE_RELEASE) && rcv_received.empty();
+		//the seqs of a delayed ack are pending sends too, a side that only receives never goes active on its own
+		bool const snd_idle = ((now - snd_buffer_last_active) >= WCP_BUFFER_IDLE_RELEASE) && snd_flights.empty() && snd_sending.empty() && snd_fec_group.empty() && snd_sacked_seqs.empty();
+		buffers_held = 0;
 
-			u8_t retransmit = 0;
-			u32_t timediff = static_cast<u32_t>(now - flight_pack->sent_ts);
-			i32_t skip = snd_biggest_ack - flight_pack->header.seq;
+		{
+			lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+			if (rcv_idle && (rb == NULL || rb->count() == 0) && (rb_standby == NULL || rb_standby->count() == 0)) {
+				rb = NULL;
+				rb_standby = NULL;
+			}
+			info.rcv_buffer = (rb == NULL ? 0 : rb->capacity()) + (rb_standby == NULL ? 0 : rb_standby->capacity());
+			rcv_queued = static_cast<u32_t>(r_msgs.size());
+			for (WCB_RcvStreamMap::iterator it = r_streams.begin(); it != r_streams.end(); ++it) {
+				WCB_rcv_stream& st = *(it->second);
+				if (rcv_idle && st.rb != NULL && st.rb->count() == 0) {
+					st.rb = NULL;
+				}
+				if (rcv_idle && st.received.empty()) {
+					st.received.shrink(WCP_PACK_RING_INIT);
+				}
+				info.rcv_buffer += (st.rb == NULL ? 0 : st.rb->capacity());
+				rcv_queued += st.received.count();
+			}
+		}
+
+		{
+			lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+			if (snd_idle && sb != NULL && sb->count() == 0 && s_sending_standby.empty()) {
+				sb = NULL;
+			}
+			info.snd_buffer = (sb == NULL ? 0 : sb->capacity());
+			for (WCB_SndStreamMap::iterator it = s_streams.begin(); it != s_streams.end(); ++it) {
+				WCB_snd_stream& st = *(it->second);
+				if (snd_idle && st.sb != NULL && st.sb->count() == 0) {
+					st.sb = NULL;
+				}
+				info.snd_buffer += (st.sb == NULL ? 0 : st.sb->capacity());
+			}
+			info.snd_packs = static_cast<u32_t>(s_sending_standby.size() + s_msgs.size());
+		}
 
-			if( (skip>=1) && timediff >= (srtt + (rttvar>>2) )) {
-				retransmit = 1;
+		if (rcv_idle) {
+			WCB_ReceivedPackVector().swap(*received_vec);
+			std::vector<byte_t>().swap(rcv_fec_buffer);
+			rcv_received.shrink(WCP_PACK_RING_INIT);
+			if (rcv_fec_history.empty()) {
+				rcv_fec_history.shrink(WCP_PACK_RING_INIT);
 			}
-			else if ((wcb_flag&SND_FAST_RECOVERED) && timediff >= (srtt + (rttvar >> 2))) {
-				retransmit = 2;
+		}
+
+		if (snd_idle) {
+			std::vector<byte_t>().swap(snd_fec_buffer);
+			std::vector<u32_t>().swap(snd_sacked_seqs);
+			WCB_SackRangeVector().swap(snd_sack_scoreboard);
+			snd_flights.shrink(WCP_PACK_RING_INIT);
+			WCB_FlightSentQueue().swap(snd_flights_sent);
+			std::vector<WCB_flight_sent>().swap(snd_flights_due);
+		}
+
+		{
+			lock_guard<spin_mutex> lg_received_vec(received_vec_mutex);
+			if (rcv_idle && received_vec_standby->empty()) {
+				WCB_ReceivedPackVector().swap(*received_vec_standby);
 			}
-			else if (timediff >= static_cast<u32_t>(rto)) {
-				++lost_count;
-				retransmit = 3;
+			info.rcv_packs = static_cast<u32_t>(received_vec_standby->size());
+			info.scratch = static_cast<u32_t>(received_vec_standby->capacity()*sizeof(WWRP<WCB_received_pack>) + rcv_gro_buffer.capacity());
+		}
 
-				if ( !(wcb_flag&SND_LOST_DETECTED) && (flight_pack->header.seq>snd_lost_biggest_seq)) {
-					snd_lost_biggest_seq = flight_pack->header.seq;
-				}
+		if (info.rcv_buffer != 0 || received_vec->capacity() != 0 || rcv_received.capacity() > WCP_PACK_RING_INIT || rcv_fec_buffer.capacity() != 0) {
+			buffers_held |= WCB_BUFFERS_RCV;
+		}
+		if (info.snd_buffer != 0 || snd_fec_buffer.capacity() != 0 || snd_sacked_seqs.capacity() != 0 || snd_flights.capacity() > WCP_PACK_RING_INIT) {
+			buffers_held |= WCB_BUFFERS_SND;
+		}
 
-				if (flight_pack->sent_times > max_sent_time) {
-					max_sent_time = flight_pack->sent_times;
+		//held past the idle time by the data in them, look again one idle time later
+		if ((buffers_held&WCB_BUFFERS_RCV) && (now - rcv_buffer_last_active) >= WCP_BUFFER_IDLE_RELEASE) {
+			rcv_buffer_last_active = now;
+		}
+		if ((buffers_held&WCB_BUFFERS_SND) && (now - snd_buffer_last_active) >= WCP_BUFFER_IDLE_RELEASE) {
+			snd_buffer_last_active = now;
+		}
+
+		info.rcv_packs += rcv_received.count() + rcv_fec_history.count() + rcv_queued;
+		for (WCB_FecGroupMap::const_iterator it = rcv_fec_groups.begin(); it != rcv_fec_groups.end(); ++it) {
+			for (u8_t i = 0; i < WCP_FEC_M_MAX; ++i) {
+				if (it->second.parity[i] != NULL) {
+					++info.rcv_packs;
 				}
 			}
-			else {}
+		}
+		info.rcv_packs *= sizeof(WCB_received_pack);
 
-			if (retransmit > 0) {
-				int sndrt = send_pack(*it);
+		info.snd_packs += static_cast<u32_t>(snd_sending.size() + s_sending_ignore_seq_space.size() + snd_fec_group.size()) + snd_flights.count();
+		info.snd_packs *= sizeof(WCB_pack);
 
-				if (sndrt != wawo::OK) {
-					if (sndrt != wawo::E_SOCKET_SEND_BLOCK) {
-						lock_guard<spin_mutex> lg_s_mutex(s_mutex);
-						wcb_errno = sndrt;
-						s_flag |= WRITE_SEND_ERROR;
+		info.scratch += static_cast<u32_t>(
+			received_vec->capacity()*sizeof(WWRP<WCB_received_pack>) +
+			(rcv_received.capacity() + rcv_fec_history.capacity())*sizeof(WWRP<WCB_received_pack>) +
+			snd_flights.capacity()*sizeof(WWRP<WCB_pack>) + (snd_flights_sent.size() + snd_flights_due.capacity())*sizeof(WCB_flight_sent) +
+			rcv_fec_buffer.capacity() + snd_fec_buffer.capacity() +
+			snd_sacked_seqs.capacity()*sizeof(u32_t) + snd_sack_scoreboard.capacity()*sizeof(WCB_sack_range)
+		);
 
-						WAWO_ERR("[wcp][rt][%s]skip: %d,seq: %u ,failed: %d,stimes: %u,una: %u,cwnd: %u,rwnd: %u,nflight: %u,ssthresh: %u,rto: %u,srtt: %u,rttvar: %u",
-							retransmit_reason[retransmit], skip, flight_pack->header.seq, sndrt, flight_pack->sent_times, snd_info.una, snd_info.cwnd, snd_info.rwnd, snd_nflight_bytes, snd_info.ssthresh, rto, srtt, rttvar
-						);
-					}
+		info.total = sizeof(WCB) + info.rcv_buffer + info.snd_buffer + info.rcv_packs + info.snd_packs + info.scratch;
 
-					WCP_TRACE("[wcp][rt][%s]skip: %d,seq: %u,failed: %d,stimes: %u,una: %u,cwnd: %u,rwnd: %u,nflight: %u,ssthresh: %u,rto: %u,srtt: %u,rttvar: %u",
-						retransmit_reason[retransmit], skip, flight_pack->header.seq, sndrt, flight_pack->sent_times, snd_info.una, snd_info.cwnd, snd_info.rwnd, snd_nflight_bytes, snd_info.ssthresh, rto, srtt, rttvar
-					);
-					break;
-				}
+		lock_guard<spin_mutex> lg(mutex);
+		mem_info = info;
+	}
 
-				flight_pack->sent_ts = now;
-				flight_pack->sent_times++;
+	void WCB::take_info() {
+		lock_guard<spin_mutex> lg(mutex);
+		info.state = static_cast<u8_t>(state);
+		info.congestion = congestion;
+		info.rto = rto;
+		info.srtt = srtt;
+		info.rttvar = rttvar;
+		info.snd_una = snd_info.una;
+		info.snd_nxt = snd_info.dsn;
+		info.snd_cwnd = snd_info.cwnd;
+		info.snd_ssthresh = snd_info.ssthresh;
+		info.snd_rwnd = snd_info.rwnd;
+		info.snd_nflight_bytes = snd_nflight_bytes;
+		info.rcv_next = rcv_info.next;
+		info.rcv_wnd = rcv_info.wnd;
+		info.counters = counters;
+	}
 
-				WCP_TRACE("[wcp][rt][%s]td: %u,skip: %d,seq: %u,stimes: %u,una: %u,cwnd: %u,rwnd: %u,nflight: %u,ssthresh: %u,rto: %u,srtt: %u,rttvar: %u",
-					retransmit_reason[retransmit], timediff, skip, flight_pack->header.seq, flight_pack->sent_times, snd_info.una, snd_info.cwnd, snd_info.rwnd, snd_nflight_bytes, snd_info.ssthresh, rto, srtt, rttvar
-				);
+	//false if the socket takes no more for now
+	bool WCB::send_ignore_seq_space() {
+		while (s_sending_ignore_seq_space.size()) {
+			WWRP<WCB_pack>& pack = s_sending_ignore_seq_space.front();
+			int sndrt = send_pack(pack);
+			if (sndrt != wawo::OK) {
+				if (sndrt != wawo::E_SOCKET_SEND_BLOCK) {
+					lock_guard<spin_mutex> lg_s_mutex(s_mutex);
+					wcb_errno = sndrt;
+					s_flag |= WRITE_SEND_ERROR;
+				}
+				return false;
 			}
+			s_sending_ignore_seq_space.pop();
+		}
+		return true;
+	}
 
-			++it;
+	//runs after check_send, the data packs sent in this update carry the ack already
+	void WCB::check_ack(u64_t const& now) {
+		if (snd_sacked_seqs.size() == 0 && !(wcb_flag&RCV_ACK_NOW)) {
+			return;
+		}
+
+		//a hole asks the peer for a retransmit, tell it at once
+		bool const now_ = (wcb_flag&RCV_ACK_NOW) || !rcv_received.empty();
+		if (!now_) {
+			if (rcv_acked == rcv_info.next) {
+				snd_sacked_seqs.clear();
+				rcv_ack_since = 0;
+				return;
+			}
+			if (snd_sacked_seqs.size() < WCP_ACK_EVERY && (now - rcv_ack_since) < WCP_ACK_DELAY) {
+				return;
+			}
 		}
 
-		wcb_flag &= ~(SND_BIGGEST_SACK_UPDATE |SND_UNA_UPDATE | SND_FAST_RECOVERED);
+		SACK(snd_sacked_seqs, rcv_info.next);
+		wcb_flag &= ~RCV_ACK_NOW;
+		rcv_ack_since = 0;
+		send_ignore_seq_space();
+	}
 
-		if ( lost_count>=WCP_LOST_THRESHOLD || max_sent_time >= 5 ) {
+	void WCB::fec_add(WWRP<WCB_pack> const& pack) {
+		WAWO_ASSERT(fec_k != 0 && fec_m != 0);
+		if (!WCPPACK_TEST_FLAG(*pack, WCP_FLAG_DAT) || pack->header.dlen > WCP_FEC_MDU) {
+			fec_flush();
+			return;
+		}
 
-			WAWO_ASSERT( rto >= WCP_RTO_MIN ) ;
-			rto = WAWO_MIN((rto >> 1) + rto, WCP_RTO_MAX);
-			WCP_TRACE("[wcp]lost detected, wcp new rto: %u, srrt: %u, rttvar: %u", rto, srtt, rttvar);
+		if (snd_fec_group.size() && (snd_fec_group.front()->header.seq + snd_fec_group.size()) != pack->header.seq) {
+			fec_flush();
+		}
+
+		snd_fec_group.push_back(pack);
+		if (snd_fec_group.size() >= fec_k) {
+			fec_flush();
+		}
+	}
 
-			if ( (state == WCB_ESTABLISHED) && (now-snd_lost_detected_timer)>= WAWO_MAX(srtt,30) ) {
-				snd_lost_detected_timer = now;
-				snd_lost_bigger_than_lost_seq_time = 0;
+	void WCB::fec_flush() {
+		if (snd_fec_group.size() == 0) {
+			return;
+		}
 
-				u32_t last_flight_max = snd_nflight_bytes_max;
-				(void)last_flight_max;
+		u8_t const k = static_cast<u8_t>(snd_fec_group.size());
+		u8_t const m = WAWO_MAX(fec_m, 1);
+		WAWO_ASSERT(k <= WCP_FEC_K_MAX && m <= WCP_FEC_M_MAX);
 
-				u32_t half_flight_max = snd_nflight_bytes_max >> 1;
-				u32_t new_ssthresh = WAWO_MAX(half_flight_max,  WCP_SND_SSTHRESH_MIN );
-				WAWO_ASSERT( snd_nflight_bytes_max >= snd_nflight_bytes );
+		u16_t len = 0;
+		for (u8_t i = 0; i < k; ++i) {
+			len = WAWO_MAX(len, snd_fec_group[i]->header.dlen);
+		}
+		len += sizeof(u16_t) * 2;
 
-				snd_lost_cwnd_for_fast_recovery_compensation = (new_ssthresh-(snd_nflight_bytes>>1));
-				snd_info.ssthresh = WAWO_MIN(new_ssthresh, snd_info.ssthresh );
+		if (snd_fec_buffer.size() < (WCP_FEC_K_MAX*(WCP_MDU))) {
+			snd_fec_buffer.resize(WCP_FEC_K_MAX*(WCP_MDU));
+		}
 
-				snd_nflight_bytes_max = WAWO_MAX(snd_nflight_bytes_max >>1, snd_nflight_bytes);
-				wcb_flag |= (SND_CWND_SLOW_START|SND_LOST_DETECTED);
-				wcb_flag &= ~SND_CWND_CONGEST_AVOIDANCE;
+		byte_t const* blocks[WCP_FEC_K_MAX];
+		for (u8_t i = 0; i < k; ++i) {
+			WWRP<WCB_pack> const& pack = snd_fec_group[i];
+			byte_t* b = &snd_fec_buffer[i*len];
+			wawo::bytes_helper::write_u16(pack->header.flag, b);
+			wawo::bytes_helper::write_u16(pack->header.dlen, b + sizeof(u16_t));
+			::memcpy(b + sizeof(u16_t) * 2, pack->data, pack->header.dlen);
+			::memset(b + sizeof(u16_t) * 2 + pack->header.dlen, 0, len - sizeof(u16_t) * 2 - pack->header.dlen);
+			blocks[i] = b;
+		}
 
-				snd_info.cwnd = WCP_CWND_Cfg::WCP_LW*WCP_MTU;
-				WCP_TRACE("[wcp]lost detected in establish state,ssthresh: %u,una: %u, rwnd: %u,last_flight_max: %u,curr_flight_max: %u,nflight: %u,compensation: %u",
-					snd_info.ssthresh, snd_info.una, snd_info.rwnd, last_flight_max, snd_nflight_bytes_max, snd_nflight_bytes, snd_lost_cwnd_for_fast_recovery_compensation);
+		u32_t const base = snd_fec_group.front()->header.seq;
+		snd_fec_group.clear();
+
+		u64_t const rate = pacing_rate();
+		for (u8_t idx = 0; idx < m; ++idx) {
+			WWRP<WCB_pack> opack = wawo::make_ref<WCB_pack>();
+			opack->header.seq = base;
+			opack->header.flag = WCP_FLAG_FEC;
+			opack->header.dlen = (WCP_FEC_HEADER_LEN - sizeof(u16_t) * 2) + len;
+			opack->data[0] = k;
+			opack->data[1] = m;
+			opack->data[2] = idx;
+			opack->data[3] = 0;
+			wcp_fec::encode(blocks, k, len, idx, opack->data + (WCP_FEC_HEADER_LEN - sizeof(u16_t) * 2));
+
+			//parity is best effort, a failed one is as if lost on the link
+			if (send_pack(opack) != wawo::OK) {
+				break;
+			}
+			if (rate != 0) {
+				snd_pacing_release_us += ((opack->header.dlen + WCP_HeaderLen) * 1000000ULL) / rate;
 			}
 		}
 	}
 
+	void WCB::fec_arrive(WWRP<WCB_received_pack> const& parity) {
+		wcb_flag |= RCV_FEC_ARRIVED;
 
-	//@issue 1: we did not considerate faireness for each session for current implementation
-	void WCB::check_send(u64_t const& now) {
+		if (parity->header.dlen < WCP_FEC_HEADER_LEN) {
+			return;
+		}
 
-		if (s_flag&WRITE_SEND_ERROR) {
-			WAWO_WARN("[wcp][%u]WCB::check_send, send error already: %s", fd, remote_addr.address_info().cstr);
+		u8_t const k = parity->data[0];
+		u8_t const m = parity->data[1];
+		u8_t const idx = parity->data[2];
+		u16_t const len = parity->header.dlen - (WCP_FEC_HEADER_LEN - sizeof(u16_t) * 2);
+		u32_t const base = parity->header.seq;
+
+		if (k == 0 || k > WCP_FEC_K_MAX || m == 0 || m > WCP_FEC_M_MAX || idx >= m) {
+			WCP_TRACE("[wcp]fec_arrive, invalid parity, seq: %u, k: %u, m: %u, idx: %u", base, k, m, idx);
 			return;
 		}
 
-		
-		{
-			//update rwnd manually
-			if ( (r_flag&READ_RWND_MORE_THAN_MTU) && (now - r_timer_last_rwnd_update)>WCP_RWND_CHECK_GRANULARITY) {
+		if ((base + k) <= rcv_info.next) {
+			return;
+		}
+		//the rebuilt packs go to rcv_received, keep them in the wnd as check_recv does
+		if (!seq_before(base, rcv_info.next) && (base - rcv_info.next) >= rcv_seq_span()) {
+			return;
+		}
 
-				if (s_sending_ignore_seq_space.size() == 0) {
-					update_rwnd();
-				}
-				else {
-					WWSP<WCB_pack>& pack = s_sending_ignore_seq_space.front();
-					pack->header.flag |= WCP_FLAG_WND;
-				}
-				r_timer_last_rwnd_update = now;
+		WCB_FecGroupMap::iterator it = rcv_fec_groups.find(base);
+		if (it == rcv_fec_groups.end()) {
+			if (rcv_fec_groups.size() >= WCP_FEC_GROUP_MAX) {
+				return;
 			}
+			WCB_fec_group g;
+			g.k = k;
+			g.m = m;
+			g.len = len;
+			it = rcv_fec_groups.insert(WCB_FecGroupMap::value_type(base, g)).first;
+		}
+		else if (it->second.k != k || it->second.m != m || it->second.len != len) {
+			return;
+		}
 
-			while (s_sending_ignore_seq_space.size()) {
-				WWSP<WCB_pack>& pack = s_sending_ignore_seq_space.front();
-				int sndrt = send_pack(pack);
-				if (sndrt != wawo::OK) {
-					if (sndrt != wawo::E_SOCKET_SEND_BLOCK) {
-						lock_guard<spin_mutex> lg_s_mutex(s_mutex);
-						wcb_errno = sndrt;
-						s_flag |= WRITE_SEND_ERROR;
-					}
+		it->second.parity[idx] = parity;
+		fec_rebuild(it);
+	}
+
+	void WCB::fec_check(u32_t const& seq) {
+		WCB_FecGroupMap::iterator it = rcv_fec_groups.upper_bound(seq);
+		if (it == rcv_fec_groups.begin()) {
+			return;
+		}
+		--it;
+		if (seq < (it->first + it->second.k)) {
+			fec_rebuild(it);
+		}
+	}
+
+	//rebuild the missing data packs if there are enough parity, the group is dropped once nothing more could be done with it
+	void WCB::fec_rebuild(WCB_FecGroupMap::iterator const& it) {
+		u32_t const base = it->first;
+		WCB_fec_group const& g = it->second;
+
+		WWRP<WCB_received_pack> const* packs[WCP_FEC_K_MAX];
+		u8_t nlost = 0;
+		for (u8_t j = 0; j < g.k; ++j) {
+			u32_t const seq = base + j;
+			if (seq < rcv_info.next) {
+				packs[j] = rcv_fec_history.find(seq);
+				if (packs[j] == NULL) {
+					//delivered before we kept the history, no way to use the parity
+					rcv_fec_groups.erase(it);
 					return;
 				}
-				s_sending_ignore_seq_space.pop();
+			} else {
+				packs[j] = rcv_received.find(seq);
+				if (packs[j] == NULL) {
+					++nlost;
+				}
 			}
 		}
-		
-_begin_send:
-		while ( snd_sending.size() ) {
-			WWSP<WCB_pack>& pack = snd_sending.front();
 
-			u32_t ntotal_bytes = pack->header.dlen + WCP_HeaderLen;
-			if ( ((ntotal_bytes + snd_nflight_bytes) >= WAWO_MIN(snd_info.cwnd, snd_info.rwnd)) )
-			{
-				WCP_TRACE("[wcp]congest seq: %u,flag: %u,size: %u,una: %u,cwnd: %u,rwnd: %u,flight: %u,ssthresh: %u,rto: %u,srtt: %u,rttvar: %u",
-					pack->header.seq, pack->header.flag, ntotal_bytes,snd_info.una, snd_info.cwnd, snd_info.rwnd, snd_nflight_bytes, snd_info.ssthresh, rto,srtt,rttvar
-				);
-				
-				return ;
+		if (nlost == 0) {
+			rcv_fec_groups.erase(it);
+			return;
+		}
+
+		byte_t const* parity[WCP_FEC_M_MAX];
+		WWRP<WCB_received_pack> any_parity;
+		u8_t nparity = 0;
+		for (u8_t i = 0; i < g.m; ++i) {
+			parity[i] = NULL;
+			if (g.parity[i] != NULL) {
+				parity[i] = g.parity[i]->data + (WCP_FEC_HEADER_LEN - sizeof(u16_t) * 2);
+				any_parity = g.parity[i];
+				++nparity;
 			}
+		}
+		if (nparity < nlost) {
+			return;
+		}
 
-			WAWO_ASSERT(pack->header.seq == snd_info.next, "[wcp][%d]seq: %u, una: %u, flag: %u, next: %u", fd, pack->header.seq, snd_info.una, pack->header.flag, snd_info.next );
-			WAWO_ASSERT(pack->header.seq >= snd_info.una, "[wcp][%d]seq: %u, una: %u, flag: %u",fd, pack->header.seq, snd_info.una, pack->header.flag );
+		if (rcv_fec_buffer.size() < (WCP_FEC_K_MAX*(WCP_MDU))) {
+			rcv_fec_buffer.resize(WCP_FEC_K_MAX*(WCP_MDU));
+		}
 
-			int sndrt = send_pack(pack);
-			if (sndrt != wawo::OK) {
-				if (sndrt != wawo::E_SOCKET_SEND_BLOCK) {
-					lock_guard<spin_mutex> lg_s_mutex(s_mutex);
-					wcb_errno = sndrt;
-					s_flag |= WRITE_SEND_ERROR;
-				}
-				return;
+		byte_t const* blocks[WCP_FEC_K_MAX];
+		byte_t* rebuilt[WCP_FEC_K_MAX];
+		for (u8_t j = 0; j < g.k; ++j) {
+			byte_t* b = &rcv_fec_buffer[j*g.len];
+			rebuilt[j] = b;
+			if (packs[j] == NULL) {
+				blocks[j] = NULL;
+				continue;
 			}
 
-			WAWO_ASSERT(!WCPPACK_TEST_FLAG(*pack, (WCP_FLAG_SACK | WCP_FLAG_KEEP_ALIVE | WCP_FLAG_KEEP_ALIVE_REPLY)));
+			WCB_received_pack const& pack = *(*packs[j]);
+			if ((pack.header.dlen + sizeof(u16_t) * 2) > g.len) {
+				rcv_fec_groups.erase(it);
+				return;
+			}
+			wawo::bytes_helper::write_u16(pack.header.flag, b);
+			wawo::bytes_helper::write_u16(pack.header.dlen, b + sizeof(u16_t));
+			::memcpy(b + sizeof(u16_t) * 2, pack.data, pack.header.dlen);
+			::memset(b + sizeof(u16_t) * 2 + pack.header.dlen, 0, g.len - sizeof(u16_t) * 2 - pack.header.dlen);
+			blocks[j] = b;
+		}
 
-			pack->sent_ts = now;
-			pack->sent_times = 1;
+		if (!wcp_fec::decode(blocks, g.k, parity, g.m, g.len, rebuilt)) {
+			return;
+		}
 
-			snd_flights.push_back(pack);
-			snd_nflight_bytes += ntotal_bytes;
+		for (u8_t j = 0; j < g.k; ++j) {
+			if (blocks[j] != NULL) {
+				continue;
+			}
 
-			if ( snd_nflight_bytes > snd_nflight_bytes_max) {
-				snd_nflight_bytes_max = snd_nflight_bytes;
+			u16_t const flag = wawo::bytes_helper::read_u16((byte_t const*)rebuilt[j]);
+			u16_t const dlen = wawo::bytes_helper::read_u16((byte_t const*)rebuilt[j] + sizeof(u16_t));
+			if (!(flag&WCP_FLAG_DAT) || (flag&(WCP_FLAG_SYN | WCP_FLAG_FIN | WCP_FLAG_FEC)) || (dlen + sizeof(u16_t) * 2) > g.len) {
+				WCP_TRACE("[wcp]fec_rebuild, bad block, base: %u, idx: %u, flag: %u, dlen: %u", base, j, flag, dlen);
+				continue;
 			}
 
-			snd_info.next++;
+			WWRP<WCB_received_pack> pack = wawo::make_ref<WCB_received_pack>();
+			pack->header.seq = base + j;
+			pack->header.ack = any_parity->header.ack;
+			pack->header.wnd = any_parity->header.wnd;
+			pack->header.flag = flag;
+			pack->header.dlen = dlen;
+			pack->from = any_parity->from;
+			::memcpy(pack->data, rebuilt[j] + sizeof(u16_t) * 2, dlen);
+
+			rcv_received.insert(pack->header.seq, pack);
+			snd_sacked_seqs.push_back(pack->header.seq);
+			WCP_TRACE("[wcp]fec_rebuild, seq: %u, dlen: %u, base: %u", pack->header.seq, dlen, base);
+		}
 
-			if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_FIN)) {
-				lock_guard<spin_mutex> lg_wcp_state(mutex);
+		rcv_fec_groups.erase(it);
+	}
 
-				switch (state) {
-				case WCB_ESTABLISHED:
-				{
-					timer_state = now;
-					state = WCB_FIN_WAIT_1;
+	int WCB::send_pack(WWRP<WCB_pack> const& pack) {
+		WAWO_ASSERT(!remote_addr.is_null());
+		WAWO_ASSERT(engine != NULL);
 
-					lock_guard<spin_mutex> lg_s_mutex( s_mutex );
-					s_flag |= WRITE_LOCAL_FIN_SENT;
-				}
-				break;
-				case WCB_CLOSE_WAIT:
-				{
-					state = WCB_LAST_ACK;
-					timer_state = now;
-				}
-				break;
-				default:
+		WCB_batch& batch = engine->snd_batch();
+		if (batch.count >= snd_batch) {
+			int flushrt = flush_packs();
+			WAWO_RETURN_V_IF_NOT_MATCH(flushrt, flushrt == wawo::OK);
+		}
+
+		pack->header.ack = rcv_info.next;
+		pack->header.wnd = rcv_info.wnd;
+		rcv_acked = rcv_info.next;
+
+		udp_message& m = batch.msgs[batch.count];
+		u16_t len;
+		WCPPACK_TO_UDPMESSAGE(*pack, m.buff, WCP_MTU, len);
+		m.len = len;
+		m.addr = so->is_connected() ? address() : remote_addr;
+		m.segment = 0;
+		++batch.count;
+		++counters.packs_out;
+		counters.bytes_out += len;
+
+#ifdef WCP_TRACE_INOUT_PACK
+		WCP_TRACE("[wcp]WCB::send_pack, sendto: %s, seq: %u, flag: %u, ack: %u, wnd: %u",
+			remote_addr.address_info().cstr, pack->header.seq, pack->header.flag, pack->header.ack, pack->header.wnd);
+#endif
+		return wawo::OK;
+	}
+
+	//packs failed to flush are dropped, as if they were lost on the link
+	int WCB::flush_packs() {
+		WAWO_ASSERT(engine != NULL);
+
+		WCB_batch& batch = engine->snd_batch();
+		if (batch.count == 0) {
+			return wawo::OK;
+		}
+
+		int ec;
+		u32_t const count = batch.count;
+		u32_t nmsgs = 0;
+		batch.count = 0;
+
+		if (offload&WCP_OFFLOAD_GSO) {
+			//coalesce the contiguous run of equal sized datagrams into one super datagram, the last one may be shorter
+			udp_message gso_msgs[WCP_BATCH_MAX];
+			u32_t gso_first[WCP_BATCH_MAX];
+			u32_t ngso = 0;
+			for (u32_t i = 0; i < count; ++ngso) {
+				udp_message& g = gso_msgs[ngso];
+				g = batch.msgs[i];
+				gso_first[ngso] = i;
+
+				u32_t const segment = batch.msgs[i].len;
+				u32_t nsegs = 1;
+				while ((++i < count) && (nsegs < WCP_GSO_SEGMENT_MAX) &&
+					(batch.msgs[i - 1].len == segment) &&
+					(batch.msgs[i].len <= segment) &&
+					(batch.msgs[i].buff == (g.buff + g.len)) &&
+					(batch.msgs[i].addr == g.addr))
 				{
-					WAWO_ASSERT(!"wcp state logic issue");
+					g.len += batch.msgs[i].len;
+					++nsegs;
 				}
-				break;
-				}
-				break;
+				g.segment = nsegs > 1 ? (segment&0xFFFF) : 0;
 			}
 
-			if (WCPPACK_TEST_FLAG(*pack, WCP_FLAG_SYN)) {
-				lock_guard<spin_mutex> lg_wcp_state(mutex);
-				WAWO_ASSERT(state == WCB_SYNING || state == WCB_SYN_RECEIVED);
-				if (state == WCB_SYNING) {
-					state = WCB_SYN_SENT;
+			u32_t nsent = so->sendmmsg(gso_msgs, ngso, ec);
+			if (nsent == ngso) {
+				return wawo::OK;
+			}
+			nmsgs = gso_first[nsent];
+
+			if (ec != wawo::E_EIO &&
+				ec != wawo::E_EINVAL &&
+				ec != wawo::E_EMSGSIZE &&
+				ec != wawo::E_ENOPROTOOPT &&
+				ec != wawo::E_EOPNOTSUPP)
+			{
+				if (ec != wawo::E_SOCKET_SEND_BLOCK) {
+					WAWO_WARN("[wcp]WCB::flush_packs failed: %d, sent: %u/%u, sendto: %s", ec, nmsgs, count, remote_addr.address_info().cstr);
 				}
+				return ec;
 			}
 
-			snd_sending.pop();
+			//the kernel or the device refused segmentation, go on with plain datagrams
+			WAWO_WARN("[wcp]WCB::flush_packs gso refused: %d, turn it off, sendto: %s", ec, remote_addr.address_info().cstr);
+			offload &= ~WCP_OFFLOAD_GSO;
 		}
 
-		
-		while (s_sending_standby.size()) {
-			snd_sending.push(s_sending_standby.front());
-			s_sending_standby.pop();
+		nmsgs += so->sendmmsg(batch.msgs + nmsgs, count - nmsgs, ec);
+		if (nmsgs == count) {
+			return wawo::OK;
 		}
 
-		u32_t nmax_try_bytes = snd_info.cwnd - snd_nflight_bytes;
-		if ( !(s_flag&WRITE_LOCAL_FIN_SENT) && (nmax_try_bytes) > WCP_MTU) {
+		if (ec != wawo::E_SOCKET_SEND_BLOCK) {
+			WAWO_WARN("[wcp]WCB::flush_packs failed: %d, sent: %u/%u, sendto: %s", ec, nmsgs, count, remote_addr.address_info().cstr);
+		}
+		return ec;
+	}
 
-			lock_guard<spin_mutex> lg_s_mutex(s_mutex);
-			while ( (sb->count()>0) && (nmax_try_bytes>0) ) {
+	u8_t WCB::set_offload(u8_t const& flag) {
+		WAWO_ASSERT(so != NULL);
 
-				WWSP<WCB_pack> opack = wawo::make_shared<WCB_pack>();
-				opack->header.seq = snd_info.dsn++;
-				opack->header.flag = WCP_FLAG_DAT | WCP_FLAG_ACK;
+		if (flag&WCP_OFFLOAD_GRO) {
+			if (!(offload&WCP_OFFLOAD_GRO)) {
+				//the buffer must be ready before the kernel begins to coalesce, or pump_packs would truncate
+				{
+					lock_guard<spin_mutex> lg(received_vec_mutex);
+					rcv_gro_buffer.resize(WCP_GRO_BATCH*WCP_GRO_BUFFER_SIZE);
+				}
+				if (so->set_udp_gro(true) == wawo::OK) {
+					offload |= WCP_OFFLOAD_GRO;
+				} else {
+					lock_guard<spin_mutex> lg(received_vec_mutex);
+					std::vector<byte_t>().swap(rcv_gro_buffer);
+				}
+			}
+		} else if (offload&WCP_OFFLOAD_GRO) {
+			//keep the buffer, there might be coalesced datagrams in the queue yet
+			so->set_udp_gro(false);
+			offload &= ~WCP_OFFLOAD_GRO;
+		}
 
-				WWSP<wawo::packet> data = wawo::make_shared<wawo::packet>(WCP_MDU);
-				u32_t nread = sb->read(data->begin(), WCP_MDU);
-				data->forward_write_index(nread);
-				opack->data = data;
-				opack->header.dlen = nread & 0xFFFF;
-				snd_sending.push(opack);
+		if (flag&WCP_OFFLOAD_GSO) {
+			//probe only, segment size is given by each send
+			if (!(offload&WCP_OFFLOAD_GSO) && so->set_udp_segment(WCP_MTU) == wawo::OK) {
+				so->set_udp_segment(0);
+				offload |= WCP_OFFLOAD_GSO;
+			}
+		} else {
+			offload &= ~WCP_OFFLOAD_GSO;
+		}
 
-				nmax_try_bytes -= nread;
-			}			
+		return offload;
+	}
+
+	//a listener passes it to the accepted ones, others could only switch before any data flies
+	int WCB::set_congestion(u8_t const& type) {
+		if (state != WCB_CLOSED && state != WCB_LISTEN) {
+			return wawo::E_INVALID_STATE;
 		}
 
-		if (snd_sending.size()) {
-			goto _begin_send;
+		WWRP<wcp_cc_abstract> _cc = wcp_cc_make(type);
+		if (_cc == NULL) {
+			return wawo::E_EINVAL;
 		}
-	}
 
-	int WCB::send_pack(WWSP<WCB_pack> const& pack) {
-		WAWO_ASSERT(!remote_addr.is_null());
-		pack->header.ack = rcv_info.next;
-		pack->header.wnd = rcv_info.wnd;
-		return inject_to_address(so, pack, remote_addr);
+		snd_info.ssthresh = WCP_SND_SSTHRESH_DEFAULT;
+		snd_info.cwnd = WCP_CWND_Cfg::WCP_IW*WCP_MTU;
+		_cc->init(*this);
+
+		cc = _cc;
+		congestion = type;
+		return wawo::OK;
 	}
 
 	void WCB::listen_handle_syn() {
@@ -891,8 +2461,10 @@ _begin_send:
 		u32_t i = 0;
 		for( ;i<received_size;++i ) {
 
-			WWSP<WCB_received_pack> const& pack = (*received_vec_standby)[i];
+			WWRP<WCB_received_pack> const& pack = (*received_vec_standby)[i];
 			address const& from = pack->from;
+			++counters.packs_in;
+			counters.bytes_in += WCP_HeaderLen + pack->header.dlen;
 
 			{
 				lock_guard<spin_mutex> lg_r_mutex(r_mutex);
@@ -909,123 +2481,255 @@ _begin_send:
 				continue;
 			}
 
-			if (!WCPPACK_TEST_FLAG( *pack, WCP_FLAG_SYN)) {
-				WAWO_WARN("[wcp]WCB::accept, flag none WCP_FLAG_SYN, flag: %u, remote addr: %s, reply rst", pack->header.flag, from.address_info().cstr);
-				reply_rst_to_address(so, pack->header.ack, from);
+			//a connection accepted already, a retransmitted syn or a pack that raced with its watch, its wcb answers by itself
+			if (wcp::instance()->four_tuple_fd(local_addr, from) != 0) {
+				WAWO_DEBUG("[wcp]WCB::accept, pack of an accepted one from: %s, ignore", from.address_info().cstr);
+				continue;
+			}
+
+			//nothing is kept for a syn, the wcb is made when the final ack brings the cookie back
+			if (WCPPACK_TEST_FLAG( *pack, WCP_FLAG_SYN)) {
+				WAWO_DEBUG("[wcp]WCB::accept, receive new syn from: %s, reply cookie", from.address_info().cstr);
+				reply_syn_cookie_to_address(so, wcp::instance()->make_syn_cookie(local_addr, from), rcv_info.wnd, from);
+				continue;
+			}
+
+			//no rst for the others, the final ack of a handshake might be on its way yet
+			if (!WCPPACK_TEST_FLAG(*pack, WCP_FLAG_ACK) ||
+				pack->header.seq != 1 ||
+				pack->header.dlen < sizeof(u32_t) ||
+				!wcp::instance()->check_syn_cookie(local_addr, from, wawo::bytes_helper::read_u32((byte_t const*)pack->data))
+			) {
+				WCP_TRACE("[wcp]WCB::accept, no valid cookie, flag: %u, seq: %u, remote addr: %s, ignore", pack->header.flag, pack->header.seq, from.address_info().cstr);
 				continue;
 			}
 
-			WAWO_DEBUG("[wcp]WCB::accept, receive new syn from: %s", from.address_info().cstr);
-			WWRP<socket> accepted_so = wawo::make_ref<socket>(so->get_buffer_cfg(), F_PF_INET, ST_DGRAM, P_UDP, OPTION_NONE);
+			WAWO_DEBUG("[wcp]WCB::accept, receive valid cookie from: %s", from.address_info().cstr);
+			WWRP<socket> accepted_so;
+			if (wcb_flag&WCB_FLAG_SHARED_SO) {
+				accepted_so = so;
+			} else {
+				accepted_so = wawo::make_ref<socket>(so->get_buffer_cfg(), F_PF_INET, ST_DGRAM, P_UDP, OPTION_NONE);
 
-			int openrt = accepted_so->open();
-			if (openrt != wawo::OK) {
-				WAWO_ERR("[wcp]WCB::accept, call socket() failed: %d", openrt);
-				accepted_so->close(openrt);
+				int openrt = accepted_so->open();
+				if (openrt != wawo::OK) {
+					WAWO_ERR("[wcp]WCB::accept, call socket() failed: %d", openrt);
+					accepted_so->close(openrt);
 
-				reply_rst_to_address(so, pack->header.ack, from);
-				continue;
-			}
+					reply_rst_to_address(so, pack->header.ack, from);
+					continue;
+				}
+				wcp_netem::instance()->attach(accepted_so);
 
-			int reusert = accepted_so->reuse_addr();
-			if(reusert != wawo::OK) {
-				WAWO_ERR("[wcp]WCB::accept, call reuse_addr() failed: %d", reusert);
+				int reusert = accepted_so->reuse_addr();
+				if(reusert != wawo::OK) {
+					WAWO_ERR("[wcp]WCB::accept, call reuse_addr() failed: %d", reusert);
 
-				accepted_so->close(reusert);
-				reply_rst_to_address(so, pack->header.ack, from);
-				continue;
-			}
+					accepted_so->close(reusert);
+					reply_rst_to_address(so, pack->header.ack, from);
+					continue;
+				}
 
-			reusert = accepted_so->reuse_port();
-			if(reusert != wawo::OK) {
-				WAWO_ERR("[wcp]WCB::accept, call reuse_port() failed: %d", reusert);
-				accepted_so->close(reusert);
+				reusert = accepted_so->reuse_port();
+				if(reusert != wawo::OK) {
+					WAWO_ERR("[wcp]WCB::accept, call reuse_port() failed: %d", reusert);
+					accepted_so->close(reusert);
 
-				reply_rst_to_address(so, pack->header.ack, from);
-				continue;
-			}
+					reply_rst_to_address(so, pack->header.ack, from);
+					continue;
+				}
 
-			sockaddr_in addr_local;
-			addr_local.sin_family = AF_INET;
-			addr_local.sin_addr.s_addr = local_addr.get_netsequence_ulongip();
+				sockaddr_in addr_local;
+				addr_local.sin_family = AF_INET;
+				addr_local.sin_addr.s_addr = local_addr.get_netsequence_ulongip();
 
 #if WAWO_ISGNU
-			addr_local.sin_port = local_addr.get_netsequence_port();
+				addr_local.sin_port = local_addr.get_netsequence_port();
 #else
-			addr_local.sin_port = 0;
+				addr_local.sin_port = 0;
 #endif
-			wawo::net::address bind_addr(addr_local);
+				wawo::net::address bind_addr(addr_local);
 
-			int bindrt = accepted_so->bind(bind_addr);
-			if (bindrt != wawo::OK ) {
-				WAWO_ERR("[wcp]WCB::accept, call bind failed: %d", bindrt);
-				accepted_so->close(bindrt);
+				int bindrt = accepted_so->bind(bind_addr);
+				if (bindrt != wawo::OK ) {
+					WAWO_ERR("[wcp]WCB::accept, call bind failed: %d", bindrt);
+					accepted_so->close(bindrt);
 
-				reply_rst_to_address(so, pack->header.ack, from);
-				continue;
-			}
+					reply_rst_to_address(so, pack->header.ack, from);
+					continue;
+				}
 
-			int connrt = accepted_so->connect(from);
-			if (connrt != wawo::OK ) {
-				WAWO_ERR("[wcp]WCB::accept, call connect failed: %d", connrt);
-				accepted_so->close(connrt);
+				int connrt = accepted_so->connect(from);
+				if (connrt != wawo::OK ) {
+					WAWO_ERR("[wcp]WCB::accept, call connect failed: %d", connrt);
+					accepted_so->close(connrt);
 
-				reply_rst_to_address(so, pack->header.ack, from);
-				continue;
+					reply_rst_to_address(so, pack->header.ack, from);
+					continue;
+				}
+
+				int nonblocking = accepted_so->turnon_nonblocking();
+				if (nonblocking != wawo::OK) {
+					WAWO_ERR("[wcp]WCB::accept, turn on nonblocking failed: %d", nonblocking);
+					accepted_so->close(nonblocking);
+
+					reply_rst_to_address(so, pack->header.ack, from);
+					continue;
+				}
 			}
 
-			int nonblocking = accepted_so->turnon_nonblocking();
-			if (nonblocking != wawo::OK) {
-				WAWO_ERR("[wcp]WCB::accept, turn on nonblocking failed: %d", nonblocking);
-				accepted_so->close(nonblocking);
+			wawo::u32_t _four_tuple_hash_id = wcp::instance()->four_tuple_hash( local_addr, from );
 
+			int fd = wcp::instance()->make_wcb_fd();
+			if (fd < 0) {
+				WAWO_WARN("[wcp]WCB::accept, make fd failed: %d, remote addr: %s, reply rst", fd, from.address_info().cstr);
+				if (accepted_so != so) {
+					accepted_so->close(fd);
+				}
 				reply_rst_to_address(so, pack->header.ack, from);
 				continue;
 			}
 
-			wawo::u32_t _four_tuple_hash_id = four_tuple_hash( local_addr, from );
-
 			WWRP<WCB> wcb = wawo::make_ref<WCB>();
 			wcb->init();
 			wcb->wcb_flag |= WCB_FLAG_IS_PASSIVE_OPEN;
 			wcb->four_tuple_hash_id = _four_tuple_hash_id;
 			wcb->local_addr = accepted_so->get_local_addr();
 			wcb->remote_addr = from;
+			wcb->listen_addr = local_addr;
 			wcb->so = accepted_so;
-			wcb->fd = wcp::make_wcb_fd();
+			wcb->fd = fd;
 			wcb->set_rcv_buffer_size( get_rcv_buffer_size() );
+			wcb->rcv_wnd_max = rcv_wnd_max;
+			wcb->rcv_batch = rcv_batch;
+			wcb->snd_batch = snd_batch;
+			if (accepted_so == so) {
+				wcb->wcb_flag |= WCB_FLAG_SHARED_SO;
+				wcb->shared_so_owner = WWRP<WCB>(this);
+				shared_so_refs.fetch_add(1, std::memory_order_relaxed);
+				//set on the socket already
+				wcb->offload = offload;
+			} else if (offload != 0) {
+				wcb->set_offload(offload);
+			}
+			if (congestion != wcb->congestion) {
+				wcb->set_congestion(congestion);
+			}
+			wcb->pacing = pacing;
+			wcb->nodelay = nodelay;
+			wcb->pacing_rate_max = pacing_rate_max;
+			wcb->fec_k = fec_k;
+			wcb->fec_m = fec_m;
 			wcb->set_snd_buffer_size( get_snd_buffer_size() );
 
 			wcb->SYN_RCVD(pack);
 
 			if ( wcp::instance()->add_to_four_tuple_hash_map(wcb)<0 ) {
 				WAWO_WARN("[wcp]WCB::accept, add_to_four_tuple_hash_map failed, remote addr: %s, reply rst", from.address_info().cstr);
-				accepted_so->close();
+				wcp::instance()->free_wcb_fd(fd);
+				wcb->close_so(wawo::OK);
 				reply_rst_to_address(so, pack->header.ack, wcb->remote_addr );
 				continue;
 			}
 
-			wcp::instance()->watch(wcb);
-
 			lock_guard<spin_mutex> lg_r_mutex(r_mutex);
+			wcb->accept_listener = WWRP<WCB>(this);
+			int watchrt = wcp::instance()->watch(wcb);
+			if (watchrt != wawo::OK) {
+				wcb->accept_listener = NULL;
+				WAWO_WARN("[wcp]WCB::accept, watch failed: %d, remote addr: %s, reply rst", watchrt, from.address_info().cstr);
+				wcp::instance()->remove_from_four_tuple_hash_map(wcb);
+				wcp::instance()->free_wcb_fd(fd);
+				wcb->close_so(wawo::OK);
+				reply_rst_to_address(so, pack->header.ack, wcb->remote_addr);
+				continue;
+			}
 			backloglist_pending.push_back(wcb);
 		}
 
 		received_vec_standby->erase( received_vec_standby->begin() , received_vec_standby->begin() + i);
 	}
 
+	void WCB::pump_pack(byte_t const* const buffer, u32_t const& len, address const& from) {
+		WWRP<WCB_received_pack> inpack = wawo::make_ref<WCB_received_pack>();
+		if (!_received_pack_from_udpmessage(*inpack, buffer, len)) {
+			return;
+		}
+		inpack->from = from;
+		{
+			lock_guard<spin_mutex> lg_received_vec(received_vec_mutex);
+			received_vec_standby->push_back(inpack);
+		}
+		schedule_update();
+	}
+
 	void WCB::pump_packs() {
 
+		//the packs are released by the engine thread, take them from its slab
+		WWRP<wcp_engine> _engine = engine;
+		object_pool_slab_scope _slab_scope(_engine == NULL ? 0 : (_engine->id() + 1));
+
+		//a listener on a shared socket demuxes for the accepted ones, and drops the rest once it is closed
+		bool demux;
+		bool closed;
+		{
+			lock_guard<spin_mutex> lg(mutex);
+			demux = (wcb_flag&WCB_FLAG_SHARED_SO) && (wcb_flag&WCB_FLAG_IS_LISTENER);
+			closed = (wcb_flag&WCB_FLAG_CLOSED_CALLED) != 0;
+		}
+
 		lock_guard<spin_mutex> lg_received_vec(received_vec_mutex);
 
+		byte_t _buffer[WCP_BATCH_MAX*WCP_MTU];
+		udp_message msgs[WCP_BATCH_MAX];
+
+		u32_t batch = rcv_batch;
+		byte_t* buffer = _buffer;
+		u32_t buffer_size = WCP_MTU;
+		if (rcv_gro_buffer.size()) {
+			batch = WAWO_MIN(batch, WCP_GRO_BATCH);
+			buffer = &rcv_gro_buffer[0];
+			buffer_size = WCP_GRO_BUFFER_SIZE;
+		}
+
+		WAWO_ASSERT(batch > 0 && batch <= WCP_BATCH_MAX);
+		for (u32_t i = 0; i < batch; ++i) {
+			msgs[i].buff = buffer + i*buffer_size;
+		}
+
+		u32_t count = 0;
+		u32_t nmsgs;
 		int recvfrom_ec;
 		do {
-
 			WAWO_ASSERT(so != NULL);
-			byte_t _buffer[WCP_MTU];
+			for (u32_t i = 0; i < batch; ++i) {
+				msgs[i].len = buffer_size;
+			}
 
-			address from;
-			wawo::u32_t nbytes = so->recvfrom(_buffer, WCP_MTU, from, recvfrom_ec);
+			nmsgs = so->recvmmsg(msgs, batch, recvfrom_ec);
+			for (u32_t i = 0; i < nmsgs; ++i) {
+				//split the coalesced one back into wcp packs
+				u32_t const segment = msgs[i].segment == 0 ? msgs[i].len : msgs[i].segment;
+				for (u32_t offset = 0; offset < msgs[i].len; offset += segment) {
+					byte_t* const mbuffer = msgs[i].buff + offset;
+					u32_t const mlen = WAWO_MIN(segment, msgs[i].len - offset);
+					WWRP<WCB_received_pack> inpack = wawo::make_ref<WCB_received_pack>();
+					if (!_received_pack_from_udpmessage(*inpack, mbuffer, mlen)) {
+						continue;
+					}
+					inpack->from = msgs[i].addr;
+
+#ifdef WCP_TRACE_INOUT_PACK
+					WCP_TRACE("[wcp]WCB::pump_packs, recvfrom: %s, seq: %u, flag: %u, ack: %u, wnd: %u",
+						inpack->from.address_info().cstr, inpack->header.seq, inpack->header.flag, inpack->header.ack, inpack->header.wnd );
+#endif
+					if (demux && (shared_so_route(local_addr, inpack) || closed)) {
+						continue;
+					}
+					received_vec_standby->push_back( inpack );
+					++count;
+				}
+			}
 
 			if (recvfrom_ec != wawo::OK) {
 				if (recvfrom_ec != wawo::E_SOCKET_RECV_BLOCK) {
@@ -1035,31 +2739,44 @@ _begin_send:
 				}
 				break;
 			}
+			//a short batch means the socket is drained
+		} while (nmsgs == batch);
 
-			WAWO_ASSERT(nbytes >= WCP_HeaderLen);
-			WWSP<WCB_received_pack> inpack = wawo::make_shared<WCB_received_pack>();
-			WCP_RECEIVED_PACK_FROM_UDPMESSAGE(*inpack, _buffer, nbytes);
-			inpack->from = from;
-			received_vec_standby->push_back( inpack );
+		if (count>0) {
+			schedule_update();
+		}
+	}
 
-#ifdef WCP_TRACE_INOUT_PACK
-			WCP_TRACE("[wcp]WCB::pump_packs, recvfrom: %s, seq: %u, flag: %u, ack: %u, wnd: %u",
-				from.address_info().cstr, inpack->header.seq, inpack->header.flag, inpack->header.ack, inpack->header.wnd );
-#endif
-		} while (recvfrom_ec == wawo::OK);
+	//a socket shared by a listener and the accepted ones is closed by the last of them
+	void WCB::close_so(int const& ec) {
+		WAWO_ASSERT(so != NULL);
+		if (!(wcb_flag&WCB_FLAG_SHARED_SO)) {
+			so->close(ec);
+			return;
+		}
 
+		WWRP<WCB> owner = (wcb_flag&WCB_FLAG_IS_LISTENER) ? WWRP<WCB>(this) : shared_so_owner;
+		shared_so_owner = NULL;
+		WAWO_ASSERT(owner != NULL);
+		u32_t const refs = owner->shared_so_refs.fetch_sub(1, std::memory_order_acq_rel);
+		WAWO_ASSERT(refs > 0);
+		if (refs == 1) {
+			owner->so->close(ec);
+		}
 	}
 
-	int WCB::recv_pack(WWSP<WCB_received_pack>& pack, address& from) {
+	int WCB::recv_pack(WWRP<WCB_received_pack>& pack, address& from) {
 
 		int ec;
 		byte_t _buffer[WCP_MTU];
 		wawo::u32_t nbytes = so->recvfrom(_buffer, WCP_MTU, from, ec);
 		WAWO_RETURN_V_IF_NOT_MATCH(ec, ec == wawo::OK);
 
-		WAWO_ASSERT(nbytes >= WCP_HeaderLen);
-		WWSP<WCB_received_pack> inpack = wawo::make_shared<WCB_received_pack>();
-		WCP_RECEIVED_PACK_FROM_UDPMESSAGE(*inpack, _buffer, nbytes);
+		WWRP<WCB_received_pack> inpack = wawo::make_ref<WCB_received_pack>();
+		if (!_received_pack_from_udpmessage(*inpack, _buffer, nbytes)) {
+			wawo::set_last_errno(wawo::E_EINVAL);
+			return wawo::E_EINVAL;
+		}
 		inpack->from = from;
 		pack = inpack;
 
@@ -1079,7 +2796,8 @@ _begin_send:
 			SYN();
 		}
 		state = WCB_SYNING;
-		timer_state = wawo::time::curr_milliseconds();
+		timer_state = wcp_now();
+		schedule_update();
 
 		if ((wcb_option&WCP_O_NONBLOCK)) {
 			wawo::set_last_errno(WAWO_NEGATIVE(EINPROGRESS));
@@ -1126,6 +2844,7 @@ _begin_send:
 			return -1;
 		}
 
+		schedule_update();
 		return wawo::OK;
 	}
 
@@ -1158,6 +2877,7 @@ _begin_send:
 			r_flag |= READ_LOCAL_READ_SHUTDOWNED;
 
 			r_cond.notify_all();
+			schedule_update();
 			return wawo::OK;
 		}
 
@@ -1176,6 +2896,7 @@ _begin_send:
 				r_flag |= READ_LOCAL_READ_SHUTDOWNED;
 			}
 			r_cond.notify_all();
+			schedule_update();
 			return wawo::OK;
 		}
 
@@ -1193,60 +2914,87 @@ _begin_send:
 		state = WCB_LISTEN;
 		backlog_size = backlog;
 		wcb_flag |= WCB_FLAG_IS_LISTENER;
+#if !WAWO_ISGNU
+		//an accepted socket gets a port of its own here, but the peer learned the listener's from the cookie syn-ack
+		shared_so = 1;
+#endif
+		if (shared_so) {
+			wcb_flag |= WCB_FLAG_SHARED_SO;
+			shared_so_refs.store(1, std::memory_order_relaxed);
+		}
 
 		return wawo::OK;
 	}
 
-	wcp::wcp() :
-		m_state (S_IDLE)
+	wcp_engine::wcp_engine(u32_t const& id) :
+		m_id(id),
+		m_signaled(false),
+		m_timer_wheel(wcp_now())
 	{
-		//int startrt = start();
-		//WAWO_ASSERT(startrt == wawo::OK);
+		::memset(&m_counters, 0, sizeof(WCP_Counters));
+		m_snd_batch.count = 0;
+		for (u32_t i = 0; i < WCP_BATCH_MAX; ++i) {
+			m_snd_batch.msgs[i].buff = m_snd_batch.buffer + i*WCP_MTU;
+			m_snd_batch.msgs[i].len = 0;
+		}
 	}
 
-	wcp::~wcp() { WAWO_ASSERT(m_state == S_IDLE || m_state == S_EXIT); }
-
-	void wcp::on_start() {
-		lock_guard<shared_mutex> lg(m_mutex);
-		m_state = S_RUN;
+	wcp_engine::~wcp_engine() {}
 
-		m_self_ticker = wawo::make_shared<wawo::thread::fn_ticker>(std::bind(&wcp::run, this) );
-		observer_ticker::instance()->schedule(m_self_ticker);
+	void wcp_engine::on_start() {
+		WAWO_INFO("[wcp][engine#%u]start", m_id);
+		wawo::object_pool_slab() = m_id + 1;
 	}
 
-	void wcp::on_stop() {
+	void wcp_engine::on_stop() {
+		m_wcb_map.clear();
+		m_timer_wheel.clear();
 
-		if (m_self_ticker != NULL) {
-			observer_ticker::instance()->deschedule(m_self_ticker);
+		lock_guard<spin_mutex> lg_ops(m_ops_mutex);
+		while (!m_ops.empty()) {
+			m_ops.pop();
 		}
+		WAWO_INFO("[wcp][engine#%u]stop", m_id);
+	}
 
-		lock_guard<shared_mutex> lg(m_mutex);
-		m_state = S_EXIT;
-
-		m_self_ticker = NULL;
+	void wcp_engine::run() {
+		m_signaled.store(false, std::memory_order_release);
+		step(wcp_now());
 
-		{
-			lock_guard<shared_mutex> _(m_wcb_map_mutex);
-			WCBMap::iterator it = m_wcb_map.begin();
-			while (it != m_wcb_map.end()) {
-				it->second->close();
-				it->second->so->close(wawo::E_SOCKET_FORCE_CLOSE);
-				++it;
-			}
+		lock_guard<spin_mutex> lg(m_signal_mutex);
+		if (m_signaled.load(std::memory_order_acquire)) {
+			return;
+		}
 
-			m_wcb_map.clear();
-			m_wcb_four_tuple_map.clear();
+		u64_t const next = m_timer_wheel.next_tick();
+		if (next == ((u64_t)-1)) {
+			m_signal_cond.wait<spin_mutex>(m_signal_mutex);
+			return;
 		}
 
-		m_wpoll_map.clear();
+		u64_t const now = wcp_now();
+		if (next > now) {
+			m_signal_cond.wait_for<spin_mutex>(m_signal_mutex, std::chrono::milliseconds(next - now));
+		}
 	}
 
+	void wcp_engine::step(u64_t const& now) {
+		_execute_ops(now);
+
+		m_timer_wheel.advance(now, [this, &now](u64_t const& expire, WWRP<WCB> const& wcb) {
+			//stale entry, wcb rescheduled or recycled
+			if (wcb->engine_timer_expire != expire) {
+				return;
+			}
+			wcb->engine_timer_expire = 0;
+			_update_wcb(wcb, now);
+		});
+	}
 
-	void wcp::_execute_ops() {
+	void wcp_engine::_execute_ops(u64_t const& now) {
 
 		while (!m_ops.empty()) {
 
-			lock_guard<shared_mutex> lg(m_wcb_map_mutex);
 			Op op = { NULL,OP_NONE };
 			_pop_op(op);
 
@@ -1258,16 +3006,24 @@ _begin_send:
 			WAWO_ASSERT(op.wcb->so != NULL);
 			WAWO_ASSERT(op.wcb->so->is_nonblocking());
 
-#ifdef DEBUG
-			WCBMap::iterator it = m_wcb_map.find( op.wcb->fd );
-			WAWO_ASSERT( it == m_wcb_map.end() );
-#endif
 			switch (op.op) {
 			case OP_WATCH:
 			{
+#ifdef DEBUG
+				WCBMap::iterator it = m_wcb_map.find( op.wcb->fd );
+				WAWO_ASSERT( it == m_wcb_map.end() );
+#endif
 				m_wcb_map.insert(WCBPair(op.wcb->fd, op.wcb));
-				WAWO_ASSERT(op.wcb != NULL);
-				op.wcb->so->begin_async_read(WATCH_OPTION_INFINITE,op.wcb, wawo::net::wcb_pump_packs, wawo::net::wcb_socket_error);
+				//the listener pumps for the accepted ones on its socket
+				if (!((op.wcb->wcb_flag&WCB_FLAG_SHARED_SO) && (op.wcb->wcb_flag&WCB_FLAG_IS_PASSIVE_OPEN))) {
+					op.wcb->so->begin_async_read(WATCH_OPTION_INFINITE,op.wcb, wawo::net::wcb_pump_packs, wawo::net::wcb_socket_error);
+				}
+				_update_wcb(op.wcb, now);
+			}
+			break;
+			case OP_UPDATE:
+			{
+				_update_wcb(op.wcb, now);
 			}
 			break;
 			case OP_NONE:
@@ -1277,39 +3033,219 @@ _begin_send:
 		}
 	}
 
-	void wcp::_update() {
+	void wcp_engine::_update_wcb(WWRP<WCB> const& wcb, u64_t const& now) {
+		wcb->engine_update_pending.store(false, std::memory_order_release);
+
+		WCB_State s = wcb->update(now);
+		_fold_counters(wcb);
+		wcb->wpoll_notify();
+		if (s == WCB_RECYCLE) {
+			wcb->engine_timer_expire = 0;
+			WCBMap::iterator it = m_wcb_map.find(wcb->fd);
+			if (it == m_wcb_map.end() || it->second != wcb) {
+				//recycled already
+				return;
+			}
+			m_wcb_map.erase(it);
 
-		std::vector< WWRP<WCB> > wcb_to_delete;
-		{
-			shared_lock_guard<shared_mutex> lg_map(m_wcb_map_mutex);
-			WCBMap::iterator it = m_wcb_map.begin();
-			while (it != m_wcb_map.end()) {
-				u64_t now = wawo::time::curr_milliseconds();
-				WCB_State s = it->second->update(now);
-				if (s == WCB_RECYCLE) {
-					WWRP<wawo::net::socket> const& so = it->second->so;
-					WAWO_ASSERT( so != NULL );
+			wcb->close_so(wcb->wcb_errno);
+			wcp::instance()->unwatch(wcb);
+			return;
+		}
+
+		//entries in wheel are cancelled lazily, a later one would fire and get rescheduled
+		u64_t const expire = wcb->next_timer(now);
+		if (expire != 0 && (wcb->engine_timer_expire == 0 || expire < wcb->engine_timer_expire)) {
+			wcb->engine_timer_expire = expire;
+			m_timer_wheel.schedule(expire, wcb);
+		}
+	}
+
+	void wcp_engine::_fold_counters(WWRP<WCB> const& wcb) {
+		WCP_Counters const& c = wcb->counters;
+		WCP_Counters& f = wcb->counters_folded;
+
+		lock_guard<spin_mutex> lg(m_counters_mutex);
+		m_counters.packs_in += c.packs_in - f.packs_in;
+		m_counters.packs_out += c.packs_out - f.packs_out;
+		m_counters.bytes_in += c.bytes_in - f.bytes_in;
+		m_counters.bytes_out += c.bytes_out - f.bytes_out;
+		m_counters.retransmits_ack_skip += c.retransmits_ack_skip - f.retransmits_ack_skip;
+		m_counters.retransmits_fast_recovery += c.retransmits_fast_recovery - f.retransmits_fast_recovery;
+		m_counters.retransmits_rto += c.retransmits_rto - f.retransmits_rto;
+		m_counters.rto_fires += c.rto_fires - f.rto_fires;
+		m_counters.dup_packs += c.dup_packs - f.dup_packs;
+		m_counters.sacks_in += c.sacks_in - f.sacks_in;
+		m_counters.sacks_out += c.sacks_out - f.sacks_out;
+		m_counters.msgs_in += c.msgs_in - f.msgs_in;
+		m_counters.msgs_out += c.msgs_out - f.msgs_out;
+		m_counters.msgs_dropped += c.msgs_dropped - f.msgs_dropped;
+		m_counters.malformed_packs += c.malformed_packs - f.malformed_packs;
+		f = c;
+	}
+
+	void wcp_engine::counters(WCP_Counters& total) {
+		lock_guard<spin_mutex> lg(m_counters_mutex);
+		total.packs_in += m_counters.packs_in;
+		total.packs_out += m_counters.packs_out;
+		total.bytes_in += m_counters.bytes_in;
+		total.bytes_out += m_counters.bytes_out;
+		total.retransmits_ack_skip += m_counters.retransmits_ack_skip;
+		total.retransmits_fast_recovery += m_counters.retransmits_fast_recovery;
+		total.retransmits_rto += m_counters.retransmits_rto;
+		total.rto_fires += m_counters.rto_fires;
+		total.dup_packs += m_counters.dup_packs;
+		total.sacks_in += m_counters.sacks_in;
+		total.sacks_out += m_counters.sacks_out;
+		total.msgs_in += m_counters.msgs_in;
+		total.msgs_out += m_counters.msgs_out;
+		total.msgs_dropped += m_counters.msgs_dropped;
+		total.malformed_packs += m_counters.malformed_packs;
+	}
+
+	wcp::wcp() :
+		m_state (S_IDLE),
+		m_engine_count(WAWO_DEFAULT_WCP_ENGINE_COUNT),
+		m_fd_max(WAWO_DEFAULT_WCP_FD_MAX),
+		m_rcv_wnd_max(WAWO_DEFAULT_WCP_RCV_WND_MAX)
+	{
+		//int startrt = start();
+		//WAWO_ASSERT(startrt == wawo::OK);
+	}
+
+	wcp::~wcp() { WAWO_ASSERT(m_state == S_IDLE || m_state == S_EXIT); }
+
+	u32_t wcp::_syn_cookie(wawo::net::address const& local, wawo::net::address const& remote, u64_t const& slot) const {
+		u64_t const m[3] = { local.identity(), remote.identity(), slot };
+		u64_t const mac = _siphash24(m_syn_cookie_key, m, 3);
+		return (static_cast<u32_t>(slot & 0x3) << 30) | static_cast<u32_t>(mac & 0x3FFFFFFF);
+	}
+
+	//top 2 bits for the time slot, 30 bits of mac over the four tuple and the slot
+	u32_t wcp::make_syn_cookie(wawo::net::address const& local, wawo::net::address const& remote) const {
+		return _syn_cookie(local, remote, wcp_now() / WCP_SYN_COOKIE_SLOT);
+	}
+
+	bool wcp::check_syn_cookie(wawo::net::address const& local, wawo::net::address const& remote, u32_t const& cookie) const {
+		u64_t const slot = wcp_now() / WCP_SYN_COOKIE_SLOT;
+		if ((slot & 0x3) == (cookie >> 30)) {
+			return _syn_cookie(local, remote, slot) == cookie;
+		}
+		if (((slot - 1) & 0x3) == (cookie >> 30)) {
+			return _syn_cookie(local, remote, slot - 1) == cookie;
+		}
+		return false;
+	}
 
-					so->close( it->second->wcb_errno );
-					wcb_to_delete.push_back(it->second);
+	int wcp::on_start() {
+		lock_guard<shared_mutex> lg(m_mutex);
+		WAWO_ASSERT(m_state == S_IDLE);
+		WAWO_ASSERT(m_engines.size() == 0);
+
+		std::random_device rd;
+		m_syn_cookie_key[0] = (static_cast<u64_t>(rd()) << 32) | rd();
+		m_syn_cookie_key[1] = (static_cast<u64_t>(rd()) << 32) | rd();
+
+		m_wcb_table.init(m_fd_max);
+		m_four_tuple_table.init();
+
+		for (u32_t i = 0; i < m_engine_count; ++i) {
+			WWRP<wcp_engine> engine = wawo::make_ref<wcp_engine>(i);
+			int startrt = engine->start();
+			if (startrt != wawo::OK) {
+				WAWO_ERR("[wcp]start engine#%u failed: %d", i, startrt);
+				for (u32_t j = 0; j < m_engines.size(); ++j) {
+					m_engines[j]->stop();
 				}
-				++it;
+				m_engines.clear();
+				return startrt;
 			}
+			m_engines.push_back(engine);
 		}
 
-		if (wcb_to_delete.size()) {
-			lock_guard<shared_mutex> lg_map(m_wcb_map_mutex);
-			for (u32_t i = 0; i < wcb_to_delete.size(); i++) {
+		m_state = S_RUN;
+		return wawo::OK;
+	}
+
+	void wcp::on_stop() {
 
-				if (wcb_to_delete[i]->wcb_flag&WCB_FLAG_IS_PASSIVE_OPEN) {
-					remove_from_four_tuple_hash_map(wcb_to_delete[i]);
-				}
-				m_wcb_map.erase(wcb_to_delete[i]->fd);
+		wcp_engine_vector engines;
+		{
+			lock_guard<shared_mutex> lg(m_mutex);
+			m_state = S_EXIT;
+			engines.swap(m_engines);
+		}
+
+		for (u32_t i = 0; i < engines.size(); ++i) {
+			engines[i]->stop();
+		}
+		engines.clear();
+
+		{
+			std::vector< WWRP<WCB> > wcbs;
+			m_wcb_table.bound(wcbs);
+			for (u32_t i = 0; i < wcbs.size(); ++i) {
+				wcbs[i]->close();
+				wcbs[i]->so->close(wawo::E_SOCKET_FORCE_CLOSE);
 			}
+			m_wcb_table.clear();
+		}
+
+		m_four_tuple_table.deinit();
+
+		lock_guard<shared_mutex> lg(m_mutex);
+		WpollMap::iterator it = m_wpoll_map.begin();
+		while (it != m_wpoll_map.end()) {
+			it->second->close();
+			++it;
+		}
+		m_wpoll_map.clear();
+	}
+
+	void wcp::counters(WCP_Counters& total) {
+		::memset(&total, 0, sizeof(WCP_Counters));
+		shared_lock_guard<shared_mutex> lg(m_mutex);
+		for (u32_t i = 0; i < m_engines.size(); ++i) {
+			m_engines[i]->counters(total);
 		}
 	}
 
-	std::atomic<int> wcp::s_wcb_auto_increament_id(1);
+	WWRP<wcp_engine> wcp::_engine_of(u32_t const& four_tuple_hash_id) {
+		shared_lock_guard<shared_mutex> slg(m_mutex);
+		if (m_state != S_RUN) {
+			return NULL;
+		}
+		WAWO_ASSERT(m_engines.size() > 0);
+		return m_engines[four_tuple_hash_id%m_engines.size()];
+	}
+
+	int wcp::watch(WWRP<WCB> const& wcb) {
+		WAWO_ASSERT(wcb != NULL);
+		WWRP<wcp_engine> engine = _engine_of(wcb->four_tuple_hash_id);
+		if (engine == NULL) {
+			wawo::set_last_errno(wawo::E_INVALID_STATE);
+			return wawo::E_INVALID_STATE;
+		}
+
+		int bindrt = m_wcb_table.bind(wcb->fd, wcb);
+		if (bindrt != wawo::OK) {
+			wawo::set_last_errno(bindrt);
+			return bindrt;
+		}
+
+		wcb->engine = engine;
+		engine->watch(wcb);
+		return wawo::OK;
+	}
+
+	void wcp::unwatch(WWRP<WCB> const& wcb) {
+		WAWO_ASSERT(wcb != NULL);
+		if (wcb->wcb_flag&WCB_FLAG_IS_PASSIVE_OPEN) {
+			remove_from_four_tuple_hash_map(wcb);
+		}
+
+		m_wcb_table.free(wcb->fd);
+	}
 
 	int wcp::socket(int const& family, int const& socket_type, int const& protocol) {
 
@@ -1320,18 +3256,22 @@ _begin_send:
 		WWRP<wawo::net::socket> udpsocket = wawo::make_ref<wawo::net::socket>(F_AF_INET, ST_DGRAM, P_UDP);
 		int openrt = udpsocket->open();
 		WAWO_RETURN_V_IF_NOT_MATCH( WAWO_NEGATIVE(socket_get_last_errno()) , openrt == wawo::OK);
+		wcp_netem::instance()->attach(udpsocket);
+
+		int fd = make_wcb_fd();
+		if (fd < 0) {
+			udpsocket->close(fd);
+			return fd;
+		}
 
 		WWRP<WCB> wcb = wawo::make_ref<WCB>();
 		wcb->init();
 		wcb->so = udpsocket;
-		wcb->fd = wcp::make_wcb_fd();
+		wcb->fd = fd;
+		wcb->rcv_wnd_max = m_rcv_wnd_max;
 
 		lock_guard<spin_mutex> slg(m_wcb_create_pending_map_mutex);
-		const WCBMap::iterator& it = m_wcb_create_pending_map.find(wcb->fd);
-		if (it != m_wcb_create_pending_map.end()) {
-			wawo::set_last_errno(wawo::E_WCP_INTERNAL_ERROR);
-			return wawo::E_WCP_INTERNAL_ERROR;
-		}
+		WAWO_ASSERT(m_wcb_create_pending_map.find(wcb->fd) == m_wcb_create_pending_map.end());
 		m_wcb_create_pending_map.insert( WCBPair(wcb->fd, wcb) );
 		return wcb->fd;
 	}
@@ -1351,14 +3291,15 @@ _begin_send:
 
 		int nonblocking = wcb->so->turnon_nonblocking();
 		WAWO_RETURN_V_IF_NOT_MATCH( nonblocking, nonblocking == wawo::OK );
+
+		wawo::net::address const remote(*((sockaddr_in*)addr));
+		wcb->four_tuple_hash_id = four_tuple_hash(wcb->local_addr, remote);
+
+		int watchrt = watch(wcb);
+		WAWO_RETURN_V_IF_NOT_MATCH(watchrt, watchrt == wawo::OK);
 		m_wcb_create_pending_map.erase(it);
-		{
-			lock_guard<shared_mutex> lg_wcb_map_mutex(m_wcb_map_mutex);
-			m_wcb_map.insert(WCBPair(fd, wcb));
-		}
 
-		wcb->so->begin_async_read(WATCH_OPTION_INFINITE, wcb, wawo::net::wcb_pump_packs, wawo::net::wcb_socket_error);
-		return wcb->connect(wawo::net::address(*((sockaddr_in*)addr)));
+		return wcb->connect(remote);
 	}
 
 	int wcp::bind(int const& fd, const struct sockaddr* addr, socklen_t const& len ) {
@@ -1409,25 +3350,23 @@ _begin_send:
 		int listenrt = wcb->listen(backlog);
 		WAWO_RETURN_V_IF_NOT_MATCH( listenrt, listenrt==wawo::OK );
 
-		m_wcb_create_pending_map.erase(it);
+		wcb->four_tuple_hash_id = four_tuple_hash(wcb->local_addr, wawo::net::address());
 
-		lock_guard<shared_mutex> lg_wcb_map_mutex(m_wcb_map_mutex);
-		m_wcb_map.insert(WCBPair(fd, wcb));
-		wcb->so->begin_async_read(WATCH_OPTION_INFINITE,wcb, wawo::net::wcb_pump_packs, wawo::net::wcb_socket_error);
+		int watchrt = watch(wcb);
+		WAWO_RETURN_V_IF_NOT_MATCH(watchrt, watchrt == wawo::OK);
+		m_wcb_create_pending_map.erase(it);
 
 		return wawo::OK;
 	}
 
 	int wcp::accept(int const& fd, struct sockaddr* addr, socklen_t* addrlen ) {
 
-		shared_lock_guard<shared_mutex> slg(m_wcb_map_mutex);
-		const WCBMap::iterator& it = m_wcb_map.find(fd);
-		if (it == m_wcb_map.end()) {
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
+		if (wcb == NULL) {
 			wawo::set_last_errno(wawo::E_EBADF);
 			return wawo::E_EBADF;
 		}
 
-		WWRP<WCB>& wcb = it->second;
 		WAWO_ASSERT(wcb != NULL);
 		WAWO_ASSERT(wcb->so != NULL);
 
@@ -1463,14 +3402,12 @@ _begin_send:
 	}
 
 	int wcp::shutdown(int const& fd, int const& flag) {
-		shared_lock_guard<shared_mutex> slg(m_wcb_map_mutex);
-		const WCBMap::iterator& it = m_wcb_map.find(fd);
-		if (it == m_wcb_map.end()) {
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
+		if (wcb == NULL) {
 			wawo::set_last_errno(wawo::E_EBADF);
 			return wawo::E_EBADF;
 		}
 
-		WWRP<WCB>& wcb = it->second;
 		WAWO_ASSERT(wcb != NULL);
 		WAWO_ASSERT(wcb->so != NULL);
 
@@ -1484,14 +3421,8 @@ _begin_send:
 
 	int wcp::close(int const& fd) {
 
-		WWRP<WCB> wcb;
-		{
-			shared_lock_guard<shared_mutex> slg(m_wcb_map_mutex);
-			const WCBMap::iterator& it = m_wcb_map.find(fd);
-			if (it != m_wcb_map.end()) {
-				wcb = it->second;
-			}
-		}
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
+		bool pending = false;
 
 		if (wcb == NULL) {
 			lock_guard<spin_mutex> lg_create_pending(m_wcb_create_pending_map_mutex);
@@ -1499,6 +3430,8 @@ _begin_send:
 			if (it != m_wcb_create_pending_map.end()) {
 				wcb = it->second;
 				m_wcb_create_pending_map.erase(it);
+				free_wcb_fd(fd);
+				pending = true;
 			}
 		}
 
@@ -1509,126 +3442,73 @@ _begin_send:
 
 		WAWO_ASSERT(wcb != NULL);
 		WAWO_ASSERT(wcb->so != NULL);
-		return wcb->close();
+		int closert = wcb->close();
+
+		//no engine would ever recycle a pending one
+		if (pending) {
+			wcb->so->close();
+		}
+		return closert;
 	}
 
 	int wcp::send(int const& fd, byte_t const* const buffer, u32_t const& len, int const& flag) {
-		(void)flag;
-
-		WWRP<WCB> wcb;
-		{
-			shared_lock_guard<shared_mutex> slg(m_wcb_map_mutex);
-			const WCBMap::iterator& it = m_wcb_map.find(fd);
-			if (it == m_wcb_map.end()) {
-				wawo::set_last_errno(wawo::E_EBADF);
-				return wawo::E_EBADF;
-			}
-			wcb = it->second;
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
+		if (wcb == NULL) {
+			wawo::set_last_errno(wawo::E_EBADF);
+			return wawo::E_EBADF;
 		}
 
 		WAWO_ASSERT(wcb != NULL);
 		WAWO_ASSERT(wcb->so != NULL);
-
-		lock_guard<spin_mutex> lg_wcb_s_mutex(wcb->s_mutex);
-		if (wcb->s_flag& (WRITE_SEND_ERROR | WRITE_LOCAL_WRITE_SHUTDOWNED)) {
-			if (wcb->wcb_errno != 0) {
-				wawo::set_last_errno( wcb->wcb_errno );
-				return wcb->wcb_errno;
-			}
-			wawo::set_last_errno(wawo::E_ECONNABORTED);
-			return wawo::E_ECONNABORTED;
-		}
-
-		u32_t left_capacity = wcb->sb->left_capacity();
-		if ( (left_capacity<len) && left_capacity<(2*WCP_MDU) ) {
-			wawo::set_last_errno(EWOULDBLOCK);
-			return WAWO_NEGATIVE(EWOULDBLOCK);
-		}
-
-		return wcb->sb->write(buffer, len);
+		return wcb->send(buffer, len, flag);
 	}
 
 	int wcp::recv(int const&fd, byte_t* const buffer_o, u32_t const& size, int const& flag ) {
-		(void)flag;
-
-		WWRP<WCB> wcb;
-		{
-			shared_lock_guard<shared_mutex> slg(m_wcb_map_mutex);
-			const WCBMap::iterator& it = m_wcb_map.find(fd);
-			if (it == m_wcb_map.end()) {
-				wawo::set_last_errno(wawo::E_EBADF);
-				return wawo::E_EBADF;
-			}
-			wcb = it->second;
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
+		if (wcb == NULL) {
+			wawo::set_last_errno(wawo::E_EBADF);
+			return wawo::E_EBADF;
 		}
 
 		WAWO_ASSERT(wcb != NULL);
 		WAWO_ASSERT(wcb->so != NULL);
+		return wcb->recv(buffer_o, size, flag);
+	}
 
-		lock_guard<spin_mutex> lg_rb_recv(wcb->r_mutex);
-	read_begin:
-		if (wcb->r_flag&READ_LOCAL_READ_SHUTDOWNED) {
-			wawo::set_last_errno(wawo::E_ECONNABORTED);
-			return wawo::E_ECONNABORTED;
-		}
-
-		if (wcb->rb->count()>0) {
-			u32_t nbytes = wcb->rb->read( buffer_o, size );
-
-			WAWO_ASSERT( nbytes>0 );
-			//WAWO_INFO("[wcp][%d:%s] read bytes: %u", wcb->fd, wcb->remote_addr.address_info().cstr, nbytes);
-			return nbytes;
-		}
-
-		WAWO_ASSERT( wcb->rb->count() == 0 );
-
-		if ( wcb->r_flag&READ_REMOTE_FIN_RECEIVED ) {
-			if (wcb->r_flag&READ_REMOTE_FIN_READ_BY_USER) {
-				wawo::set_last_errno(wawo::E_ECONNRESET);
-				return wawo::E_ECONNRESET;
-			}
-			wcb->r_flag |= READ_REMOTE_FIN_READ_BY_USER;
-			wawo::set_last_errno(wawo::OK);
-			return wawo::OK;
-		}
-
-		if (wcb->r_flag&READ_RECV_ERROR) {
-			WAWO_ASSERT(wcb->wcb_errno != 0);
-			wawo::set_last_errno(wcb->wcb_errno);
-			return WAWO_NEGATIVE(wcb->wcb_errno);
+	int wcp::send_stream(int const& fd, u16_t const& sid, byte_t const* const buffer, u32_t const& len) {
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
+		if (wcb == NULL) {
+			wawo::set_last_errno(wawo::E_EBADF);
+			return wawo::E_EBADF;
 		}
+		return wcb->send_stream(sid, buffer, len);
+	}
 
-		//@NOTICE, 2018.01.10
-		WAWO_ASSERT(wcb->wcb_errno == 0);
-
-		//if (wcb->wcb_errno != 0) {
-		//	wawo::set_last_errno(wcb->wcb_errno);
-		//	return WAWO_NEGATIVE(wcb->wcb_errno);
-		//}
-
-		if (wcb->wcb_option&WCP_O_NONBLOCK) {
-			wawo::set_last_errno(EWOULDBLOCK);
-			return WAWO_NEGATIVE(EWOULDBLOCK);
+	int wcp::recv_stream(int const& fd, u16_t const& sid, byte_t* const buffer_o, u32_t const& size) {
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
+		if (wcb == NULL) {
+			wawo::set_last_errno(wawo::E_EBADF);
+			return wawo::E_EBADF;
 		}
+		return wcb->recv_stream(sid, buffer_o, size);
+	}
 
-		WAWO_ASSERT( !(wcb->wcb_option&WCP_O_NONBLOCK));
-
-		wcb->r_cond.wait<spin_mutex>(wcb->r_mutex);
-		goto read_begin;
+	int wcp::stream_ready(int const& fd, u16_t* const sids, u32_t const& count) {
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
+		if (wcb == NULL) {
+			wawo::set_last_errno(wawo::E_EBADF);
+			return wawo::E_EBADF;
+		}
+		return wcb->stream_ready(sids, count);
 	}
 
 	int wcp::getsockname(int const& fd, struct sockaddr* addr, socklen_t* addrlen ) {
 		(void)addrlen;
 
-		WWRP<WCB> wcb;
-		{
-			shared_lock_guard<shared_mutex> slg(m_wcb_map_mutex);
-			const WCBMap::iterator& it = m_wcb_map.find(fd);
-			if (it == m_wcb_map.end()) {
-				wawo::set_last_errno(wawo::E_EBADF);
-				return wawo::E_EBADF;
-			}
-			wcb = it->second;
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
+		if (wcb == NULL) {
+			wawo::set_last_errno(wawo::E_EBADF);
+			return wawo::E_EBADF;
 		}
 
 		WAWO_ASSERT(wcb != NULL);
@@ -1648,14 +3528,7 @@ _begin_send:
 
 	int wcp::getsockopt(int const& fd, int const& level, int const& option_name, void* value, socklen_t* option_len ) {
 
-		WWRP<WCB> wcb;
-		{
-			shared_lock_guard<shared_mutex> slg(m_wcb_map_mutex);
-			const WCBMap::iterator& it = m_wcb_map.find(fd);
-			if (it != m_wcb_map.end()) {
-				wcb = it->second;
-			}
-		}
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
 
 		if (wcb == NULL) {
 			lock_guard<spin_mutex> lg_create_pending(m_wcb_create_pending_map_mutex);
@@ -1673,6 +3546,90 @@ _begin_send:
 		WAWO_ASSERT(wcb != NULL);
 		WAWO_ASSERT(wcb->so != NULL);
 
+		if (level == WCP_SOL) {
+			int& _v = (*(int*)value);
+			switch (option_name) {
+			case WCP_SO_RCV_BATCH:
+			{
+				_v = wcb->rcv_batch;
+			}
+			break;
+			case WCP_SO_SND_BATCH:
+			{
+				_v = wcb->snd_batch;
+			}
+			break;
+			case WCP_SO_OFFLOAD:
+			{
+				_v = wcb->offload;
+			}
+			break;
+			case WCP_SO_CONGESTION:
+			{
+				_v = wcb->congestion;
+			}
+			break;
+			case WCP_SO_PACING:
+			{
+				_v = wcb->pacing;
+			}
+			break;
+			case WCP_SO_PACING_RATE_MAX:
+			{
+				_v = static_cast<int>(wcb->pacing_rate_max);
+			}
+			break;
+			case WCP_SO_FEC:
+			{
+				_v = WCP_FEC_KM(wcb->fec_k, wcb->fec_m);
+			}
+			break;
+			case WCP_SO_SHARED_SO:
+			{
+				_v = wcb->shared_so;
+			}
+			break;
+			case WCP_SO_RCV_WND_MAX:
+			{
+				_v = static_cast<int>(wcb->rcv_wnd_max);
+			}
+			break;
+			case WCP_SO_NODELAY:
+			{
+				_v = wcb->nodelay;
+			}
+			break;
+			case WCP_SO_INFO:
+			{
+				if (option_len == NULL || *option_len < sizeof(WCP_Info)) {
+					wawo::set_last_errno(wawo::E_EINVAL);
+					return wawo::E_EINVAL;
+				}
+				lock_guard<spin_mutex> lg(wcb->mutex);
+				*((WCP_Info*)value) = wcb->info;
+				*option_len = sizeof(WCP_Info);
+			}
+			break;
+			case WCP_SO_MEMINFO:
+			{
+				if (option_len == NULL || *option_len < sizeof(WCP_MemInfo)) {
+					wawo::set_last_errno(wawo::E_EINVAL);
+					return wawo::E_EINVAL;
+				}
+				lock_guard<spin_mutex> lg(wcb->mutex);
+				*((WCP_MemInfo*)value) = wcb->mem_info;
+				*option_len = sizeof(WCP_MemInfo);
+			}
+			break;
+			default:
+			{
+				wawo::set_last_errno(wawo::E_EINVAL);
+				return wawo::E_EINVAL;
+			}
+			}
+			return wawo::OK;
+		}
+
 		if (option_name == SO_REUSEADDR
 #if WAWO_ISGNU
 			|| option_name == SO_REUSEPORT
@@ -1707,14 +3664,7 @@ _begin_send:
 
 	int wcp::setsockopt(int const& fd, int const& level, int const& option_name, void const* value, socklen_t const& option_len ) {
 
-		WWRP<WCB> wcb;
-		{
-			shared_lock_guard<shared_mutex> slg(m_wcb_map_mutex);
-			const WCBMap::iterator& it = m_wcb_map.find(fd);
-			if (it != m_wcb_map.end()) {
-				wcb = it->second;
-			}
-		}
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
 
 		if (wcb == NULL) {
 			lock_guard<spin_mutex> lg_create_pending(m_wcb_create_pending_map_mutex);
@@ -1732,6 +3682,127 @@ _begin_send:
 		WAWO_ASSERT(wcb != NULL);
 		WAWO_ASSERT(wcb->so != NULL);
 
+		if (level == WCP_SOL) {
+			int const& _v = *(int const*)(value);
+			switch (option_name) {
+			case WCP_SO_RCV_BATCH:
+			case WCP_SO_SND_BATCH:
+			{
+				if (_v <= 0 || _v > WCP_BATCH_MAX) {
+					wawo::set_last_errno(wawo::E_EINVAL);
+					return wawo::E_EINVAL;
+				}
+				lock_guard<spin_mutex> lg(wcb->mutex);
+				if (option_name == WCP_SO_RCV_BATCH) {
+					wcb->rcv_batch = _v & 0xFFFF;
+				} else {
+					wcb->snd_batch = _v & 0xFFFF;
+				}
+			}
+			break;
+			case WCP_SO_OFFLOAD:
+			{
+				if (_v & ~(WCP_OFFLOAD_GSO|WCP_OFFLOAD_GRO)) {
+					wawo::set_last_errno(wawo::E_EINVAL);
+					return wawo::E_EINVAL;
+				}
+				lock_guard<spin_mutex> lg(wcb->mutex);
+				u8_t const offload = wcb->set_offload(_v&0xFF);
+				if (_v != 0 && offload == 0) {
+					wawo::set_last_errno(wawo::E_EOPNOTSUPP);
+					return wawo::E_EOPNOTSUPP;
+				}
+			}
+			break;
+			case WCP_SO_CONGESTION:
+			{
+				if (_v < 0 || _v >= WCP_CC_MAX) {
+					wawo::set_last_errno(wawo::E_EINVAL);
+					return wawo::E_EINVAL;
+				}
+				lock_guard<spin_mutex> lg(wcb->mutex);
+				int const rt = wcb->set_congestion(_v&0xFF);
+				if (rt != wawo::OK) {
+					wawo::set_last_errno(rt);
+					return rt;
+				}
+			}
+			break;
+			case WCP_SO_PACING:
+			case WCP_SO_PACING_RATE_MAX:
+			{
+				if (_v < 0 || (option_name == WCP_SO_PACING && _v > 1)) {
+					wawo::set_last_errno(wawo::E_EINVAL);
+					return wawo::E_EINVAL;
+				}
+				lock_guard<spin_mutex> lg(wcb->mutex);
+				if (option_name == WCP_SO_PACING) {
+					wcb->pacing = _v & 0xFF;
+				} else {
+					wcb->pacing_rate_max = static_cast<u32_t>(_v);
+				}
+			}
+			break;
+			case WCP_SO_FEC:
+			{
+				int const k = (_v >> 8) & 0xFF;
+				int const m = _v & 0xFF;
+				if ((_v & ~0xFFFF) || (_v != 0 && (k == 0 || k > WCP_FEC_K_MAX || m == 0 || m > WCP_FEC_M_MAX))) {
+					wawo::set_last_errno(wawo::E_EINVAL);
+					return wawo::E_EINVAL;
+				}
+				lock_guard<spin_mutex> lg(wcb->mutex);
+				wcb->fec_k = k & 0xFF;
+				wcb->fec_m = m & 0xFF;
+			}
+			break;
+			case WCP_SO_SHARED_SO:
+			{
+				if (_v < 0 || _v > 1) {
+					wawo::set_last_errno(wawo::E_EINVAL);
+					return wawo::E_EINVAL;
+				}
+				lock_guard<spin_mutex> lg(wcb->mutex);
+				if (wcb->state != WCB_CLOSED || (wcb->wcb_flag&(WCB_FLAG_IS_LISTENER|WCB_FLAG_IS_PASSIVE_OPEN|WCB_FLAG_IS_ACTIVE_OPEN))) {
+					wawo::set_last_errno(wawo::E_INVALID_STATE);
+					return wawo::E_INVALID_STATE;
+				}
+				wcb->shared_so = _v & 0xFF;
+			}
+			break;
+			case WCP_SO_RCV_WND_MAX:
+			{
+				if (_v < 0 || static_cast<u32_t>(_v) > m_rcv_wnd_max) {
+					wawo::set_last_errno(wawo::E_EINVAL);
+					return wawo::E_EINVAL;
+				}
+				lock_guard<spin_mutex> lg(wcb->mutex);
+				wcb->rcv_wnd_max = static_cast<u32_t>(_v);
+			}
+			break;
+			case WCP_SO_NODELAY:
+			{
+				if (_v < 0 || _v > 1) {
+					wawo::set_last_errno(wawo::E_EINVAL);
+					return wawo::E_EINVAL;
+				}
+				{
+					lock_guard<spin_mutex> lg(wcb->mutex);
+					wcb->nodelay = _v & 0xFF;
+				}
+				//push out the held tail
+				wcb->schedule_update();
+			}
+			break;
+			default:
+			{
+				wawo::set_last_errno(wawo::E_EINVAL);
+				return wawo::E_EINVAL;
+			}
+			}
+			return wawo::OK;
+		}
+
 		if (option_name == SO_REUSEADDR) {
 			return wcb->so->reuse_addr();
 		}
@@ -1742,7 +3813,12 @@ _begin_send:
 #endif
 
 		if(option_name == SO_RCVBUF) {
-			return wcb->set_rcv_buffer_size( *(int*)(value) );
+			int setrt = wcb->set_rcv_buffer_size( *(int*)(value) );
+			if (setrt == wawo::OK) {
+				//the user knows better
+				wcb->rcv_wnd_max = 0;
+			}
+			return setrt;
 		}
 
 		if(option_name == SO_SNDBUF)
@@ -1762,14 +3838,7 @@ _begin_send:
 	}
 
 	int wcp::fcntl_getfl(int const& fd, int& flag) {
-		WWRP<WCB> wcb;
-		{
-			shared_lock_guard<shared_mutex> slg(m_wcb_map_mutex);
-			const WCBMap::iterator& it = m_wcb_map.find(fd);
-			if (it != m_wcb_map.end()) {
-				wcb = it->second;
-			}
-		}
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
 
 		if (wcb == NULL) {
 			lock_guard<spin_mutex> lg_create_pending(m_wcb_create_pending_map_mutex);
@@ -1793,14 +3862,7 @@ _begin_send:
 	}
 
 	int wcp::fcntl_setfl(int const& fd, int const& flag) {
-		WWRP<WCB> wcb;
-		{
-			shared_lock_guard<shared_mutex> slg(m_wcb_map_mutex);
-			const WCBMap::iterator& it = m_wcb_map.find(fd);
-			if (it != m_wcb_map.end()) {
-				wcb = it->second;
-			}
-		}
+		WWRP<WCB> wcb = m_wcb_table.get(fd);
 
 		if (wcb == NULL) {
 			lock_guard<spin_mutex> lg_create_pending(m_wcb_create_pending_map_mutex);
@@ -1825,6 +3887,80 @@ _begin_send:
 
 
 
+	wpoll::wpoll() :
+		efd(-1),
+		closed(false)
+	{
+#if WAWO_ISGNU
+		efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (efd == -1) {
+			WAWO_WARN("[wcp]wpoll eventfd failed: %d", wawo::socket_get_last_errno());
+		}
+#endif
+	}
+
+	wpoll::~wpoll() {
+		if (efd != -1) {
+			::close(efd);
+			efd = -1;
+		}
+	}
+
+	void wpoll::efd_signal() {
+#if WAWO_ISGNU
+		if (efd != -1) {
+			u64_t one = 1;
+			ssize_t wrt = ::write(efd, &one, sizeof(one));
+			(void)wrt;
+		}
+#endif
+	}
+
+	void wpoll::efd_reset() {
+#if WAWO_ISGNU
+		if (efd != -1) {
+			u64_t v;
+			ssize_t rrt = ::read(efd, &v, sizeof(v));
+			(void)rrt;
+		}
+#endif
+	}
+
+	void wpoll::push(WWSP<wpoll_watch_event> const& evt) {
+		lock_guard<spin_mutex> lg(mutex);
+		if (closed || evt->queued) {
+			return;
+		}
+		evt->queued = true;
+		if (ready.empty()) {
+			efd_signal();
+		}
+		ready.push_back(evt);
+		cond.notify_one();
+	}
+
+	void wpoll::close() {
+		lock_guard<spin_mutex> lg(mutex);
+		closed = true;
+		wpoll_watch_event_map::iterator it = evts.begin();
+		while (it != evts.end()) {
+			WCB& wcb = *(it->second->wcb);
+			lock_guard<spin_mutex> lg_wcb(wcb.wpoll_mutex);
+			if (wcb.wpoll_evt == it->second) {
+				wcb.wpoll_evt = NULL;
+			}
+			++it;
+		}
+		evts.clear();
+		ready.clear();
+
+		if (efd != -1) {
+			::close(efd);
+			efd = -1;
+		}
+		cond.notify_all();
+	}
+
 	int wcp::wpoll_create() {
 		int id = wawo::atomic_increment(&s_wpoll_auto_increament_id);
 
@@ -1835,26 +3971,32 @@ _begin_send:
 		}
 
 		WWSP<wpoll> _wpoll = wawo::make_shared<wpoll>();
-		_wpoll->evts.reserve(100);
 		m_wpoll_map.insert( WpollPair(id, _wpoll) );
 
 		return id;
 	}
 
 	int wcp::wpoll_close(int const& wpoll_handle) {
-		lock_guard<shared_mutex> lg(m_mutex);
+		WWSP<wpoll> _wpoll;
+		{
+			lock_guard<shared_mutex> lg(m_mutex);
 
-		if (m_state != S_RUN) {
-			wawo::set_last_errno(wawo::E_INVALID_STATE);
-			return wawo::E_INVALID_STATE;
-		}
+			if (m_state != S_RUN) {
+				wawo::set_last_errno(wawo::E_INVALID_STATE);
+				return wawo::E_INVALID_STATE;
+			}
 
-		WpollMap::iterator it = m_wpoll_map.find(wpoll_handle);
-		if (it == m_wpoll_map.end()) {
-			wawo::set_last_errno( wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS);
-			return wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS;
+			WpollMap::iterator it = m_wpoll_map.find(wpoll_handle);
+			if (it == m_wpoll_map.end()) {
+				wawo::set_last_errno( wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS);
+				return wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS;
+			}
+			_wpoll = it->second;
+			m_wpoll_map.erase(it);
 		}
-		m_wpoll_map.erase(it);
+
+		//wake up the waiters, and break the wcb <-> watch event refs
+		_wpoll->close();
 		return wawo::OK;
 	}
 
@@ -1863,70 +4005,90 @@ _begin_send:
 		WAWO_ASSERT(evt.fd > 0);
 		WAWO_ASSERT(wpoll_handle>0);
 
-		shared_lock_guard<shared_mutex> lg(m_mutex);
-		if (m_state != S_RUN) {
-			wawo::set_last_errno(wawo::E_INVALID_STATE);
-			return wawo::E_INVALID_STATE;
-		}
+		WWSP<wpoll> _wpoll;
+		{
+			shared_lock_guard<shared_mutex> lg(m_mutex);
+			if (m_state != S_RUN) {
+				wawo::set_last_errno(wawo::E_INVALID_STATE);
+				return wawo::E_INVALID_STATE;
+			}
 
-		WpollMap::iterator it = m_wpoll_map.find(wpoll_handle);
-		if (it == m_wpoll_map.end()) {
-			wawo::set_last_errno( wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS);
-			return wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS;
+			WpollMap::iterator it = m_wpoll_map.find(wpoll_handle);
+			if (it == m_wpoll_map.end()) {
+				wawo::set_last_errno( wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS);
+				return wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS;
+			}
+			_wpoll = it->second;
 		}
 
-		shared_lock_guard<shared_mutex> lg_wcb_map(m_wcb_map_mutex);
-		WCBMap::iterator wcb_it = m_wcb_map.find(evt.fd);
-		if (wcb_it == m_wcb_map.end()) {
+		WWRP<WCB> wcb = m_wcb_table.get(evt.fd);
+		if (wcb == NULL) {
 			wawo::set_last_errno(wawo::E_EBADF);
 			return wawo::E_EBADF;
 		}
 
-		WWSP<wpoll>& wpoll = it->second;
-
 		switch (op) {
 
 		case WPOLL_CTL_ADD:
 			{
 				WAWO_ASSERT(evt.cookie != NULL);
 
-				lock_guard<shared_mutex> lg_evts( wpoll->mutex );
-				wpoll_watch_event_vector::iterator evt_it = std::find_if(wpoll->evts.begin(), wpoll->evts.end(), [&](WWSP<wpoll_watch_event> const& _evt) {
-					return evt.fd == _evt->fd;
-				});
+				WWSP<wpoll_watch_event> _evt;
+				{
+					lock_guard<spin_mutex> lg_wpoll(_wpoll->mutex);
+					wpoll_watch_event_map::iterator evt_it = _wpoll->evts.find(evt.fd);
 
-				if (evt_it != wpoll->evts.end()) {
-					WAWO_ASSERT((*evt_it)->cookie == evt.cookie);
-					(*evt_it)->evts |= evt.evts;
-					return wawo::OK;
-				}
+					if (evt_it != _wpoll->evts.end()) {
+						WAWO_ASSERT(evt_it->second->cookie == evt.cookie);
+						evt_it->second->evts |= evt.evts;
+						_evt = evt_it->second;
+					}
+					else {
+						lock_guard<spin_mutex> lg_wcb_wpoll(wcb->wpoll_mutex);
+						if (wcb->wpoll_evt != NULL) {
+							wawo::set_last_errno(wawo::E_EEXIST);
+							return wawo::E_EEXIST;
+						}
+
+						_evt = wawo::make_shared<wpoll_watch_event>();
+						_evt->fd = evt.fd;
+						_evt->evts = evt.evts;
+						_evt->cookie = evt.cookie;
+						_evt->wcb = wcb;
+						_evt->wp = _wpoll;
+						_evt->queued = false;
 
-				WWSP<wpoll_watch_event> _evt = wawo::make_shared<wpoll_watch_event>();
-				_evt->fd = evt.fd;
-				_evt->evts = evt.evts;
-				_evt->cookie = evt.cookie;
-				_evt->wcb = wcb_it->second;
+						_wpoll->evts.insert(std::make_pair(evt.fd, _evt));
+						wcb->wpoll_evt = _evt;
+					}
+				}
 
-				wpoll->evts.push_back(_evt);
+				//report the current level once, as epoll does for a new or modified fd
+				_wpoll->push(_evt);
 				return wawo::OK;
 			}
 			break;
 		case WPOLL_CTL_DEL:
 			{
-				lock_guard<shared_mutex> lg_evts(wpoll->mutex);
-				wpoll_watch_event_vector::iterator evt_it = std::find_if(wpoll->evts.begin(), wpoll->evts.end(), [&](WWSP<wpoll_watch_event> const& _evt) {
-					return evt.fd == _evt->fd;
-				});
+				lock_guard<spin_mutex> lg_wpoll(_wpoll->mutex);
+				wpoll_watch_event_map::iterator evt_it = _wpoll->evts.find(evt.fd);
 
-				if (evt_it == wpoll->evts.end()) {
+				if (evt_it == _wpoll->evts.end()) {
 					wawo::set_last_errno(wawo::E_EBADF);
 					return wawo::E_EBADF;
 				}
 
-				(*evt_it)->evts &= ~evt.evts;
+				WWSP<wpoll_watch_event> _evt = evt_it->second;
+				_evt->evts &= ~evt.evts;
+
+				if (_evt->evts == 0) {
+					//a queued one is skipped by wpoll_wait
+					_wpoll->evts.erase(evt_it);
 
-				if ( (*evt_it)->evts == 0) {
-					wpoll->evts.erase(evt_it);
+					lock_guard<spin_mutex> lg_wcb_wpoll(_evt->wcb->wpoll_mutex);
+					if (_evt->wcb->wpoll_evt == _evt) {
+						_evt->wcb->wpoll_evt = NULL;
+					}
 				}
 				return wawo::OK;
 			}
@@ -1937,104 +4099,141 @@ _begin_send:
 		return wawo::E_WCP_WPOLL_INVALID_OP;
 	}
 
-	int wcp::wpoll_wait(int const& wpoll_handle, wpoll_event evts[], u32_t const& size) {
-
-		shared_lock_guard<shared_mutex> lg(m_mutex);
-		if (m_state != S_RUN) {
-			wawo::set_last_errno(wawo::E_INVALID_STATE);
-			return wawo::E_INVALID_STATE;
-		}
+	int wcp::wpoll_wait(int const& wpoll_handle, wpoll_event evts[], u32_t const& size, int const& timeout) {
 
-		WpollMap::iterator it = m_wpoll_map.find(wpoll_handle);
-		if (it == m_wpoll_map.end()) {
-			wawo::set_last_errno(wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS);
-			return wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS;
-		}
+		WWSP<wpoll> _wpoll;
+		{
+			shared_lock_guard<shared_mutex> lg(m_mutex);
+			if (m_state != S_RUN) {
+				wawo::set_last_errno(wawo::E_INVALID_STATE);
+				return wawo::E_INVALID_STATE;
+			}
 
-		u32_t count = 0;
-		while (m_event_pending_queue.size() && (count<size) ) {
-			wpoll_event_pending const& pending = m_event_pending_queue.front();
-			if (pending.watch_evt->evts != 0) {
-				evts[count++] = pending.wpoll_evt;
+			WpollMap::iterator it = m_wpoll_map.find(wpoll_handle);
+			if (it == m_wpoll_map.end()) {
+				wawo::set_last_errno(wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS);
+				return wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS;
 			}
-			m_event_pending_queue.pop();
+			_wpoll = it->second;
 		}
 
-		if (count > 0) {
-			return count;
-		}
+		u64_t const wait_begin = (timeout > 0) ? wawo::time::curr_milliseconds() : 0;
+		u32_t count = 0;
+		bool closed = false;
+		std::vector< WWSP<wpoll_watch_event> > popped;
 
-		WAWO_ASSERT( m_event_pending_queue.size() == 0 );
+		while (true) {
+			//pop with the mutex held, the wcb locks are taken after it is released
+			{
+				lock_guard<spin_mutex> lg_wpoll(_wpoll->mutex);
+				while (true) {
+					while ((count + popped.size() < size) && _wpoll->ready.size()) {
+						WWSP<wpoll_watch_event> _evt = _wpoll->ready.front();
+						_wpoll->ready.pop_front();
+						_evt->queued.store(false, std::memory_order_release);
+
+						//unwatched after being pushed
+						if (_evt->evts.load() == 0) {
+							continue;
+						}
+						popped.push_back(_evt);
+					}
 
-		WWSP<wpoll>& _wpoll = it->second;
-		shared_lock_guard<shared_mutex> lg_wpoll(_wpoll->mutex);
-		wpoll_watch_event_vector::iterator evt_it = _wpoll->evts.begin();
+					if (popped.size() || count > 0 || timeout == 0 || _wpoll->closed) {
+						break;
+					}
 
-		while( evt_it != _wpoll->evts.end() ) {
+					if (timeout < 0) {
+						_wpoll->cond.wait<spin_mutex>(_wpoll->mutex);
+						continue;
+					}
 
-			wpoll_watch_event& __evt = *(*evt_it);
+					u64_t const elapsed = wawo::time::curr_milliseconds() - wait_begin;
+					if (elapsed >= static_cast<u64_t>(timeout)) {
+						break;
+					}
+					_wpoll->cond.wait_for<spin_mutex>(_wpoll->mutex, std::chrono::milliseconds(static_cast<u64_t>(timeout) - elapsed));
+				}
 
-			if (__evt.wcb->state == WCB_RECYCLE) {
-				evt_it = _wpoll->evts.erase(evt_it);
-				continue;
+				if (_wpoll->ready.empty()) {
+					_wpoll->efd_reset();
+				}
+				closed = _wpoll->closed;
 			}
 
-			wpoll_event _evt = { __evt.fd, 0, __evt.cookie };
+			if (popped.empty()) {
+				break;
+			}
 
-			if (__evt.evts & WPOLLIN) {
-				lock_guard<spin_mutex> _lg_backlog(__evt.wcb->r_mutex);
-				if (__evt.wcb->wcb_flag&WCB_FLAG_IS_LISTENER) {
-					if (__evt.wcb->backlogq.size()) {
-						_evt.evts |= WPOLLIN;
+			//the engine pushes an entry again once it changes after being popped, a level missed here is not lost
+			for (u32_t i = 0; i < popped.size(); ++i) {
+				WWSP<wpoll_watch_event> const& _evt = popped[i];
+				WWRP<WCB> const& wcb = _evt->wcb;
+				if (wcb->state == WCB_RECYCLE) {
+					{
+						lock_guard<spin_mutex> lg_wpoll(_wpoll->mutex);
+						wpoll_watch_event_map::iterator evt_it = _wpoll->evts.find(_evt->fd);
+						if (evt_it != _wpoll->evts.end() && evt_it->second == _evt) {
+							_wpoll->evts.erase(evt_it);
+						}
 					}
-				} else {
-					if (__evt.wcb->rb->count() || ( (__evt.wcb->r_flag&READ_REMOTE_FIN_RECEIVED) && !(__evt.wcb->r_flag&READ_REMOTE_FIN_READ_BY_USER)) ) {
-						_evt.evts |= WPOLLIN;
+
+					lock_guard<spin_mutex> lg_wcb_wpoll(wcb->wpoll_mutex);
+					if (wcb->wpoll_evt == _evt) {
+						wcb->wpoll_evt = NULL;
 					}
+					continue;
 				}
 
-				if (__evt.wcb->r_flag& (READ_RECV_ERROR| READ_LOCAL_READ_SHUTDOWNED)) {
-					WAWO_ASSERT(__evt.wcb->wcb_errno != wawo::OK);
-					_evt.evts |= WPOLLERR;
+				u32_t const watching = _evt->evts.load();
+				u32_t const ready = (watching == 0) ? 0 : wcb->wpoll_check(watching);
+				if (ready == 0) {
+					continue;
 				}
-			}
-
-			if (__evt.evts&WPOLLOUT) {
-				WAWO_ASSERT( !(__evt.wcb->wcb_flag&WCB_FLAG_IS_LISTENER) );
-				lock_guard<spin_mutex> lg_s_mutex(__evt.wcb->s_mutex);
-				if (__evt.wcb->s_flag&(WRITE_LOCAL_WRITE_SHUTDOWNED | WRITE_SEND_ERROR)) {
-					WAWO_ASSERT(__evt.wcb->wcb_errno != wawo::OK);
-					_evt.evts |= WPOLLERR;
 
-					__evt.evts &= ~WPOLLOUT;//unwatch out
-				}
-				else {
-					if ( (__evt.wcb->state == WCB_ESTABLISHED) && __evt.wcb->sb->left_capacity()>(WCP_MDU*2) ) {
-						_evt.evts |= WPOLLOUT;
+				if ((ready&WPOLLERR) && (watching&WPOLLOUT)) {
+					lock_guard<spin_mutex> lg_s_mutex(wcb->s_mutex);
+					if (wcb->s_flag&(WRITE_LOCAL_WRITE_SHUTDOWNED | WRITE_SEND_ERROR)) {
+						_evt->evts &= ~WPOLLOUT;//unwatch out
 					}
 				}
-			}
 
-			if (__evt.wcb->wcb_errno != 0) {
-				_evt.evts |= WPOLLERR;
+				wpoll_event const wevt = { _evt->fd, ready, _evt->cookie };
+				evts[count++] = wevt;
 			}
+			popped.clear();
 
-			if (_evt.evts != 0) {
-
-				if (count < size) {
-					evts[count++] = _evt;
-				}
-				else {
-					WAWO_ASSERT(count == size);
-					wpoll_event_pending pending_evt = { _evt, *evt_it };
-					m_event_pending_queue.push(pending_evt);
-				}
+			if (count == size) {
+				break;
 			}
-			++evt_it;
 		}
 
+		if (count == 0 && closed) {
+			wawo::set_last_errno(wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS);
+			return wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS;
+		}
 		return count;
 	}
 
+	int wcp::wpoll_fd(int const& wpoll_handle) {
+		shared_lock_guard<shared_mutex> lg(m_mutex);
+		if (m_state != S_RUN) {
+			wawo::set_last_errno(wawo::E_INVALID_STATE);
+			return wawo::E_INVALID_STATE;
+		}
+
+		WpollMap::iterator it = m_wpoll_map.find(wpoll_handle);
+		if (it == m_wpoll_map.end()) {
+			wawo::set_last_errno(wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS);
+			return wawo::E_WCP_WPOLL_HANDLE_NOT_EXISTS;
+		}
+
+		if (it->second->efd == -1) {
+			wawo::set_last_errno(wawo::E_EOPNOTSUPP);
+			return wawo::E_EOPNOTSUPP;
+		}
+		return it->second->efd;
+	}
+
 	std::atomic<int> wcp::s_wpoll_auto_increament_id(1);
 }}
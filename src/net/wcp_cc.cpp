@@ -0,0 +1,326 @@
+#include <wawo/net/wcp_cc.hpp>
+#include <wawo/net/wcp.hpp>
+
+namespace wawo { namespace net {
+
+	WWRP<wcp_cc_abstract> wcp_cc_make(u8_t const& type) {
+		switch (type) {
+		case WCP_CC_RENO:
+		{
+			return wawo::make_ref<wcp_cc_reno>();
+		}
+		break;
+		case WCP_CC_BBR:
+		{
+			return wawo::make_ref<wcp_cc_bbr>();
+		}
+		break;
+		default:
+		{
+			return NULL;
+		}
+		}
+	}
+
+	wcp_cc_reno::wcp_cc_reno() :
+		m_flag(SLOW_START),
+		m_timer_congest_avoidance(0),
+		m_lost_detected_timer(0),
+		m_lost_biggest_seq(0),
+		m_lost_cwnd_for_fast_recovery_compensation(0),
+		m_lost_bigger_than_lost_seq_time(0),
+		m_nflight_bytes_max(0)
+	{
+	}
+
+	void wcp_cc_reno::init(WCB& wcb) {
+		m_flag = SLOW_START;
+		m_timer_congest_avoidance = 0;
+		m_lost_detected_timer = 0;
+		m_lost_biggest_seq = wcb.snd_info.una;
+		m_lost_cwnd_for_fast_recovery_compensation = 0;
+		m_lost_bigger_than_lost_seq_time = 0;
+		m_nflight_bytes_max = 0;
+	}
+
+	void wcp_cc_reno::on_sent(WCB& wcb, WWRP<WCB_pack> const& pack, u64_t const& now) {
+		(void)pack;
+		(void)now;
+		if (wcb.snd_nflight_bytes > m_nflight_bytes_max) {
+			m_nflight_bytes_max = wcb.snd_nflight_bytes;
+		}
+	}
+
+	void wcp_cc_reno::on_acked(WCB& wcb, wcp_cc_ack const& ack, u64_t const& now) {
+		WCB_SndInfo& snd_info = wcb.snd_info;
+
+		if (m_flag&SLOW_START) {
+			snd_info.cwnd += ack.bytes;
+
+			if (snd_info.cwnd >= snd_info.ssthresh) {
+				m_flag |= CONGEST_AVOIDANCE;
+				m_flag &= ~SLOW_START;
+			}
+		}
+		else if (m_flag&CONGEST_AVOIDANCE) {
+			if ((now - m_timer_congest_avoidance) >= static_cast<u32_t>(wcb.srtt)) {
+				snd_info.cwnd += WCP_MTU;
+				m_timer_congest_avoidance = now;
+			}
+		}
+		else {}
+
+		snd_info.cwnd = WAWO_MIN(snd_info.cwnd, WCP_SND_CWND_MAX);
+	}
+
+	bool wcp_cc_reno::on_sacked(WCB& wcb, u32_t const& ack, u64_t const& now) {
+		(void)now;
+		if (!(m_flag&LOST_DETECTED) || !seq_before(m_lost_biggest_seq, ack)) {
+			return false;
+		}
+
+		++m_lost_bigger_than_lost_seq_time;
+		WCB_SndInfo& snd_info = wcb.snd_info;
+
+		if ((m_lost_bigger_than_lost_seq_time >= 1) && seq_before(m_lost_biggest_seq, snd_info.una)) {
+
+			snd_info.cwnd += m_lost_cwnd_for_fast_recovery_compensation;
+			snd_info.cwnd = WAWO_MIN(snd_info.cwnd, WCP_SND_CWND_MAX);
+
+			WCP_TRACE("[wcp][FR]try to set ssthresh from: %u to: %u (choose larger one), compensation: %u", snd_info.ssthresh, snd_info.cwnd, m_lost_cwnd_for_fast_recovery_compensation);
+
+			u32_t _new_ssthresh = WAWO_MIN(snd_info.cwnd, WCP_SND_SSTHRESH_MAX);
+			snd_info.ssthresh = WAWO_MAX(_new_ssthresh, snd_info.ssthresh);
+
+			m_lost_cwnd_for_fast_recovery_compensation = 0;
+			m_flag &= ~LOST_DETECTED;
+			return true;
+		}
+		return false;
+	}
+
+	void wcp_cc_reno::on_timeout(WCB& wcb, WWRP<WCB_pack> const& pack, u64_t const& now) {
+		(void)wcb;
+		(void)now;
+		if (!(m_flag&LOST_DETECTED) && seq_before(m_lost_biggest_seq, pack->header.seq)) {
+			m_lost_biggest_seq = pack->header.seq;
+		}
+	}
+
+	void wcp_cc_reno::on_lost(WCB& wcb, u64_t const& now) {
+		if ((now - m_lost_detected_timer) < WAWO_MAX(wcb.srtt, 30)) {
+			return;
+		}
+
+		WCB_SndInfo& snd_info = wcb.snd_info;
+		u32_t const& snd_nflight_bytes = wcb.snd_nflight_bytes;
+
+		m_lost_detected_timer = now;
+		m_lost_bigger_than_lost_seq_time = 0;
+
+		u32_t last_flight_max = m_nflight_bytes_max;
+		(void)last_flight_max;
+
+		u32_t half_flight_max = m_nflight_bytes_max >> 1;
+		u32_t new_ssthresh = WAWO_MAX(half_flight_max, WCP_SND_SSTHRESH_MIN);
+		WAWO_ASSERT(m_nflight_bytes_max >= snd_nflight_bytes);
+
+		m_lost_cwnd_for_fast_recovery_compensation = (new_ssthresh - (snd_nflight_bytes >> 1));
+		snd_info.ssthresh = WAWO_MIN(new_ssthresh, snd_info.ssthresh);
+
+		m_nflight_bytes_max = WAWO_MAX(m_nflight_bytes_max >> 1, snd_nflight_bytes);
+		m_flag |= (SLOW_START|LOST_DETECTED);
+		m_flag &= ~CONGEST_AVOIDANCE;
+
+		snd_info.cwnd = WCP_CWND_Cfg::WCP_LW*WCP_MTU;
+		WCP_TRACE("[wcp]lost detected in establish state,ssthresh: %u,una: %u, rwnd: %u,last_flight_max: %u,curr_flight_max: %u,nflight: %u,compensation: %u",
+			snd_info.ssthresh, snd_info.una, snd_info.rwnd, last_flight_max, m_nflight_bytes_max, snd_nflight_bytes, m_lost_cwnd_for_fast_recovery_compensation);
+	}
+
+	//2/ln2, the smallest gain that doubles the delivery rate each round in startup
+	static const u32_t WCP_BBR_HIGH_GAIN = (WCP_BBR_GAIN_UNIT*2885)/1000;
+	static const u32_t WCP_BBR_DRAIN_GAIN = (WCP_BBR_GAIN_UNIT*1000)/2885;
+	static const u32_t WCP_BBR_CWND_GAIN = WCP_BBR_GAIN_UNIT*2;
+	static const u32_t WCP_BBR_PACING_GAIN_CYCLE[WCP_BBR_CYCLE_LEN] = {
+		WCP_BBR_GAIN_UNIT*5/4, WCP_BBR_GAIN_UNIT*3/4,
+		WCP_BBR_GAIN_UNIT, WCP_BBR_GAIN_UNIT, WCP_BBR_GAIN_UNIT, WCP_BBR_GAIN_UNIT, WCP_BBR_GAIN_UNIT, WCP_BBR_GAIN_UNIT
+	};
+
+	wcp_cc_bbr::wcp_cc_bbr()
+	{
+	}
+
+	void wcp_cc_bbr::init(WCB& wcb) {
+		(void)wcb;
+		m_mode = STARTUP;
+
+		m_round = 0;
+		m_next_round_delivered = 0;
+		::memset(m_bw_rounds, 0, sizeof(m_bw_rounds));
+		m_btlbw = 0;
+
+		m_min_rtt_us = ~u64_t(0);
+		m_min_rtt_ts = 0;
+
+		m_full_bw = 0;
+		m_full_bw_count = 0;
+		m_filled_pipe = false;
+
+		m_cycle_idx = 0;
+		m_cycle_ts = 0;
+		m_probe_rtt_done_ts = 0;
+		m_prior_cwnd = 0;
+
+		m_pacing_gain = WCP_BBR_HIGH_GAIN;
+		m_cwnd_gain = WCP_BBR_HIGH_GAIN;
+		m_pacing_rate = 0;
+	}
+
+	u32_t wcp_cc_bbr::_bdp(u32_t const& gain) const {
+		u64_t const bdp = (m_btlbw*WAWO_MAX(m_min_rtt_us, u64_t(WCP_BBR_MIN_RTT_FLOOR_US))) / 1000000;
+		return static_cast<u32_t>(WAWO_MIN((bdp*gain) / WCP_BBR_GAIN_UNIT, u64_t(WCP_SND_CWND_MAX)));
+	}
+
+	void wcp_cc_bbr::_update_bw(wcp_cc_ack const& ack, bool& round_start) {
+		round_start = false;
+		if (ack.prior_delivered >= m_next_round_delivered) {
+			m_next_round_delivered = ack.delivered;
+			++m_round;
+			m_bw_rounds[m_round%WCP_BBR_BW_WINDOW_ROUNDS] = 0;
+			round_start = true;
+		}
+
+		u64_t& bw_round = m_bw_rounds[m_round%WCP_BBR_BW_WINDOW_ROUNDS];
+		if (ack.delivery_rate > bw_round) {
+			bw_round = ack.delivery_rate;
+		}
+
+		m_btlbw = 0;
+		for (u32_t i = 0; i < WCP_BBR_BW_WINDOW_ROUNDS; ++i) {
+			m_btlbw = WAWO_MAX(m_btlbw, m_bw_rounds[i]);
+		}
+	}
+
+	void wcp_cc_bbr::_update_mode(WCB& wcb, bool const& round_start, bool const& min_rtt_expired, u64_t const& now) {
+		u32_t const min_cwnd = WCP_BBR_MIN_CWND_PACKS*WCP_MTU;
+
+		//the pipe is full once the bandwidth stops growing by 25% for several rounds
+		if (!m_filled_pipe && round_start && m_btlbw > 0) {
+			if (m_btlbw >= (m_full_bw*5)/4) {
+				m_full_bw = m_btlbw;
+				m_full_bw_count = 0;
+			} else if (++m_full_bw_count >= WCP_BBR_FULL_BW_ROUNDS) {
+				m_filled_pipe = true;
+			}
+		}
+
+		if (m_mode == STARTUP && m_filled_pipe) {
+			m_mode = DRAIN;
+		}
+
+		if (m_mode == DRAIN && wcb.snd_nflight_bytes <= _bdp(WCP_BBR_GAIN_UNIT)) {
+			m_mode = PROBE_BW;
+			//do not start with the draining phase
+			m_cycle_idx = static_cast<u8_t>(m_round%(WCP_BBR_CYCLE_LEN - 1));
+			if (m_cycle_idx >= 1) {
+				++m_cycle_idx;
+			}
+			m_cycle_ts = now;
+		}
+
+		if (m_mode == PROBE_BW && (now - m_cycle_ts)*1000 > WAWO_MAX(m_min_rtt_us, u64_t(WCP_BBR_MIN_RTT_FLOOR_US))) {
+			m_cycle_idx = (m_cycle_idx + 1) % WCP_BBR_CYCLE_LEN;
+			m_cycle_ts = now;
+		}
+
+		if (min_rtt_expired && m_mode != PROBE_RTT) {
+			m_mode = PROBE_RTT;
+			m_prior_cwnd = wcb.snd_info.cwnd;
+			m_probe_rtt_done_ts = 0;
+		}
+
+		if (m_mode == PROBE_RTT) {
+			if (m_probe_rtt_done_ts == 0 && wcb.snd_nflight_bytes <= min_cwnd) {
+				m_probe_rtt_done_ts = now + WCP_BBR_PROBE_RTT_TIME;
+			} else if (m_probe_rtt_done_ts != 0 && now >= m_probe_rtt_done_ts) {
+				m_min_rtt_ts = now;
+				wcb.snd_info.cwnd = WAWO_MAX(wcb.snd_info.cwnd, m_prior_cwnd);
+				if (m_filled_pipe) {
+					m_mode = PROBE_BW;
+					m_cycle_idx = 0;
+					m_cycle_ts = now;
+				} else {
+					m_mode = STARTUP;
+				}
+			}
+		}
+
+		switch (m_mode) {
+		case STARTUP:
+		{
+			m_pacing_gain = WCP_BBR_HIGH_GAIN;
+			m_cwnd_gain = WCP_BBR_HIGH_GAIN;
+		}
+		break;
+		case DRAIN:
+		{
+			m_pacing_gain = WCP_BBR_DRAIN_GAIN;
+			m_cwnd_gain = WCP_BBR_HIGH_GAIN;
+		}
+		break;
+		case PROBE_BW:
+		{
+			m_pacing_gain = WCP_BBR_PACING_GAIN_CYCLE[m_cycle_idx];
+			m_cwnd_gain = WCP_BBR_CWND_GAIN;
+		}
+		break;
+		case PROBE_RTT:
+		{
+			m_pacing_gain = WCP_BBR_GAIN_UNIT;
+			m_cwnd_gain = WCP_BBR_GAIN_UNIT;
+		}
+		break;
+		}
+	}
+
+	void wcp_cc_bbr::on_acked(WCB& wcb, wcp_cc_ack const& ack, u64_t const& now) {
+		bool const min_rtt_expired = (m_min_rtt_ts != 0) && ((now - m_min_rtt_ts) > WCP_BBR_MIN_RTT_WINDOW);
+		if (ack.rtt_us >= 0 && (static_cast<u64_t>(ack.rtt_us) <= m_min_rtt_us || min_rtt_expired)) {
+			m_min_rtt_us = ack.rtt_us;
+			m_min_rtt_ts = now;
+		}
+
+		bool round_start;
+		_update_bw(ack, round_start);
+		_update_mode(wcb, round_start, min_rtt_expired, now);
+
+		u32_t& cwnd = wcb.snd_info.cwnd;
+		u32_t const min_cwnd = WCP_BBR_MIN_CWND_PACKS*WCP_MTU;
+
+		if (m_btlbw == 0 || m_min_rtt_us == ~u64_t(0)) {
+			//no model yet
+			cwnd += ack.bytes;
+		} else {
+			u32_t const target = _bdp(m_cwnd_gain);
+			if (m_filled_pipe) {
+				cwnd = WAWO_MIN(cwnd + ack.bytes, target);
+			} else if (cwnd < target || ack.delivered < WCP_CWND_Cfg::WCP_IW*WCP_MTU) {
+				cwnd += ack.bytes;
+			}
+		}
+
+		cwnd = WAWO_MAX(cwnd, min_cwnd);
+		if (m_mode == PROBE_RTT) {
+			cwnd = WAWO_MIN(cwnd, min_cwnd);
+		}
+		cwnd = WAWO_MIN(cwnd, WCP_SND_CWND_MAX);
+
+		if (m_btlbw > 0) {
+			m_pacing_rate = (m_btlbw*m_pacing_gain) / WCP_BBR_GAIN_UNIT;
+		} else if (wcb.srtt > 0) {
+			m_pacing_rate = ((u64_t(cwnd) * 1000 / wcb.srtt)*m_pacing_gain) / WCP_BBR_GAIN_UNIT;
+		} else {
+			m_pacing_rate = 0;
+		}
+	}
+}}
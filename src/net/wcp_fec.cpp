@@ -0,0 +1,188 @@
+#include <vector>
+#include <wawo/net/wcp_fec.hpp>
+
+namespace wawo { namespace net {
+
+	struct gf256 {
+		byte_t exp[512];
+		u8_t log[256];
+
+		gf256() {
+			u32_t x = 1;
+			for (u32_t i = 0; i < 255; ++i) {
+				exp[i] = static_cast<byte_t>(x);
+				log[x] = static_cast<u8_t>(i);
+				x <<= 1;
+				if (x & 0x100) {
+					x ^= 0x11d;
+				}
+			}
+			for (u32_t i = 255; i < 512; ++i) {
+				exp[i] = exp[i - 255];
+			}
+			log[0] = 0;
+		}
+
+		inline byte_t mul(byte_t const& a, byte_t const& b) const {
+			if (a == 0 || b == 0) {
+				return 0;
+			}
+			return exp[log[a] + log[b]];
+		}
+
+		inline byte_t inv(byte_t const& a) const {
+			WAWO_ASSERT(a != 0);
+			return exp[255 - log[a]];
+		}
+
+		//dst ^= c*src
+		inline void mul_add(byte_t* dst, byte_t const* src, byte_t const& c, u32_t const& len) const {
+			if (c == 0) {
+				return;
+			}
+			if (c == 1) {
+				u32_t i = 0;
+				for (; (i + sizeof(u64_t)) <= len; i += sizeof(u64_t)) {
+					u64_t d;
+					u64_t s;
+					::memcpy(&d, dst + i, sizeof(u64_t));
+					::memcpy(&s, src + i, sizeof(u64_t));
+					d ^= s;
+					::memcpy(dst + i, &d, sizeof(u64_t));
+				}
+				for (; i < len; ++i) {
+					dst[i] ^= src[i];
+				}
+				return;
+			}
+
+			byte_t t[256];
+			u32_t const lc = log[c];
+			t[0] = 0;
+			for (u32_t x = 1; x < 256; ++x) {
+				t[x] = exp[log[x] + lc];
+			}
+			for (u32_t i = 0; i < len; ++i) {
+				dst[i] ^= t[src[i]];
+			}
+		}
+	};
+
+	static gf256 const& _gf() {
+		static gf256 gf;
+		return gf;
+	}
+
+	//cauchy 1/(x_i+y_j) with x_i = i, y_j = M_MAX+j, column j scaled by y_j to make row 0 all 1
+	static inline byte_t _coef(gf256 const& gf, u8_t const& i, u8_t const& j) {
+		byte_t const y = static_cast<byte_t>(WCP_FEC_M_MAX + j);
+		return gf.mul(y, gf.inv(static_cast<byte_t>(i^y)));
+	}
+
+	void wcp_fec::encode(byte_t const* const data[], u8_t const& k, u32_t const& len, u8_t const& idx, byte_t* parity) {
+		WAWO_ASSERT(k > 0 && k <= WCP_FEC_K_MAX);
+		WAWO_ASSERT(idx < WCP_FEC_M_MAX);
+
+		gf256 const& gf = _gf();
+		::memset(parity, 0, len);
+		for (u8_t j = 0; j < k; ++j) {
+			gf.mul_add(parity, data[j], _coef(gf, idx, j), len);
+		}
+	}
+
+	bool wcp_fec::decode(byte_t const* const data[], u8_t const& k, byte_t const* const parity[], u8_t const& m, u32_t const& len, byte_t* const rebuilt[]) {
+		WAWO_ASSERT(k > 0 && k <= WCP_FEC_K_MAX);
+		WAWO_ASSERT(m > 0 && m <= WCP_FEC_M_MAX);
+
+		u8_t lost[WCP_FEC_M_MAX];
+		u8_t rows[WCP_FEC_M_MAX];
+		u8_t nlost = 0;
+		u8_t nrows = 0;
+
+		for (u8_t j = 0; j < k; ++j) {
+			if (data[j] == NULL) {
+				if (nlost == m) {
+					return false;
+				}
+				lost[nlost++] = j;
+			}
+		}
+		if (nlost == 0) {
+			return true;
+		}
+		for (u8_t i = 0; i < m && nrows < nlost; ++i) {
+			if (parity[i] != NULL) {
+				rows[nrows++] = i;
+			}
+		}
+		if (nrows < nlost) {
+			return false;
+		}
+
+		gf256 const& gf = _gf();
+
+		//syndromes, what the lost blocks contribute to each chosen parity
+		std::vector<byte_t> syndromes(nlost*len);
+		for (u8_t r = 0; r < nlost; ++r) {
+			byte_t* s = &syndromes[r*len];
+			::memcpy(s, parity[rows[r]], len);
+			for (u8_t j = 0; j < k; ++j) {
+				if (data[j] != NULL) {
+					gf.mul_add(s, data[j], _coef(gf, rows[r], j), len);
+				}
+			}
+		}
+
+		//invert the nlost*nlost sub matrix, gauss-jordan
+		byte_t a[WCP_FEC_M_MAX][WCP_FEC_M_MAX];
+		byte_t b[WCP_FEC_M_MAX][WCP_FEC_M_MAX];
+		for (u8_t r = 0; r < nlost; ++r) {
+			for (u8_t c = 0; c < nlost; ++c) {
+				a[r][c] = _coef(gf, rows[r], lost[c]);
+				b[r][c] = (r == c) ? 1 : 0;
+			}
+		}
+
+		for (u8_t c = 0; c < nlost; ++c) {
+			u8_t p = c;
+			while (p < nlost && a[p][c] == 0) {
+				++p;
+			}
+			if (p == nlost) {
+				WAWO_ASSERT(!"cauchy sub matrix is singular");
+				return false;
+			}
+			if (p != c) {
+				for (u8_t x = 0; x < nlost; ++x) {
+					std::swap(a[p][x], a[c][x]);
+					std::swap(b[p][x], b[c][x]);
+				}
+			}
+			byte_t const pinv = gf.inv(a[c][c]);
+			for (u8_t x = 0; x < nlost; ++x) {
+				a[c][x] = gf.mul(a[c][x], pinv);
+				b[c][x] = gf.mul(b[c][x], pinv);
+			}
+			for (u8_t r = 0; r < nlost; ++r) {
+				if (r == c || a[r][c] == 0) {
+					continue;
+				}
+				byte_t const f = a[r][c];
+				for (u8_t x = 0; x < nlost; ++x) {
+					a[r][x] ^= gf.mul(f, a[c][x]);
+					b[r][x] ^= gf.mul(f, b[c][x]);
+				}
+			}
+		}
+
+		for (u8_t c = 0; c < nlost; ++c) {
+			byte_t* out = rebuilt[lost[c]];
+			WAWO_ASSERT(out != NULL);
+			::memset(out, 0, len);
+			for (u8_t r = 0; r < nlost; ++r) {
+				gf.mul_add(out, &syndromes[r*len], b[c][r], len);
+			}
+		}
+		return true;
+	}
+}}
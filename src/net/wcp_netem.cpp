@@ -0,0 +1,204 @@
+#include <wawo/time/time.hpp>
+#include <wawo/log/logger_manager.h>
+#include <wawo/net/wcp_netem.hpp>
+
+namespace wawo { namespace net {
+
+	wcp_netem::wcp_netem() {
+		::memset(&m_conf, 0, sizeof(WCP_NetemConf));
+		::memset(&m_stats, 0, sizeof(WCP_NetemStats));
+		m_rng.seed(std::random_device()());
+	}
+
+	wcp_netem::~wcp_netem() {}
+
+	void wcp_netem::set_conf(WCP_NetemConf const& conf) {
+		lock_guard<spin_mutex> lg(m_mutex);
+		m_conf = conf;
+		m_rng.seed(conf.seed == 0 ? std::random_device()() : conf.seed);
+	}
+
+	WCP_NetemConf wcp_netem::conf() {
+		lock_guard<spin_mutex> lg(m_mutex);
+		return m_conf;
+	}
+
+	WCP_NetemStats wcp_netem::stats() {
+		lock_guard<spin_mutex> lg(m_mutex);
+		return m_stats;
+	}
+
+	void wcp_netem::attach(WWRP<socket_base> const& so) {
+		WAWO_ASSERT(so != NULL);
+		if (!is_running()) {
+			return;
+		}
+
+		lock_guard<spin_mutex> lg(m_mutex);
+		link l = { NULL, 0, 0, 0, false };
+		l.next = so->set_send_shim(wcp_netem::send, wcp_netem::sendto, wcp_netem::sendmmsg);
+		m_links[so->get_fd()] = l;
+	}
+
+	void wcp_netem::on_start() {
+		WAWO_INFO("[wcp][netem]start");
+	}
+
+	void wcp_netem::on_stop() {
+		lock_guard<spin_mutex> lg(m_mutex);
+		m_queue.clear();
+		for (LinkMap::iterator it = m_links.begin(); it != m_links.end(); ++it) {
+			it->second.queued = 0;
+		}
+		WAWO_INFO("[wcp][netem]stop");
+	}
+
+	void wcp_netem::run() {
+		std::vector<datagram> due;
+		{
+			lock_guard<spin_mutex> lg(m_mutex);
+			if (m_queue.empty()) {
+				m_cond.wait<spin_mutex>(m_mutex);
+				return;
+			}
+
+			u64_t const now = wawo::time::curr_microseconds();
+			DatagramQueue::iterator it = m_queue.begin();
+			if (it->first > now) {
+				m_cond.wait_for<spin_mutex>(m_mutex, std::chrono::microseconds(it->first - now));
+				return;
+			}
+
+			while (it != m_queue.end() && it->first <= now) {
+				LinkMap::iterator l = m_links.find(it->second.fd);
+				if (l != m_links.end() && l->second.queued > 0) {
+					--l->second.queued;
+				}
+				due.push_back(std::move(it->second));
+				m_queue.erase(it++);
+			}
+		}
+
+		//the socket might be closed by now, the error is what a lost datagram looks like
+		for (u32_t i = 0; i < due.size(); ++i) {
+			udp_message m;
+			m.buff = &due[i].data[0];
+			m.len = static_cast<u32_t>(due[i].data.size());
+			m.addr = due[i].addr;
+			m.segment = 0;
+			int ec;
+			due[i].next(due[i].fd, &m, 1, ec, 0);
+		}
+	}
+
+	bool wcp_netem::_lost(link& l) {
+		if (m_conf.ge_p > 0) {
+			if (l.bad) {
+				if (_rand() < m_conf.ge_r) {
+					l.bad = false;
+				}
+			} else if (_rand() < m_conf.ge_p) {
+				l.bad = true;
+			}
+			return _rand() < (l.bad ? m_conf.ge_loss_bad : m_conf.ge_loss_good);
+		}
+		return m_conf.loss > 0 && _rand() < m_conf.loss;
+	}
+
+	void wcp_netem::_emulate(int const& fd, byte_t const* const buffer, u32_t const& len, address const& addr) {
+		lock_guard<spin_mutex> lg(m_mutex);
+		LinkMap::iterator it = m_links.find(fd);
+		WAWO_ASSERT(it != m_links.end());
+		link& l = it->second;
+
+		++m_stats.datagrams;
+		m_stats.bytes += len;
+
+		if (_lost(l)) {
+			++m_stats.lost;
+			return;
+		}
+
+		u32_t const copies = (m_conf.duplicate > 0 && _rand() < m_conf.duplicate) ? 2 : 1;
+		if (copies > 1) {
+			++m_stats.duplicated;
+		}
+
+		for (u32_t i = 0; i < copies; ++i) {
+			if (m_conf.limit != 0 && l.queued >= m_conf.limit) {
+				++m_stats.overflowed;
+				return;
+			}
+
+			u64_t const now = wawo::time::curr_microseconds();
+			u64_t at = now;
+			if (m_conf.rate != 0) {
+				l.tx_free = WAWO_MAX(l.tx_free, now) + (u64_t(len) * 1000000) / m_conf.rate;
+				at = l.tx_free;
+			}
+
+			if (m_conf.reorder > 0 && _rand() < m_conf.reorder) {
+				++m_stats.reordered;
+			} else {
+				at += u64_t(m_conf.delay) * 1000;
+				if (m_conf.jitter != 0) {
+					i64_t const jitter = static_cast<i64_t>(m_conf.jitter) * 1000;
+					i64_t const d = std::uniform_int_distribution<i64_t>(-jitter, jitter)(m_rng);
+					at = (d < 0 && u64_t(-d) > (at - now)) ? now : u64_t(i64_t(at) + d);
+				}
+				at = WAWO_MAX(at, l.last);
+				l.last = at;
+			}
+
+			datagram d;
+			d.fd = fd;
+			d.next = l.next;
+			d.addr = addr;
+			d.data.assign(buffer, buffer + len);
+
+			bool const earliest = m_queue.empty() || at < m_queue.begin()->first;
+			m_queue.insert(std::make_pair(at, std::move(d)));
+			++l.queued;
+			if (earliest) {
+				m_cond.notify_one();
+			}
+		}
+	}
+
+	fn_sendmmsg wcp_netem::_next_of(int const& fd) {
+		lock_guard<spin_mutex> lg(m_mutex);
+		LinkMap::iterator it = m_links.find(fd);
+		WAWO_ASSERT(it != m_links.end());
+		return it->second.next;
+	}
+
+	u32_t wcp_netem::send(int const& fd, byte_t const* const buffer, u32_t const& length, int& ec_o, int const& flag) {
+		return wcp_netem::sendto(fd, buffer, length, address(), ec_o, flag);
+	}
+
+	u32_t wcp_netem::sendto(int const& fd, byte_t const* const buffer, u32_t const& length, address const& addr, int& ec_o, int const& flag) {
+		udp_message m;
+		m.buff = const_cast<byte_t*>(buffer);
+		m.len = length;
+		m.addr = addr;
+		m.segment = 0;
+		return wcp_netem::sendmmsg(fd, &m, 1, ec_o, flag) == 1 ? length : 0;
+	}
+
+	u32_t wcp_netem::sendmmsg(int const& fd, udp_message const* const msgs, u32_t const& count, int& ec_o, int const& flag) {
+		wcp_netem* netem = wcp_netem::instance();
+		if (!netem->is_running()) {
+			return netem->_next_of(fd)(fd, msgs, count, ec_o, flag);
+		}
+
+		ec_o = wawo::OK;
+		for (u32_t i = 0; i < count; ++i) {
+			udp_message const& m = msgs[i];
+			u32_t const segment = m.segment == 0 ? m.len : m.segment;
+			for (u32_t offset = 0; offset < m.len; offset += segment) {
+				netem->_emulate(fd, m.buff + offset, WAWO_MIN(segment, m.len - offset), m.addr);
+			}
+		}
+		return count;
+	}
+}}
@@ -0,0 +1,254 @@
+#include <thread>
+
+#include <wawo/time/time.hpp>
+#include <wawo/net/wcp_tuple_table.hpp>
+
+namespace wawo { namespace net {
+
+	//murmur3 finalizer
+	static inline u64_t _mix(u64_t h) {
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	static std::atomic<u32_t> s_reader_stripe_next(0);
+
+	//stripe of current thread, handed out round robin on first use
+	static inline u32_t _reader_stripe() {
+		static WAWO_TLS u32_t _stripe = 0;
+		if (_stripe == 0) {
+			_stripe = (s_reader_stripe_next.fetch_add(1) % WCP_TUPLE_TABLE_READER_STRIPES) + 1;
+		}
+		return _stripe - 1;
+	}
+
+	wcp_tuple_table::slot_array* wcp_tuple_table::_make_array(u32_t const& capacity) {
+		WAWO_ASSERT((capacity&(capacity - 1)) == 0);
+
+		slot_array* a = new slot_array();
+		WAWO_ALLOC_CHECK(a, sizeof(slot_array));
+		a->slots = new slot[capacity];
+		WAWO_ALLOC_CHECK(a->slots, sizeof(slot)*capacity);
+		for (u32_t i = 0; i < capacity; ++i) {
+			a->slots[i].local.store(0, std::memory_order_relaxed);
+			a->slots[i].remote.store(0, std::memory_order_relaxed);
+			a->slots[i].fd.store(SLOT_EMPTY, std::memory_order_relaxed);
+		}
+		a->mask = capacity - 1;
+		return a;
+	}
+
+	void wcp_tuple_table::_free_array(slot_array* a) {
+		delete[] a->slots;
+		delete a;
+	}
+
+	wcp_tuple_table::wcp_tuple_table() :
+		m_array(NULL),
+		m_phase(0),
+		m_count(0),
+		m_erased(0),
+		m_seed(0)
+	{
+		for (u32_t i = 0; i < WCP_TUPLE_TABLE_READER_STRIPES; ++i) {
+			m_readers[i].n[0].store(0, std::memory_order_relaxed);
+			m_readers[i].n[1].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	wcp_tuple_table::~wcp_tuple_table() {
+		deinit();
+	}
+
+	void wcp_tuple_table::init() {
+		lock_guard<spin_mutex> lg(m_mutex);
+		WAWO_ASSERT(m_array.load() == NULL);
+
+		m_seed = _mix(wawo::random_u64() ^ wawo::time::curr_microseconds());
+		m_count = 0;
+		m_erased = 0;
+		m_array.store(_make_array(WCP_TUPLE_TABLE_MIN_CAPACITY));
+	}
+
+	void wcp_tuple_table::deinit() {
+		lock_guard<spin_mutex> lg(m_mutex);
+		slot_array* a = m_array.exchange(NULL);
+		if (a == NULL) {
+			return;
+		}
+		_drain();
+		_free_array(a);
+		m_count = 0;
+		m_erased = 0;
+	}
+
+	u64_t wcp_tuple_table::hash(address const& local, address const& remote) const {
+		return _mix(_mix(local.identity() ^ m_seed) + remote.identity()*0x9e3779b97f4a7c15ULL);
+	}
+
+	void wcp_tuple_table::_rebuild(u32_t const& capacity) {
+		slot_array* o = m_array.load();
+		slot_array* n = _make_array(capacity);
+
+		for (u32_t i = 0; i <= o->mask; ++i) {
+			int const fd = o->slots[i].fd.load(std::memory_order_relaxed);
+			if (fd == SLOT_EMPTY || fd == SLOT_ERASED) {
+				continue;
+			}
+			u64_t const local = o->slots[i].local.load(std::memory_order_relaxed);
+			u64_t const remote = o->slots[i].remote.load(std::memory_order_relaxed);
+
+			u32_t idx = static_cast<u32_t>(hash(address(local), address(remote))) & n->mask;
+			while (n->slots[idx].fd.load(std::memory_order_relaxed) != SLOT_EMPTY) {
+				idx = (idx + 1)&n->mask;
+			}
+			n->slots[idx].local.store(local, std::memory_order_relaxed);
+			n->slots[idx].remote.store(remote, std::memory_order_relaxed);
+			n->slots[idx].fd.store(fd, std::memory_order_relaxed);
+		}
+
+		m_array.store(n);
+		m_erased = 0;
+
+		_drain();
+		_free_array(o);
+	}
+
+	//m_mutex held, after m_array is swapped, no reader holds the old one once it returns
+	void wcp_tuple_table::_drain() {
+		u32_t const prev = m_phase.load();
+		for (u32_t i = 0; i < WCP_TUPLE_TABLE_READER_STRIPES; ++i) {
+			while (m_readers[i].n[prev ^ 1].load() != 0) {
+				std::this_thread::yield();
+			}
+		}
+		m_phase.store(prev ^ 1);
+		for (u32_t i = 0; i < WCP_TUPLE_TABLE_READER_STRIPES; ++i) {
+			while (m_readers[i].n[prev].load() != 0) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	int wcp_tuple_table::insert(address const& local, address const& remote, int const& fd) {
+		WAWO_ASSERT(fd > 0);
+
+		lock_guard<spin_mutex> lg(m_mutex);
+		slot_array* a = m_array.load();
+		if (a == NULL) {
+			return wawo::E_INVALID_STATE;
+		}
+
+		u32_t const capacity = a->mask + 1;
+		if ((m_count + m_erased + 1) * 4 > capacity * 3) {
+			u32_t ncapacity = capacity;
+			while ((m_count + 1) * 2 > ncapacity) {
+				ncapacity <<= 1;
+			}
+			_rebuild(ncapacity);
+			a = m_array.load();
+		}
+
+		u64_t const l = local.identity();
+		u64_t const r = remote.identity();
+		u32_t idx = static_cast<u32_t>(hash(local, remote)) & a->mask;
+		slot* target = NULL;
+
+		while (true) {
+			slot& s = a->slots[idx];
+			int const sfd = s.fd.load(std::memory_order_relaxed);
+			if (sfd == SLOT_EMPTY) {
+				break;
+			}
+			if (sfd == SLOT_ERASED) {
+				if (target == NULL) {
+					target = &s;
+				}
+			} else if (s.local.load(std::memory_order_relaxed) == l && s.remote.load(std::memory_order_relaxed) == r) {
+				return wawo::E_EADDRINUSE;
+			}
+			idx = (idx + 1)&a->mask;
+		}
+
+		if (target == NULL) {
+			target = &a->slots[idx];
+		} else {
+			WAWO_ASSERT(m_erased > 0);
+			--m_erased;
+		}
+
+		//release on the keys too, a reader that sees them sees the slot erased before
+		target->local.store(l, std::memory_order_release);
+		target->remote.store(r, std::memory_order_release);
+		target->fd.store(fd, std::memory_order_release);
+		++m_count;
+		return wawo::OK;
+	}
+
+	int wcp_tuple_table::erase(address const& local, address const& remote, int const& fd) {
+		lock_guard<spin_mutex> lg(m_mutex);
+		slot_array* a = m_array.load();
+		if (a == NULL) {
+			return wawo::E_INVALID_STATE;
+		}
+
+		u64_t const l = local.identity();
+		u64_t const r = remote.identity();
+		u32_t idx = static_cast<u32_t>(hash(local, remote)) & a->mask;
+
+		while (true) {
+			slot& s = a->slots[idx];
+			int const sfd = s.fd.load(std::memory_order_relaxed);
+			if (sfd == SLOT_EMPTY) {
+				return wawo::E_ENOENT;
+			}
+			if (sfd == fd && s.local.load(std::memory_order_relaxed) == l && s.remote.load(std::memory_order_relaxed) == r) {
+				s.fd.store(SLOT_ERASED, std::memory_order_release);
+				WAWO_ASSERT(m_count > 0);
+				--m_count;
+				++m_erased;
+				return wawo::OK;
+			}
+			idx = (idx + 1)&a->mask;
+		}
+	}
+
+	int wcp_tuple_table::find(address const& local, address const& remote) const {
+		std::atomic<u32_t>& in = m_readers[_reader_stripe()].n[m_phase.load()];
+		in.fetch_add(1);
+		slot_array* a = m_array.load();
+		if (a == NULL) {
+			in.fetch_sub(1);
+			return 0;
+		}
+
+		u64_t const l = local.identity();
+		u64_t const r = remote.identity();
+		u32_t idx = static_cast<u32_t>(hash(local, remote)) & a->mask;
+		int found = 0;
+
+		for (u32_t n = 0; n <= a->mask; ++n) {
+			slot& s = a->slots[idx];
+			int const sfd = s.fd.load(std::memory_order_acquire);
+			if (sfd == SLOT_EMPTY) {
+				break;
+			}
+			if (sfd != SLOT_ERASED &&
+				s.local.load(std::memory_order_acquire) == l &&
+				s.remote.load(std::memory_order_acquire) == r &&
+				s.fd.load(std::memory_order_acquire) == sfd
+			) {
+				found = sfd;
+				break;
+			}
+			idx = (idx + 1)&a->mask;
+		}
+
+		in.fetch_sub(1);
+		return found;
+	}
+}}
@@ -0,0 +1,248 @@
+#include <wawo.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "shared.hpp"
+
+//file transfer through the link emulator, goodput and retransmit ratio per scenario
+//usage: wcp_netem_bench [file size in MB] [scenario name]
+
+using namespace wawo;
+using namespace wawo::net;
+
+enum BenchCfg {
+	BENCH_PORT = 32410,
+	BENCH_TIMEOUT = 60 * 1000, //ms
+	BENCH_FILE_SIZE = 8, //MB
+};
+
+struct scenario {
+	char const* name;
+	WCP_NetemConf conf;
+};
+
+//delay, jitter, loss, ge_p, ge_r, ge_loss_good, ge_loss_bad, reorder, duplicate, rate, limit, seed
+static scenario const g_scenarios[] = {
+	{ "loopback",	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 } },
+	{ "lan",		{ 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 } },
+	{ "wan",		{ 25, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 } },
+	{ "loss1",		{ 25, 2, 0.01, 0, 0, 0, 0, 0, 0, 0, 0, 1 } },
+	{ "loss5",		{ 25, 2, 0.05, 0, 0, 0, 0, 0, 0, 0, 0, 1 } },
+	{ "burst",		{ 25, 2, 0, 0.01, 0.3, 0, 0.5, 0, 0, 0, 0, 1 } },
+	{ "reorder",	{ 25, 5, 0, 0, 0, 0, 0, 0.05, 0, 0, 0, 1 } },
+	{ "dup",		{ 25, 2, 0, 0, 0, 0, 0, 0, 0.02, 0, 0, 1 } },
+	{ "cap",		{ 25, 0, 0, 0, 0, 0, 0, 0, 0, 2 * 1024 * 1024, 256, 1 } },
+	{ "mobile",		{ 60, 20, 0.01, 0, 0, 0, 0, 0.01, 0, 1024 * 1024, 128, 1 } },
+};
+
+struct bench_result {
+	int rt;
+	u64_t ms;
+	WCP_Info info; //of the sending side
+	WCP_NetemStats netem;
+};
+
+static int send_all(int const& fd, byte_t const* const buffer, u32_t const& len, u64_t const& deadline) {
+	u32_t sent = 0;
+	while (sent < len) {
+		int n = wcp::instance()->send(fd, buffer + sent, len - sent, 0);
+		if (n > 0) {
+			sent += n;
+			continue;
+		}
+		if (n != WAWO_NEGATIVE(EWOULDBLOCK)) {
+			return n;
+		}
+		if (wawo::time::curr_milliseconds() > deadline) {
+			return wawo::E_ETIMEOUT;
+		}
+		wawo::this_thread::sleep(1);
+	}
+	return wawo::OK;
+}
+
+static int recv_all(int const& fd, byte_t* const buffer, u32_t const& len, u64_t const& deadline) {
+	u32_t got = 0;
+	while (got < len) {
+		int n = wcp::instance()->recv(fd, buffer + got, len - got, 0);
+		if (n > 0) {
+			got += n;
+			continue;
+		}
+		if (n == 0) {
+			return wawo::E_ECONNRESET;
+		}
+		if (n != WAWO_NEGATIVE(EWOULDBLOCK)) {
+			return n;
+		}
+		if (wawo::time::curr_milliseconds() > deadline) {
+			return wawo::E_ETIMEOUT;
+		}
+		wawo::this_thread::sleep(1);
+	}
+	return wawo::OK;
+}
+
+//the test/wcp client and server exchange, request, header with the length, then the content
+static bench_result run(scenario const& s, u16_t const& port, std::vector<byte_t> const& file) {
+	bench_result r;
+	::memset(&r, 0, sizeof(bench_result));
+
+	wcp* w = wcp::instance();
+	wcp_netem::instance()->set_conf(s.conf);
+	WCP_NetemStats const netem_begin = wcp_netem::instance()->stats();
+
+	sockaddr_in addr;
+	::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	int l = w->socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	int c = w->socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	int a = -1;
+	u64_t const deadline = wawo::time::curr_milliseconds() + BENCH_TIMEOUT;
+
+	do {
+		//the accepted ones bind to the listen address too
+		int on = 1;
+		w->setsockopt(l, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		w->setsockopt(l, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+		r.rt = w->bind(l, (sockaddr*)&addr, sizeof(addr));
+		if (r.rt != wawo::OK) break;
+		r.rt = w->listen(l, 16);
+		if (r.rt != wawo::OK) break;
+		r.rt = w->connect(c, (sockaddr*)&addr, sizeof(addr));
+		if (r.rt != wawo::OK) break;
+
+		w->fcntl_setfl(l, WCP_O_NONBLOCK);
+		sockaddr_in from;
+		socklen_t fromlen = sizeof(from);
+		while ((a = w->accept(l, (sockaddr*)&from, &fromlen)) < 0 && wawo::time::curr_milliseconds() < deadline) {
+			wawo::this_thread::sleep(1);
+		}
+		if (a < 0) {
+			r.rt = wawo::E_ETIMEOUT;
+			break;
+		}
+		w->fcntl_setfl(a, WCP_O_NONBLOCK);
+		w->fcntl_setfl(c, WCP_O_NONBLOCK);
+
+		u64_t const begin = wawo::time::curr_milliseconds();
+
+		byte_t req[sizeof(u32_t)];
+		wawo::bytes_helper::write_u32(wcp_test::C_TRANSFER_FILE, &req[0]);
+		r.rt = send_all(c, req, sizeof(req), deadline);
+		if (r.rt != wawo::OK) break;
+
+		//server side, runs inline, the sockets are non blocking
+		r.rt = recv_all(a, req, sizeof(req), deadline);
+		if (r.rt != wawo::OK) break;
+		byte_t header[sizeof(u32_t)];
+		wawo::bytes_helper::write_u32(static_cast<u32_t>(file.size()), &header[0]);
+		r.rt = send_all(a, header, sizeof(header), deadline);
+		if (r.rt != wawo::OK) break;
+
+		std::vector<byte_t> received(file.size());
+		u32_t sent = 0;
+		u32_t got = 0;
+		r.rt = recv_all(c, header, sizeof(header), deadline);
+		if (r.rt != wawo::OK) break;
+
+		while (got < file.size() && r.rt == wawo::OK) {
+			if (sent < file.size()) {
+				int n = w->send(a, &file[sent], static_cast<u32_t>(file.size()) - sent, 0);
+				if (n > 0) {
+					sent += n;
+				} else if (n != WAWO_NEGATIVE(EWOULDBLOCK)) {
+					r.rt = n;
+					break;
+				}
+			}
+
+			int n = w->recv(c, &received[got], static_cast<u32_t>(file.size()) - got, 0);
+			if (n > 0) {
+				got += n;
+			} else if (n == 0) {
+				r.rt = wawo::E_ECONNRESET;
+			} else if (n != WAWO_NEGATIVE(EWOULDBLOCK)) {
+				r.rt = n;
+			} else if (wawo::time::curr_milliseconds() > deadline) {
+				r.rt = wawo::E_ETIMEOUT;
+			} else {
+				wawo::this_thread::sleep(1);
+			}
+		}
+		if (r.rt != wawo::OK) break;
+
+		r.ms = wawo::time::curr_milliseconds() - begin;
+		if (::memcmp(&received[0], &file[0], file.size()) != 0) {
+			r.rt = wawo::E_EINVAL;
+			break;
+		}
+
+		socklen_t len = sizeof(WCP_Info);
+		w->getsockopt(a, WCP_SOL, WCP_SO_INFO, &r.info, &len);
+	} while (false);
+
+	if (a > 0) w->close(a);
+	w->close(c);
+	w->close(l);
+
+	WCP_NetemStats const netem_end = wcp_netem::instance()->stats();
+	r.netem.datagrams = netem_end.datagrams - netem_begin.datagrams;
+	r.netem.lost = netem_end.lost - netem_begin.lost;
+	r.netem.overflowed = netem_end.overflowed - netem_begin.overflowed;
+	return r;
+}
+
+static void report(scenario const& s, u32_t const& size, bench_result const& r) {
+	if (r.rt != wawo::OK) {
+		printf("%-10s failed: %d\n", s.name, r.rt);
+		return;
+	}
+
+	WCP_Counters const& c = r.info.counters;
+	u64_t const rt = c.retransmits_ack_skip + c.retransmits_fast_recovery + c.retransmits_rto;
+	printf("%-10s %8.2f MB/s %7llu ms, retransmit ratio: %6.2f%% (as: %llu, fr: %llu, rto: %llu), rto fires: %llu, srtt: %u, link dropped: %llu/%llu\n",
+		s.name,
+		(double(size) / (1024 * 1024)) / (double(r.ms == 0 ? 1 : r.ms) / 1000),
+		(unsigned long long)r.ms,
+		c.packs_out == 0 ? 0.0 : (double(rt) * 100 / double(c.packs_out)),
+		(unsigned long long)c.retransmits_ack_skip,
+		(unsigned long long)c.retransmits_fast_recovery,
+		(unsigned long long)c.retransmits_rto,
+		(unsigned long long)c.rto_fires,
+		r.info.srtt,
+		(unsigned long long)(r.netem.lost + r.netem.overflowed),
+		(unsigned long long)r.netem.datagrams
+	);
+}
+
+int main(int argc, char** argv) {
+	u32_t const mb = argc > 1 ? static_cast<u32_t>(::atoi(argv[1])) : BENCH_FILE_SIZE;
+	char const* const only = argc > 2 ? argv[2] : NULL;
+
+	wawo::app _app;
+
+	//before any socket, only the ones created after start are attached
+	int startrt = wcp_netem::instance()->start();
+	WAWO_RETURN_V_IF_NOT_MATCH(startrt, startrt == wawo::OK);
+
+	std::vector<byte_t> file(mb * 1024 * 1024);
+	for (u32_t i = 0; i < file.size(); ++i) {
+		file[i] = static_cast<byte_t>(wawo::random_u8());
+	}
+
+	u16_t port = BENCH_PORT;
+	for (u32_t i = 0; i < sizeof(g_scenarios) / sizeof(g_scenarios[0]); ++i) {
+		if (only != NULL && ::strcmp(only, g_scenarios[i].name) != 0) {
+			continue;
+		}
+		report(g_scenarios[i], static_cast<u32_t>(file.size()), run(g_scenarios[i], port++, file));
+	}
+
+	wcp_netem::instance()->stop();
+	return 0;
+}
@@ -0,0 +1,129 @@
+
+#include <wawo.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+
+//allocation benchmark for the wcp pack path, heap based packs vs pooled packs
+
+static std::atomic<wawo::u64_t> g_nalloc(0);
+
+void* operator new(std::size_t size) {
+	g_nalloc.fetch_add(1, std::memory_order_relaxed);
+	void* p = ::malloc(size == 0 ? 1 : size);
+	if (p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) _WW_NOEXCEPT {
+	::free(p);
+}
+
+void* operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+
+void operator delete[](void* p) _WW_NOEXCEPT {
+	::operator delete(p);
+}
+
+namespace legacy {
+	using namespace wawo::net;
+
+	//the layout before object pool
+	struct WCB_pack {
+		WCP_Header header;
+		WWSP<wawo::packet> data;
+		wawo::u64_t sent_ts;
+		wawo::u32_t sent_times;
+	};
+
+	struct WCB_received_pack {
+		WCP_Header header;
+		WWSP<wawo::packet> data;
+		address	from;
+	};
+}
+
+enum BenchCfg {
+	PACK_COUNT = 1000000,
+	FLIGHT_WINDOW = 768, //1MB window of MDU
+};
+
+static wawo::byte_t g_payload[WCP_MDU];
+
+struct bench_result {
+	wawo::u64_t ns;
+	wawo::u64_t nalloc;
+};
+
+//one data pack goes out, one received pack comes in, and the oldest flight is acked
+template <class _Fn>
+bench_result run(_Fn const& fn) {
+	wawo::u64_t nalloc_begin = g_nalloc.load();
+	wawo::u64_t begin = wawo::time::curr_nanoseconds();
+	fn();
+	bench_result r = { wawo::time::curr_nanoseconds() - begin, g_nalloc.load() - nalloc_begin };
+	return r;
+}
+
+void bench_legacy() {
+	std::deque< WWSP<legacy::WCB_pack> > flights;
+	for (wawo::u32_t i = 0; i < PACK_COUNT; ++i) {
+		WWSP<legacy::WCB_pack> opack = wawo::make_shared<legacy::WCB_pack>();
+		opack->header.seq = i;
+		WWSP<wawo::packet> data = wawo::make_shared<wawo::packet>(WCP_MDU);
+		data->write(g_payload, WCP_MDU);
+		opack->data = data;
+		opack->header.dlen = WCP_MDU;
+		flights.push_back(opack);
+
+		WWSP<legacy::WCB_received_pack> inpack = wawo::make_shared<legacy::WCB_received_pack>();
+		WWSP<wawo::packet> idata = wawo::make_shared<wawo::packet>(WCP_MDU);
+		idata->write(g_payload, WCP_MDU);
+		inpack->data = idata;
+
+		if (flights.size() > FLIGHT_WINDOW) {
+			flights.pop_front();
+		}
+	}
+}
+
+void bench_pooled() {
+	std::deque< WWRP<wawo::net::WCB_pack> > flights;
+	for (wawo::u32_t i = 0; i < PACK_COUNT; ++i) {
+		WWRP<wawo::net::WCB_pack> opack = wawo::make_ref<wawo::net::WCB_pack>();
+		opack->header.seq = i;
+		::memcpy(opack->data, g_payload, WCP_MDU);
+		opack->header.dlen = WCP_MDU;
+		flights.push_back(opack);
+
+		WWRP<wawo::net::WCB_received_pack> inpack = wawo::make_ref<wawo::net::WCB_received_pack>();
+		::memcpy(inpack->data, g_payload, WCP_MDU);
+		inpack->header.dlen = WCP_MDU;
+
+		if (flights.size() > FLIGHT_WINDOW) {
+			flights.pop_front();
+		}
+	}
+}
+
+void report(char const* const name, bench_result const& r) {
+	printf("%-8s packs: %u, ns/pack: %.1f, allocations/pack: %.3f\n", name, PACK_COUNT, double(r.ns) / PACK_COUNT, double(r.nalloc) / PACK_COUNT);
+}
+
+int main(int argc, char** argv) {
+	(void)argc;
+	(void)argv;
+
+	//warm up the pool the way an engine thread does
+	wawo::object_pool_slab() = 1;
+	bench_pooled();
+
+	report("heap", run(bench_legacy));
+	report("pooled", run(bench_pooled));
+	return 0;
+}
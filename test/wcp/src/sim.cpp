@@ -0,0 +1,400 @@
+#include <wawo.h>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+//virtual time simulation of many wcp connections sharing one bottleneck, the same arguments give the same run
+//usage: wcp_sim [flows] [bottleneck Mbit/s] [seconds] [seed] [reno|bbr] [pace]
+//
+//dumbbell, each sender pushes bulk data through a drop tail bottleneck to its receiver, the acks come back uncongested
+//no engine is started, the loop steps one engine on wcp_clock, which only moves when the loop says so
+//the wcb pairs are made established by hand, there is no handshake, no socket io, the datagrams go through a send shim
+
+using namespace wawo;
+using namespace wawo::net;
+
+enum SimCfg {
+	SIM_FLOWS = 100,
+	SIM_RATE = 100, //Mbit/s
+	SIM_SECONDS = 15,
+	SIM_SEED = 1,
+	SIM_RTT_MIN = 10, //ms, base rtt of a flow, uniform in [min,max]
+	SIM_RTT_MAX = 100,
+	SIM_START_SPREAD = 2000, //ms, start of a flow, uniform in it
+	SIM_WARMUP = 5000, //ms, left out of the measurement
+	SIM_BUFFER = 50, //ms of the bottleneck rate
+	SIM_IO_CHUNK = 64 * 1024
+};
+
+//far from 0, a time of 0 reads as none in the wcb
+static u64_t g_now_us = u64_t(1000000) * 1000000;
+static u64_t sim_clock() {
+	return g_now_us;
+}
+
+struct sim_endpoint {
+	WWRP<WCB> wcb;
+	u32_t flow;
+	bool sender;
+	bool touched;
+};
+
+struct sim_flow {
+	u32_t rtt; //ms
+	u64_t start_us;
+	u64_t delivered; //bytes read by the receiver
+	u64_t delivered_warm;
+	sim_endpoint* snd;
+	sim_endpoint* rcv;
+};
+
+struct sim_datagram {
+	sim_endpoint* dst;
+	std::vector<byte_t> data;
+};
+
+struct sim_bottleneck {
+	u64_t bps;
+	u64_t buffer; //bytes
+	u64_t free_ns; //busy until
+	u64_t arrived;
+	u64_t dropped;
+	u64_t bytes; //since warmup
+	u64_t qdelay_sum; //us
+	u64_t qdelay_max;
+	std::vector<u64_t> qdelay_hist; //ms buckets
+};
+
+typedef std::unordered_map<u64_t, sim_endpoint*> EndpointMap;
+typedef std::multimap<u64_t, sim_datagram> DatagramQueue;
+
+struct sim_net {
+	EndpointMap endpoints;
+	DatagramQueue queue;
+	sim_bottleneck link;
+	std::vector<sim_flow> flows;
+	std::vector<sim_endpoint*> touched;
+	bool warm;
+
+	inline void touch(sim_endpoint* ep) {
+		if (!ep->touched) {
+			ep->touched = true;
+			touched.push_back(ep);
+		}
+	}
+
+	//datagrams to the receivers queue up at the bottleneck, the acks go straight
+	void transmit(address const& to, byte_t const* const buffer, u32_t const& len) {
+		EndpointMap::iterator it = endpoints.find(to.identity());
+		WAWO_ASSERT(it != endpoints.end());
+		sim_endpoint* dst = it->second;
+		sim_flow const& f = flows[dst->flow];
+
+		u64_t const now_ns = g_now_us * 1000;
+		u64_t at_ns = now_ns;
+		if (!dst->sender) {
+			++link.arrived;
+			u64_t const backlog_ns = link.free_ns > now_ns ? link.free_ns - now_ns : 0;
+			u64_t const backlog = (backlog_ns * link.bps) / (u64_t(8) * 1000000000);
+			if (backlog + len > link.buffer) {
+				++link.dropped;
+				return;
+			}
+
+			u64_t const qdelay_us = backlog_ns / 1000;
+			link.qdelay_sum += qdelay_us;
+			link.qdelay_max = WAWO_MAX(link.qdelay_max, qdelay_us);
+			u64_t const bucket = WAWO_MIN(qdelay_us / 1000, u64_t(link.qdelay_hist.size() - 1));
+			++link.qdelay_hist[bucket];
+			if (warm) {
+				link.bytes += len;
+			}
+
+			link.free_ns = WAWO_MAX(link.free_ns, now_ns) + (u64_t(len) * 8 * 1000000000) / link.bps;
+			at_ns = link.free_ns;
+		}
+
+		sim_datagram d;
+		d.dst = dst;
+		d.data.assign(buffer, buffer + len);
+		u64_t const at = (at_ns + 999) / 1000 + u64_t(f.rtt) * 1000 / 2;
+		queue.insert(std::make_pair(at, std::move(d)));
+	}
+};
+
+static sim_net g_net;
+
+static u32_t sim_sendmmsg(int const& fd, udp_message const* const msgs, u32_t const& count, int& ec_o, int const& flag) {
+	(void)fd;
+	(void)flag;
+	ec_o = wawo::OK;
+	for (u32_t i = 0; i < count; ++i) {
+		udp_message const& m = msgs[i];
+		u32_t const segment = m.segment == 0 ? m.len : m.segment;
+		for (u32_t offset = 0; offset < m.len; offset += segment) {
+			g_net.transmit(m.addr, m.buff + offset, WAWO_MIN(segment, m.len - offset));
+		}
+	}
+	return count;
+}
+
+static u32_t sim_sendto(int const& fd, byte_t const* const buffer, u32_t const& length, address const& addr, int& ec_o, int const& flag) {
+	udp_message m;
+	m.buff = const_cast<byte_t*>(buffer);
+	m.len = length;
+	m.addr = addr;
+	m.segment = 0;
+	return sim_sendmmsg(fd, &m, 1, ec_o, flag) == 1 ? length : 0;
+}
+
+//the shared socket is never connected
+static u32_t sim_send(int const& fd, byte_t const* const buffer, u32_t const& length, int& ec_o, int const& flag) {
+	(void)fd;
+	(void)buffer;
+	(void)length;
+	(void)flag;
+	WAWO_ASSERT(!"connected send in simulation");
+	ec_o = wawo::E_EINVAL;
+	return 0;
+}
+
+static WWRP<WCB> make_wcb(WWRP<wcp_engine> const& engine, WWRP<wawo::net::socket> const& so, int const& fd, u64_t const& local, u64_t const& remote, u8_t const& congestion, u8_t const& pacing) {
+	WWRP<WCB> wcb = wawo::make_ref<WCB>();
+	wcb->init();
+	wcb->set_congestion(congestion);
+	wcb->pacing = pacing;
+	wcb->fd = fd;
+	wcb->so = so;
+	wcb->engine = engine;
+	wcb->local_addr = address(local);
+	wcb->remote_addr = address(remote);
+	wcb->wcb_option |= WCP_O_NONBLOCK;
+	wcb->state = WCB_ESTABLISHED;
+	return wcb;
+}
+
+//bytes moved between the app and the wcb of each endpoint touched, false once nothing moves
+static bool sim_app_io(std::vector<byte_t>& io) {
+	bool moved = false;
+	for (u32_t i = 0; i < g_net.touched.size(); ++i) {
+		sim_endpoint* ep = g_net.touched[i];
+		sim_flow& f = g_net.flows[ep->flow];
+		if (ep->sender) {
+			if (g_now_us < f.start_us) {
+				continue;
+			}
+			int n;
+			while ((n = ep->wcb->send(&io[0], static_cast<u32_t>(io.size()))) > 0) {
+				moved = true;
+			}
+		} else {
+			int n;
+			while ((n = ep->wcb->recv(&io[0], static_cast<u32_t>(io.size()))) > 0) {
+				f.delivered += n;
+				moved = true;
+			}
+		}
+	}
+	return moved;
+}
+
+static double percentile(std::vector<u64_t> const& hist, u64_t const& total, double const& p) {
+	u64_t const target = static_cast<u64_t>(double(total) * p);
+	u64_t sum = 0;
+	for (u32_t i = 0; i < hist.size(); ++i) {
+		sum += hist[i];
+		if (sum > target) {
+			return double(i);
+		}
+	}
+	return double(hist.size() - 1);
+}
+
+int main(int argc, char** argv) {
+	u32_t const nflows = argc > 1 ? static_cast<u32_t>(::atoi(argv[1])) : SIM_FLOWS;
+	u32_t const mbps = argc > 2 ? static_cast<u32_t>(::atoi(argv[2])) : SIM_RATE;
+	u32_t const seconds = argc > 3 ? static_cast<u32_t>(::atoi(argv[3])) : SIM_SECONDS;
+	u32_t const seed = argc > 4 ? static_cast<u32_t>(::atoi(argv[4])) : SIM_SEED;
+	u8_t const congestion = (argc > 5 && ::strcmp(argv[5], "bbr") == 0) ? WCP_CC_BBR : WCP_CC_RENO;
+	u8_t const pacing = (argc > 6 && ::strcmp(argv[6], "pace") == 0) ? 1 : 0;
+
+	if (nflows == 0 || nflows > 60000 || mbps == 0 || seconds * 1000 <= SIM_WARMUP) {
+		printf("usage: wcp_sim [flows] [bottleneck Mbit/s] [seconds > %u] [seed] [reno|bbr] [pace]\n", SIM_WARMUP / 1000);
+		return -1;
+	}
+
+	//before the engine, its timer wheel starts at wcp_now()
+	wcp_clock = sim_clock;
+	u64_t const begin_us = g_now_us;
+	u64_t const warm_us = begin_us + u64_t(SIM_WARMUP) * 1000;
+	u64_t const end_us = begin_us + u64_t(seconds) * 1000000;
+
+	std::mt19937_64 rng(seed);
+	WWRP<wcp_engine> engine = wawo::make_ref<wcp_engine>(0);
+
+	//all wcb send through one socket, opened for its fd and flags, never bound
+	WWRP<wawo::net::socket> so = wawo::make_ref<wawo::net::socket>(F_AF_INET, ST_DGRAM, P_UDP, OPTION_NON_BLOCKING);
+	int openrt = so->open();
+	WAWO_RETURN_V_IF_NOT_MATCH(openrt, openrt == wawo::OK);
+	so->set_send_shim(sim_send, sim_sendto, sim_sendmmsg);
+
+	sim_bottleneck& link = g_net.link;
+	link.bps = u64_t(mbps) * 1000000;
+	link.buffer = (link.bps / 8) * SIM_BUFFER / 1000;
+	link.free_ns = 0;
+	link.arrived = 0;
+	link.dropped = 0;
+	link.bytes = 0;
+	link.qdelay_sum = 0;
+	link.qdelay_max = 0;
+	link.qdelay_hist.assign(1000, 0);
+	g_net.warm = false;
+
+	std::vector<sim_endpoint> endpoints(nflows * 2);
+	g_net.flows.resize(nflows);
+	for (u32_t i = 0; i < nflows; ++i) {
+		sim_flow& f = g_net.flows[i];
+		f.rtt = std::uniform_int_distribution<u32_t>(SIM_RTT_MIN, SIM_RTT_MAX)(rng);
+		f.start_us = begin_us + std::uniform_int_distribution<u64_t>(0, u64_t(SIM_START_SPREAD) * 1000)(rng);
+		f.delivered = 0;
+		f.delivered_warm = 0;
+		f.snd = &endpoints[i * 2];
+		f.rcv = &endpoints[i * 2 + 1];
+
+		//10.0.0.1:port -> 10.1.0.1:port, a port per flow
+		u64_t const snd_addr = (u64_t(0x0A000001) << 16) | (i + 1);
+		u64_t const rcv_addr = (u64_t(0x0A010001) << 16) | (i + 1);
+		f.snd->wcb = make_wcb(engine, so, i * 2 + 1, snd_addr, rcv_addr, congestion, pacing);
+		f.snd->flow = i;
+		f.snd->sender = true;
+		f.snd->touched = false;
+		f.rcv->wcb = make_wcb(engine, so, i * 2 + 2, rcv_addr, snd_addr, congestion, pacing);
+		f.rcv->flow = i;
+		f.rcv->sender = false;
+		f.rcv->touched = false;
+		g_net.endpoints[snd_addr] = f.snd;
+		g_net.endpoints[rcv_addr] = f.rcv;
+	}
+
+	//the starts in time order
+	std::multimap<u64_t, sim_endpoint*> starts;
+	for (u32_t i = 0; i < nflows; ++i) {
+		starts.insert(std::make_pair(g_net.flows[i].start_us, g_net.flows[i].snd));
+	}
+
+	std::vector<byte_t> io(SIM_IO_CHUNK);
+	u64_t const wall_begin = wawo::time::curr_milliseconds();
+	u64_t steps = 0;
+	u64_t delivered_datagrams = 0;
+
+	while (g_now_us < end_us) {
+		if (!g_net.warm && g_now_us >= warm_us) {
+			g_net.warm = true;
+			for (u32_t i = 0; i < nflows; ++i) {
+				g_net.flows[i].delivered_warm = g_net.flows[i].delivered;
+			}
+		}
+
+		while (!starts.empty() && starts.begin()->first <= g_now_us) {
+			g_net.touch(starts.begin()->second);
+			starts.erase(starts.begin());
+		}
+
+		while (!g_net.queue.empty() && g_net.queue.begin()->first <= g_now_us) {
+			sim_datagram& d = g_net.queue.begin()->second;
+			sim_endpoint* dst = d.dst;
+			dst->wcb->pump_pack(&d.data[0], static_cast<u32_t>(d.data.size()), dst->wcb->remote_addr);
+			g_net.touch(dst);
+			g_net.queue.erase(g_net.queue.begin());
+			++delivered_datagrams;
+		}
+
+		u64_t const now_ms = g_now_us / 1000;
+		do {
+			engine->step(now_ms);
+			++steps;
+		} while (sim_app_io(io));
+
+		for (u32_t i = 0; i < g_net.touched.size(); ++i) {
+			g_net.touched[i]->touched = false;
+		}
+		g_net.touched.clear();
+
+		u64_t next = end_us;
+		if (!g_net.queue.empty()) {
+			next = WAWO_MIN(next, g_net.queue.begin()->first);
+		}
+		if (!starts.empty()) {
+			next = WAWO_MIN(next, starts.begin()->first);
+		}
+		u64_t const tick = engine->next_tick();
+		if (tick != ((u64_t)-1)) {
+			next = WAWO_MIN(next, tick * 1000);
+		}
+		if (!g_net.warm) {
+			next = WAWO_MIN(next, warm_us);
+		}
+		g_now_us = WAWO_MAX(next, g_now_us + 1);
+	}
+	u64_t const wall_ms = wawo::time::curr_milliseconds() - wall_begin;
+
+	//goodput of each flow over the measured part, jain's index over them
+	double const window_s = double(end_us - warm_us) / 1000000;
+	double sum = 0;
+	double sum_sq = 0;
+	double gmin = -1;
+	double gmax = 0;
+	for (u32_t i = 0; i < nflows; ++i) {
+		sim_flow const& f = g_net.flows[i];
+		double const g = double(f.delivered - f.delivered_warm) * 8 / window_s / 1000000; //Mbit/s
+		sum += g;
+		sum_sq += g*g;
+		gmin = (gmin < 0 || g < gmin) ? g : gmin;
+		gmax = WAWO_MAX(gmax, g);
+		if (nflows <= 16) {
+			printf("flow %3u rtt: %3u ms, goodput: %8.3f Mbit/s\n", i, f.rtt, g);
+		}
+	}
+
+	WCP_Counters c;
+	::memset(&c, 0, sizeof(WCP_Counters));
+	engine->counters(c);
+	u64_t const rt = c.retransmits_ack_skip + c.retransmits_fast_recovery + c.retransmits_rto;
+	u64_t const queued = link.arrived - link.dropped;
+
+	printf("flows: %u, bottleneck: %u Mbit/s, buffer: %llu bytes, rtt: [%u,%u] ms, cc: %s%s, seed: %u, simulated: %u s (%u s warmup)\n",
+		nflows, mbps, (unsigned long long)link.buffer, SIM_RTT_MIN, SIM_RTT_MAX, congestion == WCP_CC_BBR ? "bbr" : "reno", pacing ? " paced" : "", seed, seconds, SIM_WARMUP / 1000);
+	printf("goodput: %.3f Mbit/s, per flow min/avg/max: %.3f/%.3f/%.3f Mbit/s, jain fairness: %.4f\n",
+		sum, gmin, sum / nflows, gmax, sum_sq == 0 ? 0.0 : (sum*sum) / (nflows*sum_sq));
+	printf("utilisation: %.2f%% (goodput %.2f%%), bottleneck drop: %.3f%% (%llu/%llu)\n",
+		double(link.bytes) * 8 * 100 / (window_s * double(link.bps)),
+		sum * 100 / mbps,
+		link.arrived == 0 ? 0.0 : double(link.dropped) * 100 / double(link.arrived),
+		(unsigned long long)link.dropped, (unsigned long long)link.arrived);
+	printf("queueing delay: avg %.2f ms, p50 %.0f ms, p99 %.0f ms, max %.2f ms\n",
+		queued == 0 ? 0.0 : double(link.qdelay_sum) / double(queued) / 1000,
+		percentile(link.qdelay_hist, queued, 0.5),
+		percentile(link.qdelay_hist, queued, 0.99),
+		double(link.qdelay_max) / 1000);
+	printf("retransmit ratio: %.2f%% (as: %llu, fr: %llu, rto: %llu), rto fires: %llu\n",
+		c.packs_out == 0 ? 0.0 : double(rt) * 100 / double(c.packs_out),
+		(unsigned long long)c.retransmits_ack_skip,
+		(unsigned long long)c.retransmits_fast_recovery,
+		(unsigned long long)c.retransmits_rto,
+		(unsigned long long)c.rto_fires);
+	printf("wall: %llu ms, steps: %llu, datagrams: %llu\n",
+		(unsigned long long)wall_ms, (unsigned long long)steps, (unsigned long long)delivered_datagrams);
+
+	//break the wcb <-> engine cycle
+	for (u32_t i = 0; i < endpoints.size(); ++i) {
+		endpoints[i].wcb->engine = NULL;
+		endpoints[i].wcb = NULL;
+	}
+	//a nonblocking close reports to the scheduler, which is not started
+	so->turnoff_nonblocking();
+	so->close();
+	return 0;
+}